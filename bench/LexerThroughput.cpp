@@ -0,0 +1,162 @@
+#include <Jasmin/Lexer.hpp>
+#include <Jasmin/Parser.hpp>
+#include <Jasmin/SourceCache.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory_resource>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef CORPUS_DIR
+#define CORPUS_DIR "corpus"
+#endif
+
+//corpus driven throughput benchmark for the lexer (and parser), shares its
+//corpus with the fuzzers. usage:
+//  LexerThroughput [corpus dir] [--iterations N] [--min-mbps X]
+//exits with 1 when lexing throughput falls below --min-mbps
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static std::vector<std::string> loadCorpus(const fs::path& dir)
+{
+  std::vector<std::string> sources;
+
+  for(const auto& entry : fs::directory_iterator{dir})
+  {
+    if(!entry.is_regular_file())
+      continue;
+
+    std::ifstream file{entry.path(), std::ios::binary};
+    std::stringstream contents;
+    contents << file.rdbuf();
+    sources.emplace_back(contents.str());
+  }
+
+  return sources;
+}
+
+template<typename Func>
+static double measureMBps(const std::vector<std::string>& sources,
+                          size_t totalBytes, unsigned iterations, Func func)
+{
+  auto start = Clock::now();
+
+  for(unsigned i = 0; i < iterations; ++i)
+    for(const auto& source : sources)
+      func(source);
+
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  return (double(totalBytes) * iterations) / (1024.0 * 1024.0) / elapsed.count();
+}
+
+int main(int argc, char** argv)
+{
+  fs::path corpusDir = CORPUS_DIR;
+  unsigned iterations = 200;
+  double minMBps = 0;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if(arg == "--iterations" && i+1 < argc)
+      iterations = std::stoul(argv[++i]);
+    else if(arg == "--min-mbps" && i+1 < argc)
+      minMBps = std::stod(argv[++i]);
+    else
+      corpusDir = arg;
+  }
+
+  std::vector<std::string> sources;
+  try
+  {
+    sources = loadCorpus(corpusDir);
+  }
+  catch(const fs::filesystem_error& e)
+  {
+    std::cerr << e.what() << '\n';
+    return 2;
+  }
+
+  size_t totalBytes = 0;
+  for(const auto& source : sources)
+    totalBytes += source.size();
+
+  if(totalBytes == 0)
+  {
+    std::cerr << "empty corpus: " << corpusDir << '\n';
+    return 2;
+  }
+
+  //keep results alive so the work cant be optimized out
+  size_t sink = 0;
+
+  double lexMBps = measureMBps(sources, totalBytes, iterations,
+    [&](const std::string& source)
+    {
+      sink += Jasmin::Lexer::LexAll(Jasmin::InStream{source}).size();
+    });
+
+  double parseMBps = measureMBps(sources, totalBytes, iterations,
+    [&](const std::string& source)
+    {
+      sink += Jasmin::Parser::ParseAll(
+          Jasmin::Lexer::LexAll(Jasmin::InStream{source})).size();
+    });
+
+  //a monotonic buffer released after every source, like a per request arena
+  std::pmr::monotonic_buffer_resource arena;
+  double arenaMBps = measureMBps(sources, totalBytes, iterations,
+    [&](const std::string& source)
+    {
+      {
+        auto tokens = Jasmin::Lexer::LexAll(Jasmin::InStream{source}, &arena);
+        sink += Jasmin::Parser::ParseAll(tokens, &arena).size();
+      }
+      arena.release();
+    });
+
+  Jasmin::ParseVisitor noopVisitor;
+  double visitMBps = measureMBps(sources, totalBytes, iterations,
+    [&](const std::string& source)
+    {
+      Jasmin::Parser::Visit(Jasmin::Lexer{Jasmin::InStream{source}}, noopVisitor);
+    });
+
+  //images are built up front, only loading them (hash check + nodes) is timed
+  std::vector<std::string> images;
+  for(const auto& source : sources)
+    images.push_back(Jasmin::SourceCache::Build(source));
+
+  size_t nextImage = 0;
+  double cachedMBps = measureMBps(sources, totalBytes, iterations,
+    [&](const std::string& source)
+    {
+      Jasmin::SourceCache cache{images[nextImage++ % images.size()]};
+      if(cache.Matches(source))
+        sink += cache.Nodes().size();
+    });
+
+  std::cout << "corpus: " << sources.size() << " files, " << totalBytes << " bytes\n"
+            << "lex:         " << lexMBps   << " MB/s\n"
+            << "lex + parse: " << parseMBps << " MB/s\n"
+            << "  (arena):   " << arenaMBps << " MB/s\n"
+            << "lex + visit: " << visitMBps << " MB/s\n"
+            << "cached:      " << cachedMBps << " MB/s\n"
+            << "(" << sink << " tokens + nodes)\n";
+
+  if(lexMBps < minMBps)
+  {
+    std::cerr << "lexing throughput regressed below " << minMBps << " MB/s\n";
+    return 1;
+  }
+
+  return 0;
+}
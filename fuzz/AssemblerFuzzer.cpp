@@ -0,0 +1,27 @@
+#include <Jasmin/Assembler.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+  //an empty classpath still runs the reference checks on every input
+  static const std::string classpathImage = Jasmin::ClassPathIndex::Build({});
+  static const Jasmin::ClassPathIndex classpath{classpathImage};
+
+  std::string source{reinterpret_cast<const char*>(data), size};
+
+  Jasmin::AssemblerOptions options;
+  options.ClassPath = &classpath;
+
+  try
+  {
+    Jasmin::Assembler::Assemble(Jasmin::InStream{std::move(source)}, options);
+  }
+  catch(const std::runtime_error&)
+  {
+  }
+
+  return 0;
+}
@@ -0,0 +1,30 @@
+#include <Jasmin/Lexer.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+  std::string source{reinterpret_cast<const char*>(data), size};
+
+  try
+  {
+    auto tokens = Jasmin::Lexer::LexAll(Jasmin::InStream{std::move(source)});
+
+    //LexAll always terminates the token stream with a newline
+    if(tokens.empty() || tokens.back().Type != Jasmin::TT::Newline)
+      std::abort();
+
+    for(const auto& token : tokens)
+      if(token.Info.FileOffset > size)
+        std::abort();
+  }
+  catch(const std::runtime_error&)
+  {
+    //rejecting malformed input is fine, crashing or hanging is not
+  }
+
+  return 0;
+}
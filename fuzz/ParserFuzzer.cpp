@@ -0,0 +1,41 @@
+#include <Jasmin/Lexer.hpp>
+#include <Jasmin/Parser.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+  std::string source{reinterpret_cast<const char*>(data), size};
+
+  //the streaming visitor path pulls tokens from the lexer itself
+  try
+  {
+    Jasmin::ParseVisitor visitor;
+    Jasmin::Parser::Visit(Jasmin::Lexer{Jasmin::InStream{source}}, visitor);
+  }
+  catch(const std::runtime_error&)
+  {
+  }
+
+  std::vector<Jasmin::Token> tokens;
+  try
+  {
+    tokens = Jasmin::Lexer::LexAll(Jasmin::InStream{std::move(source)});
+  }
+  catch(const std::runtime_error&)
+  {
+    return -1; //dont add inputs the lexer rejects to the corpus
+  }
+
+  try
+  {
+    Jasmin::Parser::ParseAll(tokens);
+  }
+  catch(const std::runtime_error&)
+  {
+  }
+
+  return 0;
+}
@@ -2,17 +2,69 @@
 
 #include <ClassFile/ClassFile.hpp>
 
+#include "BlockLayout.hpp"
+#include "ClassPathIndex.hpp"
+#include "DebugInfo.hpp"
 #include "Parser.hpp"
+#include "SwitchLowering.hpp"
+
+#include <filesystem>
+#include <memory_resource>
 
 namespace Jasmin
 {
 
+struct AssemblerOptions
+{
+  //move the tail of methods over the 64KB code limit into helper methods
+  //(see SplitOversizedMethods)
+  bool SplitOversizedMethods = false;
+
+  //cost model used to lower the high level switch
+  SwitchLoweringOptions SwitchLowering;
+
+  //when set, AssembleFile keeps a SourceCache image of every source here
+  //and skips lexing/parsing sources that havent changed since
+  std::filesystem::path SourceCacheDir;
+
+  //when set, field and method references are checked against the classpath
+  //(see CheckReferences), the index must outlive the assembly
+  const ClassPathIndex* ClassPath = nullptr;
+  ReferenceCheckOptions ReferenceCheck;
+
+  //when set, the blocks of profiled methods are laid out hot path first
+  //(see ReorderBlocks), the profile must outlive the assembly
+  const BlockProfile* Profile = nullptr;
+  BlockLayoutOptions BlockLayout;
+
+  //line numbers, local variables and source file kept in the class (see
+  //DebugInfoPolicy), e.g. Full for debug builds and Strip for production.
+  //until there is a class writer Full and Compact only validate the .line,
+  //.var and .source directives, Strip removes them
+  DebugInfoPolicy DebugInfo = DebugInfoPolicy::Full;
+
+  //when set, receives the final constant pool layout the ldc/ldc_w choices
+  //were made from (until there is a class writer the only way to see it)
+  ConstantPoolLayout* PoolLayout = nullptr;
+};
+
 class Assembler
 {
   public:
-    static ClassFile::ClassFile Assemble(Parser);
-    static ClassFile::ClassFile Assemble(InStream);
+    //when a memory resource is given lexing and parsing allocate the tokens
+    //and nodes from it (see Parser::ParseAll), it only has to live until
+    //Assemble returns. the passes after parsing dont use it, nodes they
+    //create (lowered switches, split methods, ...) are on the global heap
+    static ClassFile::ClassFile Assemble(Parser, const AssemblerOptions& = {},
+                                         std::pmr::memory_resource* = nullptr);
+    static ClassFile::ClassFile Assemble(InStream, const AssemblerOptions& = {},
+                                         std::pmr::memory_resource* = nullptr);
+    static ClassFile::ClassFile AssembleFile(const std::filesystem::path&,
+                                             const AssemblerOptions& = {},
+                                             std::pmr::memory_resource* = nullptr);
   private:
+    static ClassFile::ClassFile assemble(std::vector<NodePtr>, const AssemblerOptions&);
+
     ClassFile::ClassFile cf;
 };
 
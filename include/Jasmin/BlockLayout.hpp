@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Jasmin
+{
+
+//execution counts from a profiling run: how often the code following a
+//label ran. a label is looked up as "name(args)ret:Label" first (for label
+//names used in more than one method) and then as just "Label".
+using BlockProfile = std::unordered_map<Symbol, std::uint64_t>;
+
+struct BlockLayoutOptions
+{
+  //blocks that ran at most this often are moved to the end of the method
+  std::uint64_t ColdCount = 0;
+};
+
+//reorders the basic blocks of every method with profiled labels so the
+//hottest successor of each block directly follows it, and cold blocks
+//(error paths, throwers, unreachable code) come last in source order.
+//
+//blocks without a profiled label get the count of the block falling into
+//them (less the count of its forward branch target, 0 if nothing falls into
+//them), the entry block stays first. conditional branches are inverted when
+//their target becomes the fallthrough, gotos to the next block are dropped
+//and gotos are added where a fallthrough got separated from its successor.
+//.catch ranges are split up to cover the same blocks in the new order and
+//moved blocks restate their .line. methods using jsr/ret or .var ranges are
+//left alone.
+std::vector<NodePtr> ReorderBlocks(std::vector<NodePtr> nodes, const BlockProfile&,
+                                   const BlockLayoutOptions& = {});
+
+} //namespace: Jasmin
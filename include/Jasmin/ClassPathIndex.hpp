@@ -0,0 +1,109 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include "Nodes.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Jasmin
+{
+
+//sorted table of the classes on a classpath (directories of .class files
+//and JAR files) and their fields and methods, stored as a flat image that
+//is memory mapped and searched in place.
+//
+//layout (native byte order, every section 8 byte aligned):
+//  header      magic, byte order mark, version, counts and section offsets
+//  classes     fixed size records sorted by class name
+//  members     fixed size records, each class's sorted by kind, name and
+//              descriptor
+//  interfaces  direct superinterfaces of the classes
+//  text        names and descriptors, referenced by {offset, length}
+class ClassPathIndex
+{
+  public:
+    static constexpr std::uint32_t Version = 1;
+
+    enum class MemberKind : std::uint8_t
+    {
+      Field,
+      Method,
+    };
+
+    //reads every class on the classpath, the first definition of a class
+    //wins like it does for the jvm
+    static std::string Build(const std::vector<std::filesystem::path>& classpath);
+
+    //writes an image returned by Build to the file (atomically, via a rename)
+    static void Write(const std::filesystem::path&, std::string_view image);
+
+    //maps the file into memory, throws if it isnt a valid image
+    static ClassPathIndex Open(const std::filesystem::path&);
+
+    //views an image in memory, which must outlive the index
+    explicit ClassPathIndex(std::string_view image);
+
+    size_t ClassCount() const;
+    bool HasClass(std::string_view className) const;
+
+    enum class Lookup
+    {
+      Found,
+      Missing,
+      //the class or one of its ancestors isnt on the classpath, so a
+      //missing member cant be told apart from an inherited one
+      Unknown,
+    };
+
+    //looks the member up in the class, its superclasses and its
+    //superinterfaces (class names in internal form, java/lang/Object)
+    Lookup FindMember(std::string_view className, MemberKind,
+                      std::string_view name, std::string_view descriptor) const;
+
+  private:
+    struct Header;
+    struct StringRef;
+    struct ClassRecord;
+    struct MemberRecord;
+
+    ClassPathIndex(MappedFile file, std::string_view image);
+
+    template<typename Record>
+    const Record* section(std::uint64_t offset, std::uint32_t count) const;
+
+    void validate() const;
+    std::string_view str(const StringRef&) const;
+    const ClassRecord* findClass(std::string_view className) const;
+    bool declares(const ClassRecord&, MemberKind, std::string_view name,
+                  std::string_view descriptor) const;
+
+    MappedFile file;
+    std::string_view image;
+
+    const Header* pHeader = nullptr;
+    const ClassRecord* pClasses = nullptr;
+    const MemberRecord* pMembers = nullptr;
+    const StringRef* pInterfaces = nullptr;
+    const char* pText = nullptr;
+};
+
+struct ReferenceCheckOptions
+{
+  //report references to classes that arent on the classpath (references to
+  //the classes being assembled are never reported). off by default: since
+  //java 9 the platform classes (java/lang/Object, ...) live in the jrt image
+  //and not in a JAR the index can read
+  bool RequireKnownClasses = false;
+};
+
+//checks the class, field and method of every getstatic, putstatic,
+//getfield, putfield and invoke* (except invokedynamic) reference against
+//the classpath, throws for the first one that doesnt resolve
+void CheckReferences(const std::vector<NodePtr>&, const ClassPathIndex&,
+                     const ReferenceCheckOptions& = {});
+
+} //namespace: Jasmin
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <variant>
+#include <vector>
+
+namespace Jasmin
+{
+
+//Fieldref, Methodref, InterfaceMethodref (Owner, Name, Descriptor) and
+//NameAndType (Name, Descriptor, no Owner)
+struct MemberRef
+{
+  Symbol Owner;
+  Symbol Name;
+  Symbol Descriptor;
+};
+
+//a MethodHandle refers to a field or method by one of the nine reference
+//kinds (1 REF_getField .. 9 REF_invokeInterface)
+struct MethodHandleRef
+{
+  std::uint8_t ReferenceKind;
+  bool IsInterface; //an InterfaceMethodref rather than a Methodref
+  MemberRef Member;
+};
+
+//an InvokeDynamic call site, the bootstrap method is an index into the
+//BootstrapMethods attribute
+struct DynamicRef
+{
+  U16 BootstrapMethod;
+  Symbol Name;
+  Symbol Descriptor;
+};
+
+struct Constant
+{
+  //NOTE: the values are the class file tags
+  enum class Kind : std::uint8_t
+  {
+    Utf8               = 1,
+    Integer            = 3,
+    Float              = 4,
+    Long               = 5,
+    Double             = 6,
+    Class              = 7,
+    String             = 8,
+    Fieldref           = 9,
+    Methodref          = 10,
+    InterfaceMethodref = 11,
+    NameAndType        = 12,
+    MethodHandle       = 15,
+    MethodType         = 16,
+    InvokeDynamic      = 18,
+  };
+
+  Kind Type;
+
+  //Utf8, Class, String and MethodType (its descriptor) hold a Symbol, the
+  //member references and NameAndType a MemberRef
+  std::variant<std::int32_t, std::int64_t, float, double, Symbol,
+               MemberRef, MethodHandleRef, DynamicRef> Value;
+
+  //constants loaded by ldc/ldc_w (Integer, Float, String, Class,
+  //MethodHandle, MethodType)
+  bool IsLdcLoadable() const;
+
+  //Long and Double take up two pool slots
+  unsigned SlotCount() const;
+
+  //the entries this one points at (the Utf8 of a Class, the Class and
+  //NameAndType of a Fieldref, ...), they need pool entries too
+  std::vector<Constant> References() const;
+
+  //constant loaded by an ldc, ldc_w or ldc2_w instruction node
+  static std::optional<Constant> FromLoad(const InstructionNode&);
+
+  //Fieldref, Methodref, InterfaceMethodref or Class operand of a field,
+  //invoke (except invokedynamic) or new/anewarray/checkcast/instanceof/
+  //multianewarray instruction node
+  static std::optional<Constant> FromReference(const InstructionNode&);
+};
+
+bool operator==(const Constant&, const Constant&);
+bool operator<(const Constant&, const Constant&);
+
+//decides the final constant pool order. ldc can only address the first 256
+//slots, so constants are profiled first and the ones loaded most often by
+//ldc get the lowest indices, everything else is placed after them
+class ConstantPoolLayout
+{
+  public:
+    static constexpr U16 MaxLdcIndex = 0xFF;
+
+    //profiles every constant load in the given nodes (loads that fold into
+    //an instruction with an immediate operand dont need a pool entry) and
+    //adds the class, member, name and descriptor entries the nodes refer to
+    void Profile(const std::vector<NodePtr>&);
+
+    void CountLdc(const Constant&);
+    void Add(const Constant&);
+
+    //assigns indices, no constants can be added afterwards
+    void Finalize();
+    bool IsFinal() const { return isFinal; }
+
+    U16 IndexOf(const Constant&) const;
+
+    //entries in pool order (index of Entries()[i] is not i+1 once a Long or
+    //Double has been placed, use IndexOf)
+    const std::vector<Constant>& Entries() const { return entries; }
+
+    //the constant_pool_count of the class file (highest index + 1)
+    U16 Count() const { return nextIndex; }
+
+  private:
+    void place(const Constant&);
+
+    //NOTE: first seen order is kept so equally used constants (and the final
+    //class file) dont depend on map ordering
+    std::vector<Constant> seen;
+    std::map<Constant, unsigned> ldcUses;
+
+    std::vector<Constant> entries;
+    std::map<Constant, U16> indices;
+    U16 nextIndex = 1;
+    bool isFinal = false;
+};
+
+//how a constant load is encoded once the pool layout is final
+struct ConstantLoad
+{
+  Symbol Mnemonic;
+  //the value bipush and sipush push
+  std::optional<std::int32_t> Immediate;
+  //the pool index ldc, ldc_w and ldc2_w load
+  std::optional<U16> PoolIndex;
+};
+
+//folds constants that have a dedicated instruction (iconst_<n>, bipush,
+//sipush, fconst_<n>, lconst_<n>, dconst_<n>), returns nullopt if the
+//constant needs a pool entry
+std::optional<ConstantLoad> FoldConstantLoad(const Constant&);
+
+//folds the constant or picks ldc, ldc_w or ldc2_w based on its pool index
+ConstantLoad LowerConstantLoad(const Constant&, const ConstantPoolLayout&);
+
+//rewrites every ldc, ldc_w and ldc2_w node to its LowerConstantLoad form
+//(iconst_<n>, bipush, ..., ldc_w only where the index needs it), the layout
+//must be final and contain the nodes constants
+std::vector<NodePtr> LowerConstantLoads(std::vector<NodePtr>, const ConstantPoolLayout&);
+
+} //namespace: Jasmin
@@ -0,0 +1,1139 @@
+#pragma once
+
+#include "Opcodes.hpp"
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+//compile time assembly of a subset of Jasmin into class file bytes:
+//
+//  constexpr auto helperClass = JASMIN_CLASS(R"(
+//    .class public Helper
+//    .super java/lang/Object
+//    .method public static answer()I
+//      .limit stack 1
+//      bipush 42
+//      ireturn
+//    .end method
+//  )");
+//
+//helperClass is a std::array<std::uint8_t, N> holding the class file. the
+//same functions work at run time (ClassFileSize + AssembleClassFile).
+//
+//supported: .class/.interface, .super, .implements, .field (without an
+//initial value), .method, .limit stack/locals, .catch, .end method, labels
+//(also in front of an instruction) and every instruction except
+//tableswitch, lookupswitch and invokedynamic. ldc/ldc_w load ints,
+//"strings" and classes, ldc2_w loads longs; floating point constants arent
+//supported. anything else (other directives included) is an error rather
+//than skipped. errors throw, which makes a constant evaluation fail to
+//compile. the class file version is 49 so methods with branches need no
+//stack map frames.
+//
+//what is accepted reads the way the runtime assembler reads it: numbers
+//like the lexer (hex literals are magnitudes, ldc reads 0x80000000 to
+//0xFFFFFFFF as int bit patterns), the \" and \n string escapes, implicit
+//and explicit wide, and ldc/ldc_w/ldc2_w lowered like LowerConstantLoads
+//(folded into iconst_<n>, bipush, ... where possible, ldc_w only past pool
+//index 255). branches further than +-32KB arent widened, they are errors.
+namespace Jasmin
+{
+namespace Constexpr
+{
+
+constexpr size_t MaxPoolEntries = 512;
+constexpr size_t MaxLabels = 256;
+constexpr size_t MaxTokens = 16;
+
+[[noreturn]] inline void fail(const char* message)
+{
+  throw std::runtime_error{message};
+}
+
+//one line of source split into whitespace separated tokens, "strings" are
+//kept together (quotes included) and comments dropped
+struct Statement
+{
+  std::array<std::string_view, MaxTokens> Tokens{};
+  size_t Count = 0;
+
+  constexpr std::string_view operator[](size_t i) const
+  {
+    if(i >= Count)
+      fail("Assembler error: missing operand");
+    return Tokens[i];
+  }
+
+  //the statement without its first n tokens (the instruction after a label)
+  constexpr Statement Skip(size_t n) const
+  {
+    Statement rest;
+    for(size_t i = n; i < Count; ++i)
+      rest.Tokens[rest.Count++] = Tokens[i];
+    return rest;
+  }
+};
+
+//tokens taken by the label a statement starts with, "Name:" or "Name :" like
+//the parser accepts, 0 if it doesnt start with one
+constexpr size_t labelTokens(const Statement& statement)
+{
+  if(statement[0].back() == ':')
+    return 1;
+  if(statement.Count > 1 && statement[1] == ":")
+    return 2;
+  return 0;
+}
+
+class StatementReader
+{
+  public:
+    constexpr explicit StatementReader(std::string_view source) : source{source} {}
+
+    //reads the next non empty statement, false at the end of the source
+    constexpr bool Next(Statement& statement)
+    {
+      while(pos < source.size())
+      {
+        statement = Statement{};
+
+        while(pos < source.size() && source[pos] != '\n')
+        {
+          char ch = source[pos];
+
+          if(ch == ' ' || ch == '\t' || ch == '\r')
+          {
+            ++pos;
+            continue;
+          }
+
+          if(ch == ';')
+          {
+            while(pos < source.size() && source[pos] != '\n')
+              ++pos;
+            break;
+          }
+
+          size_t start = pos;
+          if(ch == '"')
+          {
+            ++pos;
+            while(pos < source.size() && source[pos] != '"' && source[pos] != '\n')
+            {
+              //NOTE: escapes stay in the token, the pool decodes them
+              if(source[pos] == '\\')
+              {
+                if(pos + 1 == source.size() || (source[pos + 1] != '"' && source[pos + 1] != 'n'))
+                  fail("Assembler error: invalid escape character");
+                ++pos;
+              }
+              ++pos;
+            }
+
+            if(pos == source.size() || source[pos] != '"')
+              fail("Assembler error: unterminated string");
+            ++pos;
+          }
+          else
+          {
+            while(pos < source.size() && source[pos] != ' ' && source[pos] != '\t' &&
+                  source[pos] != '\r' && source[pos] != '\n')
+              ++pos;
+          }
+
+          if(statement.Count == MaxTokens)
+            fail("Assembler error: too many tokens on one line");
+          statement.Tokens[statement.Count++] = source.substr(start, pos - start);
+        }
+
+        if(pos < source.size())
+          ++pos; //'\n'
+
+        if(statement.Count > 0)
+          return true;
+      }
+
+      return false;
+    }
+
+  private:
+    std::string_view source;
+    size_t pos = 0;
+};
+
+constexpr std::int64_t parseInt(std::string_view str)
+{
+  bool negative = !str.empty() && str.front() == '-';
+  if(negative)
+    str.remove_prefix(1);
+
+  unsigned base = 10;
+  if(str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+  {
+    base = 16;
+    str.remove_prefix(2);
+  }
+
+  if(str.empty())
+    fail("Assembler error: expected a number");
+
+  if(base == 10 && str.size() > 1 && str[0] == '0' && str[1] == '0')
+    fail("Assembler error: double zero encountered in integer");
+
+  std::uint64_t value = 0;
+  for(char ch : str)
+  {
+    if(base == 10 && (ch == '.' || ch == 'e' || ch == 'E'))
+      fail("Assembler error: decimal constants arent supported at compile time");
+
+    unsigned digit = ch >= '0' && ch <= '9' ? ch - '0' :
+                     ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 :
+                     ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : 99;
+
+    if(digit >= base)
+      fail("Assembler error: expected a number");
+
+    if(value > (UINT64_MAX - digit) / base)
+      fail("Assembler error: number out of range");
+    value = value * base + digit;
+  }
+
+  if(value > (negative ? std::uint64_t{1} << 63 : (std::uint64_t{1} << 63) - 1))
+    fail("Assembler error: number out of range");
+
+  return negative ? static_cast<std::int64_t>(0 - value) : static_cast<std::int64_t>(value);
+}
+
+constexpr bool isNumber(std::string_view str)
+{
+  if(!str.empty() && str.front() == '-')
+    str.remove_prefix(1);
+  if(!str.empty() && str.front() == '.') //.5 is a decimal
+    str.remove_prefix(1);
+  return !str.empty() && str.front() >= '0' && str.front() <= '9';
+}
+
+//the value where an int is expected, like Token::Int32Value: int values as
+//they are and hex literals up to 0xFFFFFFFF as a bit pattern (0xFFFFFFFF is -1)
+constexpr std::int32_t int32Value(std::string_view str)
+{
+  std::int64_t value = parseInt(str);
+  if(value >= INT32_MIN && value <= INT32_MAX)
+    return static_cast<std::int32_t>(value);
+
+  bool isHex = str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X');
+  if(isHex && value <= 0xFFFFFFFF)
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(value));
+
+  fail("Assembler error: int constant out of range (use ldc2_w)");
+}
+
+//"strings" keep their escapes (\" and \n) in the source text, these read
+//them as the characters they stand for
+constexpr char escapedChar(char ch) { return ch == 'n' ? '\n' : ch; }
+
+constexpr size_t unescapedSize(std::string_view text)
+{
+  size_t size = 0;
+  for(size_t i = 0; i < text.size(); ++i, ++size)
+    if(text[i] == '\\')
+      ++i;
+  return size;
+}
+
+constexpr bool sameText(std::string_view a, bool aEscaped, std::string_view b, bool bEscaped)
+{
+  size_t i = 0, j = 0;
+  for(; i < a.size() && j < b.size(); ++i, ++j)
+  {
+    char ca = aEscaped && a[i] == '\\' ? escapedChar(a[++i]) : a[i];
+    char cb = bEscaped && b[j] == '\\' ? escapedChar(b[++j]) : b[j];
+    if(ca != cb)
+      return false;
+  }
+
+  return i == a.size() && j == b.size();
+}
+
+constexpr const Opcode& lookupOpcode(std::string_view mnemonic)
+{
+  for(const Opcode& opcode : Opcodes)
+    if(opcode.Mnemonic == mnemonic)
+      return opcode;
+
+  fail("Assembler error: unknown instruction");
+}
+
+constexpr std::uint8_t arrayType(std::string_view type)
+{
+  constexpr std::string_view types[] = {"boolean", "char", "float", "double",
+                                        "byte", "short", "int", "long"};
+  for(std::uint8_t i = 0; i < 8; ++i)
+    if(types[i] == type)
+      return static_cast<std::uint8_t>(4 + i);
+
+  fail("Assembler error: unknown newarray type");
+}
+
+enum class Declaration
+{
+  Class,
+  Field,
+  Method,
+};
+
+//the flag of an access keyword, 0 if the declaration doesnt take it (some
+//keywords share a bit: volatile and bridge, transient and varargs)
+constexpr std::uint16_t accessFlag(std::string_view keyword, Declaration declaration)
+{
+  struct Flag
+  {
+    std::string_view Name;
+    std::uint16_t Value;
+    bool OnClass, OnField, OnMethod;
+  };
+
+  constexpr Flag flags[] = {
+    {"public",       0x0001, true,  true,  true },
+    {"private",      0x0002, false, true,  true },
+    {"protected",    0x0004, false, true,  true },
+    {"static",       0x0008, false, true,  true },
+    {"final",        0x0010, true,  true,  true },
+    {"synchronized", 0x0020, false, false, true },
+    {"volatile",     0x0040, false, true,  false},
+    {"bridge",       0x0040, false, false, true },
+    {"transient",    0x0080, false, true,  false},
+    {"varargs",      0x0080, false, false, true },
+    {"native",       0x0100, false, false, true },
+    {"interface",    0x0200, true,  false, false},
+    {"abstract",     0x0400, true,  false, true },
+    {"strict",       0x0800, false, false, true },
+    {"synthetic",    0x1000, true,  true,  true },
+    {"annotation",   0x2000, true,  false, false},
+    {"enum",         0x4000, true,  true,  false},
+  };
+
+  for(const auto& flag : flags)
+  {
+    bool isTaken = declaration == Declaration::Class ? flag.OnClass :
+                   declaration == Declaration::Field ? flag.OnField : flag.OnMethod;
+    if(flag.Name == keyword && isTaken)
+      return flag.Value;
+  }
+
+  return 0;
+}
+
+//the access keywords between the directive and the name, each one has to be
+//known for the declaration
+constexpr std::uint16_t accessFlags(const Statement& statement, size_t end, Declaration declaration)
+{
+  std::uint16_t access = 0;
+  for(size_t i = 1; i < end; ++i)
+  {
+    std::uint16_t flag = accessFlag(statement[i], declaration);
+    if(!flag)
+      fail("Assembler error: unknown access keyword");
+    access |= flag;
+  }
+
+  return access;
+}
+
+//stack/local slots taken by the parameters of a method descriptor
+constexpr unsigned parameterSlots(std::string_view descriptor)
+{
+  if(descriptor.empty() || descriptor.front() != '(')
+    fail("Assembler error: malformed method descriptor");
+
+  unsigned slots = 0;
+  size_t i = 1;
+  while(i < descriptor.size() && descriptor[i] != ')')
+  {
+    char type = descriptor[i];
+    bool isArray = false;
+
+    while(descriptor[i] == '[' && i + 1 < descriptor.size())
+    {
+      isArray = true;
+      type = descriptor[++i];
+    }
+
+    if(type == 'L')
+      while(i < descriptor.size() && descriptor[i] != ';')
+        ++i;
+
+    slots += !isArray && (type == 'J' || type == 'D') ? 2 : 1;
+    ++i;
+  }
+
+  if(i == descriptor.size())
+    fail("Assembler error: malformed method descriptor");
+
+  return slots;
+}
+
+struct PoolEntry
+{
+  std::uint8_t Tag = 0;
+  std::string_view Text;
+  bool Escaped = false; //Text is a string literal body, see sameText
+  std::int64_t Value = 0;
+  std::uint16_t First = 0;
+  std::uint16_t Second = 0;
+};
+
+//constant pool built up while assembling, equal entries are shared
+class ConstantPool
+{
+  public:
+    enum Tag : std::uint8_t
+    {
+      Utf8 = 1, Integer = 3, Long = 5, Class = 7, String = 8,
+      Fieldref = 9, Methodref = 10, InterfaceMethodref = 11, NameAndType = 12,
+    };
+
+    constexpr std::uint16_t AddUtf8(std::string_view text, bool escaped = false)
+    {
+      if((escaped ? unescapedSize(text) : text.size()) > 0xFFFF)
+        fail("Assembler error: string constant too long");
+      return add(PoolEntry{Utf8, text, escaped, 0, 0, 0});
+    }
+
+    constexpr std::uint16_t AddClass(std::string_view name)
+    {
+      return add(PoolEntry{Class, {}, false, 0, AddUtf8(name), 0});
+    }
+
+    //the text as written between the quotes, escapes included
+    constexpr std::uint16_t AddString(std::string_view text)
+    {
+      return add(PoolEntry{String, {}, false, 0, AddUtf8(text, true), 0});
+    }
+
+    constexpr std::uint16_t AddInteger(std::int32_t value)
+    {
+      return add(PoolEntry{Integer, {}, false, value, 0, 0});
+    }
+
+    constexpr std::uint16_t AddLong(std::int64_t value)
+    {
+      return add(PoolEntry{Long, {}, false, value, 0, 0});
+    }
+
+    //owner/name + descriptor, e.g. java/lang/System/out Ljava/io/PrintStream;
+    constexpr std::uint16_t AddRef(Tag tag, std::string_view member, std::string_view descriptor)
+    {
+      size_t slash = member.rfind('/');
+      if(slash == std::string_view::npos)
+        fail("Assembler error: member reference has no class");
+
+      std::uint16_t owner = AddClass(member.substr(0, slash));
+      std::uint16_t nameAndType = add(PoolEntry{NameAndType, {}, false, 0,
+          AddUtf8(member.substr(slash + 1)), AddUtf8(descriptor)});
+
+      return add(PoolEntry{tag, {}, false, 0, owner, nameAndType});
+    }
+
+    constexpr std::uint16_t Count() const { return nextIndex; }
+
+    template<typename Out>
+    constexpr void Write(Out& out) const
+    {
+      out.U2(nextIndex);
+
+      for(size_t i = 0; i < size; ++i)
+      {
+        const PoolEntry& entry = entries[i];
+        out.U1(entry.Tag);
+
+        switch(entry.Tag)
+        {
+          case Utf8:
+            if(!entry.Escaped)
+            {
+              out.U2(static_cast<std::uint16_t>(entry.Text.size()));
+              out.Bytes(entry.Text);
+              break;
+            }
+
+            out.U2(static_cast<std::uint16_t>(unescapedSize(entry.Text)));
+            for(size_t c = 0; c < entry.Text.size(); ++c)
+            {
+              char ch = entry.Text[c] == '\\' ? escapedChar(entry.Text[++c]) : entry.Text[c];
+              out.U1(static_cast<std::uint8_t>(ch));
+            }
+            break;
+
+          case Integer:
+            out.U4(static_cast<std::uint32_t>(entry.Value));
+            break;
+
+          case Long:
+            out.U4(static_cast<std::uint32_t>(static_cast<std::uint64_t>(entry.Value) >> 32));
+            out.U4(static_cast<std::uint32_t>(entry.Value));
+            break;
+
+          case Class:
+          case String:
+            out.U2(entry.First);
+            break;
+
+          default:
+            out.U2(entry.First);
+            out.U2(entry.Second);
+            break;
+        }
+      }
+    }
+
+  private:
+    constexpr std::uint16_t add(const PoolEntry& entry)
+    {
+      for(size_t i = 0; i < size; ++i)
+      {
+        const PoolEntry& e = entries[i];
+        if(e.Tag == entry.Tag && sameText(e.Text, e.Escaped, entry.Text, entry.Escaped) &&
+           e.Value == entry.Value && e.First == entry.First && e.Second == entry.Second)
+          return indices[i];
+      }
+
+      if(size == MaxPoolEntries || nextIndex > 0xFFFF - 2)
+        fail("Assembler error: too many constants for compile time assembly");
+
+      entries[size] = entry;
+      indices[size] = nextIndex;
+      ++size;
+
+      //longs take up two slots
+      nextIndex += entry.Tag == Long ? 2 : 1;
+      return indices[size - 1];
+    }
+
+    std::array<PoolEntry, MaxPoolEntries> entries{};
+    std::array<std::uint16_t, MaxPoolEntries> indices{};
+    size_t size = 0;
+    std::uint16_t nextIndex = 1;
+};
+
+//counts bytes instead of writing them
+class SizeCounter
+{
+  public:
+    constexpr void U1(std::uint8_t) { ++Size; }
+    constexpr void U2(std::uint16_t) { Size += 2; }
+    constexpr void U4(std::uint32_t) { Size += 4; }
+    constexpr void Bytes(std::string_view bytes) { Size += bytes.size(); }
+
+    size_t Size = 0;
+};
+
+template<size_t N>
+class ArrayWriter
+{
+  public:
+    constexpr void U1(std::uint8_t value) { Out[pos++] = value; }
+
+    constexpr void U2(std::uint16_t value)
+    {
+      U1(static_cast<std::uint8_t>(value >> 8));
+      U1(static_cast<std::uint8_t>(value));
+    }
+
+    constexpr void U4(std::uint32_t value)
+    {
+      U2(static_cast<std::uint16_t>(value >> 16));
+      U2(static_cast<std::uint16_t>(value));
+    }
+
+    constexpr void Bytes(std::string_view bytes)
+    {
+      for(char ch : bytes)
+        U1(static_cast<std::uint8_t>(ch));
+    }
+
+    std::array<std::uint8_t, N> Out{};
+
+  private:
+    size_t pos = 0;
+};
+
+struct Label
+{
+  std::string_view Name;
+  std::uint32_t Offset = 0;
+};
+
+constexpr std::uint32_t labelOffset(const std::array<Label, MaxLabels>& labels, size_t labelCount,
+                                    std::string_view name)
+{
+  for(size_t i = 0; i < labelCount; ++i)
+    if(labels[i].Name == name)
+      return labels[i].Offset;
+
+  fail("Assembler error: undefined label");
+}
+
+class ClassAssembler
+{
+  public:
+    constexpr explicit ClassAssembler(std::string_view source) : source{source} {}
+
+    //the pool has to be complete before it is written, so the class is
+    //assembled once into a SizeCounter to collect the constants and then
+    //again into the real output
+    template<typename Out>
+    constexpr void Assemble(Out& out)
+    {
+      SizeCounter collect;
+      writeBody(collect);
+
+      out.U4(0xCAFEBABE);
+      out.U2(0);  //minor version
+      out.U2(49); //major version
+      pool.Write(out);
+      writeBody(out);
+    }
+
+  private:
+    template<typename Out>
+    constexpr void writeBody(Out& out)
+    {
+      std::uint16_t access = 0;
+      std::string_view className, superName = "java/lang/Object";
+      std::array<std::string_view, MaxTokens> interfaces{};
+      size_t interfaceCount = 0, fieldCount = 0, methodCount = 0;
+
+      StatementReader reader{source};
+      Statement statement;
+
+      while(reader.Next(statement))
+      {
+        std::string_view first = statement[0];
+
+        if(first == ".class" || first == ".interface")
+        {
+          access = first == ".class" ? 0x0020 : 0x0600; //ACC_SUPER, ACC_INTERFACE|ABSTRACT
+          access |= accessFlags(statement, statement.Count - 1, Declaration::Class);
+          className = statement[statement.Count - 1];
+        }
+        else if(first == ".super")
+        {
+          superName = statement[1];
+        }
+        else if(first == ".implements")
+        {
+          if(interfaceCount == interfaces.size())
+            fail("Assembler error: too many interfaces");
+          interfaces[interfaceCount++] = statement[1];
+        }
+        else if(first == ".field")
+        {
+          ++fieldCount;
+        }
+        else if(first == ".method")
+        {
+          ++methodCount;
+
+          //the body is checked by writeMethod
+          while(reader.Next(statement) && statement[0] != ".end")
+            ;
+        }
+        else if(first.front() == '.')
+        {
+          fail("Assembler error: directive isnt supported at compile time");
+        }
+        else
+        {
+          fail("Assembler error: instruction or label outside of a method");
+        }
+      }
+
+      if(className.empty())
+        fail("Assembler error: missing .class directive");
+
+      out.U2(access);
+      out.U2(pool.AddClass(className));
+      out.U2(pool.AddClass(superName));
+
+      out.U2(static_cast<std::uint16_t>(interfaceCount));
+      for(size_t i = 0; i < interfaceCount; ++i)
+        out.U2(pool.AddClass(interfaces[i]));
+
+      //.field <access> <name> <descriptor>
+      out.U2(static_cast<std::uint16_t>(fieldCount));
+      reader = StatementReader{source};
+      while(reader.Next(statement))
+      {
+        if(statement[0] != ".field")
+          continue;
+
+        std::uint16_t fieldAccess = 0;
+        size_t i = 1;
+        for(; i < statement.Count && accessFlag(statement[i], Declaration::Field); ++i)
+          fieldAccess |= accessFlag(statement[i], Declaration::Field);
+
+        if(statement.Count != i + 2)
+          fail("Assembler error: .field expects a name and descriptor (no initial value)");
+
+        out.U2(fieldAccess);
+        out.U2(pool.AddUtf8(statement[i]));
+        out.U2(pool.AddUtf8(statement[i + 1]));
+        out.U2(0); //attributes
+      }
+
+      out.U2(static_cast<std::uint16_t>(methodCount));
+      reader = StatementReader{source};
+      while(reader.Next(statement))
+        if(statement[0] == ".method")
+          writeMethod(statement, reader, out);
+
+      out.U2(0); //attributes
+    }
+
+    //.method <access> <name>(<args>)<ret>, reads up to .end method
+    template<typename Out>
+    constexpr void writeMethod(const Statement& header, StatementReader& reader, Out& out)
+    {
+      std::uint16_t methodAccess = accessFlags(header, header.Count - 1, Declaration::Method);
+
+      std::string_view nameAndDescriptor = header[header.Count - 1];
+      size_t paren = nameAndDescriptor.find('(');
+      if(paren == std::string_view::npos)
+        fail("Assembler error: .method expects name(args)ret");
+
+      std::string_view descriptor = nameAndDescriptor.substr(paren);
+
+      out.U2(methodAccess);
+      out.U2(pool.AddUtf8(nameAndDescriptor.substr(0, paren)));
+      out.U2(pool.AddUtf8(descriptor));
+
+      //first walk: label offsets, code length, limits and the number of
+      //exception handlers
+      StatementReader body = reader;
+      Statement statement;
+      std::array<Label, MaxLabels> labels{};
+      size_t labelCount = 0, catchCount = 0;
+      std::uint32_t codeLength = 0;
+      bool widened = false;
+      std::uint16_t maxStack = 1;
+      std::uint16_t maxLocals = static_cast<std::uint16_t>(
+          parameterSlots(descriptor) + ((methodAccess & 0x0008) ? 0 : 1));
+
+      while(true)
+      {
+        if(!body.Next(statement))
+          fail("Assembler error: .method without .end method");
+
+        std::string_view first = statement[0];
+        if(first == ".end")
+        {
+          if(statement.Count != 2 || statement[1] != "method")
+            fail("Assembler error: expected .end method");
+          break;
+        }
+
+        if(first == ".limit")
+        {
+          std::int64_t limit = parseInt(statement[2]);
+          if(limit < 0 || limit > 0xFFFF)
+            fail("Assembler error: .limit out of range");
+
+          if(statement[1] == "stack")
+            maxStack = static_cast<std::uint16_t>(limit);
+          else if(statement[1] == "locals")
+            maxLocals = static_cast<std::uint16_t>(limit);
+          else
+            fail("Assembler error: .limit expects stack or locals");
+        }
+        else if(first == ".catch")
+        {
+          //.catch <class> from <label> to <label> using <label>
+          if(statement.Count != 8 || statement[2] != "from" || statement[4] != "to" ||
+             statement[6] != "using")
+            fail("Assembler error: .catch expects <class> from <label> to <label> using <label>");
+          ++catchCount;
+        }
+        else if(first.front() == '.')
+        {
+          //NOTE: failing beats dropping a directive (.line, .var, .throws, a
+          //typo, ...) the runtime assembler would have honored
+          fail("Assembler error: directive isnt supported in a method at compile time");
+        }
+        else
+        {
+          size_t labelLength = labelTokens(statement);
+          if(labelLength)
+          {
+            std::string_view name = labelLength == 1 ? first.substr(0, first.size() - 1) : first;
+            if(name.empty())
+              fail("Assembler error: label without a name");
+
+            for(size_t i = 0; i < labelCount; ++i)
+              if(labels[i].Name == name)
+                fail("Assembler error: duplicate label");
+
+            if(labelCount == labels.size())
+              fail("Assembler error: too many labels for compile time assembly");
+            labels[labelCount++] = Label{name, codeLength};
+          }
+
+          //a label may be followed by an instruction on the same line
+          if(statement.Count > labelLength)
+          {
+            Statement instruction = statement.Skip(labelLength);
+            const Opcode& opcode = lookupOpcode(instruction[0]);
+
+            if(widened && opcode.Kind != Operand::Local && opcode.Kind != Operand::Iinc)
+              fail("Assembler error: wide must be followed by a load, store, iinc or ret");
+
+            codeLength += static_cast<std::uint32_t>(instructionSize(opcode, instruction, widened));
+            widened = opcode.Kind == Operand::Wide;
+          }
+        }
+      }
+
+      if(widened)
+        fail("Assembler error: wide must be followed by a load, store, iinc or ret");
+
+      if(codeLength > 0xFFFF)
+        fail("Assembler error: method code over 64KB");
+
+      //abstract and native methods have no code
+      if(methodAccess & (0x0400 | 0x0100))
+      {
+        if(codeLength != 0 || catchCount != 0)
+          fail("Assembler error: abstract or native method with code");
+
+        out.U2(0);
+        reader = body;
+        return;
+      }
+
+      out.U2(1); //attributes
+      out.U2(pool.AddUtf8("Code"));
+      out.U4(static_cast<std::uint32_t>(12 + codeLength + 8 * catchCount));
+      out.U2(maxStack);
+      out.U2(maxLocals);
+      out.U4(codeLength);
+
+      //second walk: the code
+      StatementReader handlers = reader;
+      std::uint32_t offset = 0;
+      widened = false;
+      while(reader.Next(statement) && statement[0] != ".end")
+      {
+        if(statement[0].front() == '.')
+          continue;
+
+        Statement instruction = statement.Skip(labelTokens(statement));
+        if(instruction.Count == 0)
+          continue;
+
+        const Opcode& opcode = lookupOpcode(instruction[0]);
+        writeInstruction(opcode, instruction, widened, offset, labels, labelCount, out);
+        offset += static_cast<std::uint32_t>(instructionSize(opcode, instruction, widened));
+        widened = opcode.Kind == Operand::Wide;
+      }
+
+      //third walk: the exception table, in source order
+      out.U2(static_cast<std::uint16_t>(catchCount));
+      while(handlers.Next(statement) && statement[0] != ".end")
+      {
+        if(statement[0] != ".catch")
+          continue;
+
+        out.U2(static_cast<std::uint16_t>(labelOffset(labels, labelCount, statement[3])));
+        out.U2(static_cast<std::uint16_t>(labelOffset(labels, labelCount, statement[5])));
+        out.U2(static_cast<std::uint16_t>(labelOffset(labels, labelCount, statement[7])));
+        out.U2(statement[1] == "all" ? 0 : pool.AddClass(statement[1]));
+      }
+
+      out.U2(0); //attributes
+    }
+
+    //a constant load as it is encoded, see lowerLoad
+    struct LoweredLoad
+    {
+      std::uint8_t Code;
+      std::uint8_t Size;
+      std::int32_t Immediate = 0;  //bipush/sipush
+      std::uint16_t PoolIndex = 0; //ldc/ldc_w/ldc2_w
+    };
+
+    //ldc, ldc_w and ldc2_w lowered like LowerConstantLoads does at run time:
+    //constants with a dedicated instruction fold into it and ldc_w is only
+    //used where the pool index needs it
+    constexpr LoweredLoad lowerLoad(const Opcode& opcode, const Statement& statement)
+    {
+      std::string_view constant = statement[1];
+
+      if(opcode.Kind == Operand::Ldc2W)
+      {
+        if(!isNumber(constant))
+          fail("Assembler error: ldc2_w only loads long constants at compile time");
+
+        std::int64_t value = parseInt(constant);
+        if(value == 0 || value == 1)
+          return LoweredLoad{static_cast<std::uint8_t>(0x09 + value), 1}; //lconst_<n>
+
+        return LoweredLoad{0x14, 3, 0, pool.AddLong(value)};
+      }
+
+      std::uint16_t index = 0;
+      if(isNumber(constant))
+      {
+        std::int32_t value = int32Value(constant);
+
+        if(value >= -1 && value <= 5)
+          return LoweredLoad{static_cast<std::uint8_t>(0x03 + value), 1}; //iconst_<n>
+        if(value >= -128 && value <= 127)
+          return LoweredLoad{0x10, 2, value}; //bipush
+        if(value >= -32768 && value <= 32767)
+          return LoweredLoad{0x11, 3, value}; //sipush
+
+        index = pool.AddInteger(value);
+      }
+      else if(constant.front() == '"')
+      {
+        index = pool.AddString(constant.substr(1, constant.size() - 2));
+      }
+      else
+      {
+        index = pool.AddClass(constant);
+      }
+
+      return index <= 0xFF ? LoweredLoad{0x12, 2, 0, index} : LoweredLoad{0x13, 3, 0, index};
+    }
+
+    //locals past 255 and iinc increments past a byte take the wide form,
+    //also after an explicit wide (widened)
+    static constexpr bool needsWide(const Opcode& opcode, const Statement& statement, bool widened)
+    {
+      if(widened)
+        return true;
+
+      if(opcode.Kind == Operand::Iinc)
+      {
+        std::int64_t increment = parseInt(statement[2]);
+        return parseInt(statement[1]) > 0xFF || increment < -128 || increment > 127;
+      }
+
+      return opcode.Kind == Operand::Local && parseInt(statement[1]) > 0xFF;
+    }
+
+    //bytes of the encoded instruction, the wide prefix of an implicit wide
+    //included (an explicit one is sized on its own)
+    constexpr size_t instructionSize(const Opcode& opcode, const Statement& statement, bool widened)
+    {
+      switch(opcode.Kind)
+      {
+        case Operand::None:            return 1;
+        case Operand::Wide:            return 1;
+        case Operand::Byte:            return 2;
+        case Operand::NewArray:        return 2;
+        case Operand::MultiANewArray:  return 4;
+        case Operand::InterfaceMethod: return 5;
+        case Operand::BranchW:         return 5;
+
+        case Operand::Local:
+        case Operand::Iinc:
+        {
+          size_t size = opcode.Kind == Operand::Iinc ? 3 : 2;
+          if(!needsWide(opcode, statement, widened))
+            return size;
+          return (widened ? 0 : 1) + 1 + 2 * (size - 1);
+        }
+
+        case Operand::Ldc:
+        case Operand::LdcW:
+        case Operand::Ldc2W:
+          return lowerLoad(opcode, statement).Size;
+
+        case Operand::Switch:
+        case Operand::Dynamic:
+          fail("Assembler error: instruction isnt supported at compile time");
+
+        default:                       return 3;
+      }
+    }
+
+    template<typename Out>
+    constexpr void writeInstruction(const Opcode& opcode, const Statement& statement, bool widened,
+                                    std::uint32_t offset, const std::array<Label, MaxLabels>& labels,
+                                    size_t labelCount, Out& out)
+    {
+      auto intOperand = [&statement](size_t i, std::int64_t low, std::int64_t high)
+      {
+        std::int64_t value = parseInt(statement[i]);
+        if(value < low || value > high)
+          fail("Assembler error: operand out of range");
+        return value;
+      };
+
+      //the opcode depends on the operands for these
+      switch(opcode.Kind)
+      {
+        case Operand::Local:
+        case Operand::Iinc:
+        {
+          bool wide = needsWide(opcode, statement, widened);
+          if(wide && !widened)
+            out.U1(0xc4);
+          out.U1(opcode.Code);
+
+          std::int64_t local = intOperand(1, 0, wide ? 0xFFFF : 0xFF);
+          if(!wide)
+          {
+            out.U1(static_cast<std::uint8_t>(local));
+            if(opcode.Kind == Operand::Iinc)
+              out.U1(static_cast<std::uint8_t>(intOperand(2, -128, 127)));
+            return;
+          }
+
+          out.U2(static_cast<std::uint16_t>(local));
+          if(opcode.Kind == Operand::Iinc)
+            out.U2(static_cast<std::uint16_t>(intOperand(2, -32768, 32767)));
+          return;
+        }
+
+        case Operand::Ldc:
+        case Operand::LdcW:
+        case Operand::Ldc2W:
+        {
+          LoweredLoad load = lowerLoad(opcode, statement);
+          out.U1(load.Code);
+
+          if(load.Code == 0x10)
+            out.U1(static_cast<std::uint8_t>(load.Immediate));
+          else if(load.Code == 0x11)
+            out.U2(static_cast<std::uint16_t>(load.Immediate));
+          else if(load.Code == 0x12)
+            out.U1(static_cast<std::uint8_t>(load.PoolIndex));
+          else if(load.Code == 0x13 || load.Code == 0x14)
+            out.U2(load.PoolIndex);
+          return;
+        }
+
+        default:
+          break;
+      }
+
+      out.U1(opcode.Code);
+
+      switch(opcode.Kind)
+      {
+        case Operand::None:
+        case Operand::Wide:
+        case Operand::Local:
+        case Operand::Iinc:
+        case Operand::Ldc:
+        case Operand::LdcW:
+        case Operand::Ldc2W:
+          break;
+
+        case Operand::Byte:
+          out.U1(static_cast<std::uint8_t>(intOperand(1, -128, 127)));
+          break;
+
+        case Operand::Short:
+          out.U2(static_cast<std::uint16_t>(intOperand(1, -32768, 32767)));
+          break;
+
+        case Operand::Branch:
+        {
+          std::int64_t jump = std::int64_t{labelOffset(labels, labelCount, statement[1])} - offset;
+          if(jump < -32768 || jump > 32767)
+            fail("Assembler error: branch out of range");
+
+          out.U2(static_cast<std::uint16_t>(jump));
+          break;
+        }
+
+        case Operand::BranchW:
+        {
+          std::int64_t jump = std::int64_t{labelOffset(labels, labelCount, statement[1])} - offset;
+          out.U4(static_cast<std::uint32_t>(jump));
+          break;
+        }
+        case Operand::Field:
+          out.U2(pool.AddRef(ConstantPool::Fieldref, statement[1], statement[2]));
+          break;
+
+        case Operand::Method:
+        case Operand::InterfaceMethod:
+        {
+          std::string_view member = statement[1];
+          size_t paren = member.find('(');
+          if(paren == std::string_view::npos)
+            fail("Assembler error: method reference expects owner/name(args)ret");
+
+          bool isInterface = opcode.Kind == Operand::InterfaceMethod;
+          out.U2(pool.AddRef(isInterface ? ConstantPool::InterfaceMethodref : ConstantPool::Methodref,
+                             member.substr(0, paren), member.substr(paren)));
+
+          if(isInterface)
+          {
+            out.U1(static_cast<std::uint8_t>(intOperand(2, 1, 0xFF)));
+            out.U1(0);
+          }
+          break;
+        }
+
+        case Operand::Class:
+          out.U2(pool.AddClass(statement[1]));
+          break;
+
+        case Operand::NewArray:
+          out.U1(arrayType(statement[1]));
+          break;
+
+        case Operand::MultiANewArray:
+          out.U2(pool.AddClass(statement[1]));
+          out.U1(static_cast<std::uint8_t>(intOperand(2, 1, 0xFF)));
+          break;
+
+        case Operand::Switch:
+        case Operand::Dynamic:
+          fail("Assembler error: instruction isnt supported at compile time");
+      }
+    }
+
+    std::string_view source;
+    ConstantPool pool;
+};
+
+//size in bytes of the class file assembled from the source
+constexpr size_t ClassFileSize(std::string_view source)
+{
+  SizeCounter counter;
+  ClassAssembler{source}.Assemble(counter);
+  return counter.Size;
+}
+
+//N must be ClassFileSize(source)
+template<size_t N>
+constexpr std::array<std::uint8_t, N> AssembleClassFile(std::string_view source)
+{
+  ArrayWriter<N> writer;
+  ClassAssembler{source}.Assemble(writer);
+  return writer.Out;
+}
+
+//Source is a callable returning the source as a constant expression (the
+//lambda JASMIN_CLASS makes), which lets its size become the array bound
+template<typename Source>
+constexpr auto AssembleClass(Source source)
+{
+  constexpr std::string_view src = source();
+  return AssembleClassFile<ClassFileSize(src)>(src);
+}
+
+} //namespace: Constexpr
+} //namespace: Jasmin
+
+#define JASMIN_CLASS(source) \
+  ::Jasmin::Constexpr::AssembleClass([]{ return std::string_view{source}; })
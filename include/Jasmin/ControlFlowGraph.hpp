@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace Jasmin
+{
+
+//basic blocks of a method body (the nodes between .method and .end method)
+//with their edges stored in flat CSR arrays: the edges of block b are
+//entries [Offsets[b], Offsets[b+1]) of one shared array. built in time
+//linear in the number of nodes and edges.
+//
+//a block is a contiguous run of node positions (indices into the body),
+//directives and labels belong to the block of the instruction following
+//them. a new block starts at every label that is a branch target or part of
+//a .catch, and after every instruction that doesnt just fall through.
+class ControlFlowGraph
+{
+  public:
+    using BlockId = std::uint32_t;
+    static constexpr BlockId NoBlock = std::numeric_limits<BlockId>::max();
+
+    //view of the block ids of one block in a CSR array
+    class BlockRange
+    {
+      public:
+        BlockRange(const BlockId* pBegin, const BlockId* pEnd) : pBegin{pBegin}, pEnd{pEnd} {}
+
+        const BlockId* begin() const { return pBegin; }
+        const BlockId* end() const { return pEnd; }
+        size_t size() const { return static_cast<size_t>(pEnd - pBegin); }
+        bool empty() const { return pBegin == pEnd; }
+        BlockId operator[](size_t i) const { return pBegin[i]; }
+
+      private:
+        const BlockId* pBegin;
+        const BlockId* pEnd;
+    };
+
+    ControlFlowGraph(std::vector<NodePtr>::const_iterator begin,
+                     std::vector<NodePtr>::const_iterator end);
+
+    //the entry is block 0, a body without instructions has no blocks
+    size_t BlockCount() const { return blockStarts.size(); }
+
+    //[BlockBegin, BlockEnd) node positions of the block
+    size_t BlockBegin(BlockId block) const { return blockStarts[block]; }
+    size_t BlockEnd(BlockId block) const;
+
+    //position of the last instruction of the block
+    size_t Terminator(BlockId block) const { return terminators[block]; }
+
+    //block containing the node at the position
+    BlockId BlockAt(size_t position) const { return blockAt[position]; }
+
+    //block the label leads into, throws on undefined labels
+    BlockId BlockOf(Symbol label) const;
+
+    //normal control flow (branch targets and fallthrough)
+    BlockRange Successors(BlockId) const;
+
+    //handlers of the .catch ranges covering the block
+    BlockRange Handlers(BlockId) const;
+
+    //blocks with a normal or exception edge into the block
+    BlockRange Predecessors(BlockId) const;
+
+    //blocks reachable from the entry (through normal and exception edges) in
+    //reverse postorder, so every block comes before its successors except
+    //along back edges
+    const std::vector<BlockId>& ReversePostorder() const { return reversePostorder; }
+
+    //index of the block in ReversePostorder(), NoBlock if it is unreachable
+    BlockId PostorderRank(BlockId block) const { return rpoRank[block]; }
+    bool IsReachable(BlockId block) const { return rpoRank[block] != NoBlock; }
+
+  private:
+    static BlockRange range(const std::vector<std::uint32_t>& offsets,
+                            const std::vector<BlockId>& edges, BlockId);
+
+    void computeReversePostorder();
+
+    size_t nodeCount;
+
+    std::vector<size_t> blockStarts;
+    std::vector<size_t> terminators;
+    std::vector<BlockId> blockAt;
+    std::unordered_map<Symbol, size_t> labels;
+
+    std::vector<std::uint32_t> successorOffsets;
+    std::vector<BlockId> successors;
+    std::vector<std::uint32_t> handlerOffsets;
+    std::vector<BlockId> handlers;
+    std::vector<std::uint32_t> predecessorOffsets;
+    std::vector<BlockId> predecessors;
+
+    std::vector<BlockId> reversePostorder;
+    std::vector<BlockId> rpoRank;
+};
+
+//immediate dominators of the reachable blocks (Cooper, Harvey and Kennedy's
+//iterative algorithm over reverse postorder), with the dominator tree
+//numbered so Dominates is O(1)
+class DominatorTree
+{
+  public:
+    using BlockId = ControlFlowGraph::BlockId;
+
+    explicit DominatorTree(const ControlFlowGraph&);
+
+    //NoBlock for the entry and unreachable blocks
+    BlockId ImmediateDominator(BlockId block) const { return idoms[block]; }
+
+    //every block dominates itself, unreachable blocks dominate nothing
+    bool Dominates(BlockId dominator, BlockId block) const;
+
+  private:
+    std::vector<BlockId> idoms;
+
+    //pre/postorder numbers in the dominator tree, a dominates b exactly when
+    //b's interval is nested in a's
+    std::vector<std::uint32_t> preorder;
+    std::vector<std::uint32_t> postorder;
+};
+
+} //namespace: Jasmin
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace Jasmin
+{
+
+class ConstantPoolLayout;
+
+//how much of the .line, .var and .source debug info ends up in the class
+enum class DebugInfoPolicy
+{
+  Full,    //a line number entry for every instruction, local variables as written
+  Compact, //line number entries only where the line changes, touching
+           //ranges of the same local variable merged
+  Strip,   //no LineNumberTable, LocalVariableTable or SourceFile
+};
+
+//removes every .line, .var and .source directive (for the Strip policy, so
+//later passes dont see them)
+std::vector<NodePtr> StripDebugInfo(std::vector<NodePtr> nodes);
+
+struct LineNumberEntry
+{
+  std::uint16_t StartPc;
+  std::uint16_t LineNumber;
+};
+
+struct LocalVariableEntry
+{
+  std::uint16_t StartPc;
+  std::uint16_t Length;
+  Symbol Name;
+  Symbol Descriptor;
+  std::uint16_t Index;
+};
+
+struct MethodDebugInfo
+{
+  std::vector<LineNumberEntry> LineNumbers;
+  std::vector<LocalVariableEntry> LocalVariables;
+};
+
+//LineNumberTable and LocalVariableTable entries of a method body (the nodes
+//between .method and .end method) under the policy:
+//
+//  .line <number>
+//  .var <index> is <name> <descriptor> [from <label> to <label>]
+//
+//a .line applies to the instructions following it, a .var without labels
+//covers the whole method. throws on malformed directives, undefined labels
+//and ranges ending before they start. the offsets come from CodeOffsets, so
+//they are only exact for methods with ldc once the pool layout is given.
+MethodDebugInfo BuildDebugInfo(std::vector<NodePtr>::const_iterator begin,
+                               std::vector<NodePtr>::const_iterator end,
+                               DebugInfoPolicy, const ConstantPoolLayout* = nullptr);
+
+//file name of the SourceFile attribute (.source <file>), nullopt without a
+//.source directive or under Strip
+std::optional<Symbol> SourceFile(const std::vector<NodePtr>&, DebugInfoPolicy);
+
+} //namespace: Jasmin
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace Jasmin
+{
+
+class ConstantPoolLayout;
+
+//static encoding/stack information about jvm instructions, keyed by mnemonic
+//(the opcodes and operand sizes come from Opcodes)
+struct InstructionInfo
+{
+  enum class Flow : std::uint8_t
+  {
+    Next,    //falls through to the next instruction
+    Branch,  //conditional branch, may also fall through
+    Goto,    //unconditional branch
+    Switch,  //tableswitch/lookupswitch
+    Return,  //*return
+    Throw,   //athrow
+    Jsr,     //jsr/jsr_w
+    Ret,     //ret
+  };
+
+  //NOTE: Variable means the value depends on the operands (descriptors,
+  //switch cases, ...)
+  static constexpr std::int8_t Variable = -1;
+
+  std::int8_t OperandBytes;
+  std::int8_t Pops;   //in stack slots (long/double take 2)
+  std::int8_t Pushes; //in stack slots
+  Flow ControlFlow;
+
+  //local variable slot accessed by the instruction (implicit for the _<n>
+  //forms), Width is 2 for longs/doubles
+  std::int8_t ImplicitLocal = Variable;
+  std::int8_t LocalWidth = 0;
+  bool IsLocalStore = false;
+
+  std::uint8_t Code = 0; //the opcode (see Opcodes)
+};
+
+const InstructionInfo* LookupInstruction(Symbol mnemonic);
+const InstructionInfo& GetInstruction(const InstructionNode&);
+
+//size in bytes of the encoded instruction when it starts at the given code
+//offset (needed for switch padding), accounts for implicit wide forms. where
+//the size depends on more than the instruction it is an upper bound: ldc is
+//sized as ldc_w unless the final pool layout is given and an explicit wide
+//as the extra bytes of wide iinc. branches are sized in their short form,
+//CodeOffsets widens them
+size_t EncodedSize(const InstructionNode&, size_t offset, const ConstantPoolLayout* = nullptr);
+
+//code offset of every instruction node in [begin, end), followed by the code
+//size. unlike summing EncodedSize, an explicit wide is sized together with
+//the instruction it widens and branches further than +-32KB are widened to
+//goto_w/jsr_w (a conditional branch to the inverted branch over a goto_w).
+//ldc offsets are exact once the final pool layout is given
+std::vector<size_t> CodeOffsets(std::vector<NodePtr>::const_iterator begin,
+                                std::vector<NodePtr>::const_iterator end,
+                                const ConstantPoolLayout* = nullptr);
+
+//bytes of padding after a tableswitch/lookupswitch opcode at the given code
+//offset, its operands start on a 4 byte boundary
+size_t SwitchPadding(size_t offset);
+
+//{pops, pushes} in stack slots, resolving descriptor dependent instructions
+std::pair<int, int> StackEffect(const InstructionNode&);
+
+//labels the instruction may transfer control to (not including fallthrough)
+std::vector<Symbol> BranchTargets(const InstructionNode&);
+
+//true if control can continue to the next instruction
+bool FallsThrough(const InstructionNode&);
+
+//local variable slot read or written by the instruction, if any
+std::optional<unsigned> LocalSlot(const InstructionNode&);
+
+//stack slots taken by a field descriptor (0 for V)
+unsigned DescriptorSlots(std::string_view fieldDescriptor);
+
+//{argument slots, return slots} of a method descriptor "(...)R", also
+//accepts a full "class/name(...)R" reference
+std::pair<unsigned, unsigned> MethodDescriptorSlots(std::string_view);
+
+//splits a method descriptor into its parameter field descriptors
+std::vector<std::string_view> MethodParameters(std::string_view methodDescriptor);
+
+//the "(...)R" part of a "name(...)R" or "class/name(...)R" reference
+std::string_view MethodDescriptorOf(std::string_view methodRef);
+
+} //namespace: Jasmin
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace Jasmin
+{
+
+//a file to put into a JAR, e.g. an assembled class under "pkg/Name.class"
+struct JarEntry
+{
+  std::string Name;
+  std::string Contents;
+};
+
+struct JarOptions
+{
+  //threads deflating entries, 0 uses std::thread::hardware_concurrency()
+  unsigned Threads = 0;
+  //zlib level, 0 stores every entry uncompressed
+  int CompressionLevel = 6;
+  //adds a META-INF/MANIFEST.MF unless one of the entries already is one
+  bool AddManifest = true;
+};
+
+//builds a JAR (zip) from the entries. every entry is deflated on its own on
+//a pool of worker threads (stored instead when deflating doesnt shrink it),
+//then the entries are written sorted by name (the manifest first) with a
+//fixed timestamp, followed by the central directory. the bytes only depend
+//on the entries and the compression level, not on the thread count or the
+//order the entries come in.
+//
+//throws on duplicate or empty names and on JARs that would need zip64
+//(65535 entries or more, or sizes/offsets past 4GB).
+std::string BuildJar(std::vector<JarEntry> entries, const JarOptions& = {});
+
+//BuildJar written to a temporary file renamed to the path, so a failed run
+//never leaves a truncated JAR behind
+void WriteJar(const std::filesystem::path& path, std::vector<JarEntry> entries,
+              const JarOptions& = {});
+
+} //namespace: Jasmin
@@ -1,13 +1,18 @@
 #pragma once
 
 #include "Stream.hpp"
+#include "Symbol.hpp"
 
+#include <cstdint>
 #include <functional>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 #include <queue>
 #include <optional>
 #include <map>
+#include <variant>
+#include <vector>
 
 namespace Jasmin
 {
@@ -67,8 +72,20 @@ class Token
       size_t FileOffset;
     };
 
+    //typed value of Integer (int32 when it fits, otherwise int64) and Decimal
+    //tokens, converted once while lexing so consumers never reparse Value
+    using Number = std::variant<std::monostate, std::int32_t, std::int64_t, double>;
+
+    bool IsNumber() const { return !std::holds_alternative<std::monostate>(Num); }
+    std::optional<std::int64_t> IntValue() const;
+    //the value where an int is expected: int32 values and hex literals up to
+    //0xFFFFFFFF read as a bit pattern (0xFFFFFFFF is -1), nullopt otherwise
+    std::optional<std::int32_t> Int32Value() const;
+    std::optional<double> DecimalValue() const;
+
     TokenType Type;
-    std::string Value;
+    Symbol Value;
+    Number Num;
     MetaInfo Info;
 };
 
@@ -85,6 +102,12 @@ class Lexer
     static std::vector<Token> LexAll(InStream& in);
     static std::vector<Token> LexAll(InStream&& in);
 
+    //the token list is allocated from the resource (the symbols stay
+    //interned in the global table)
+    std::pmr::vector<Token> LexAll(std::pmr::memory_resource*);
+    static std::pmr::vector<Token> LexAll(InStream& in, std::pmr::memory_resource*);
+    static std::pmr::vector<Token> LexAll(InStream&& in, std::pmr::memory_resource*);
+
     bool  HasMore() const;
     Token LexNext();
 
@@ -93,6 +116,9 @@ class Lexer
     size_t         CurrentFileOffset() const;
 
   private:
+    template<typename Tokens>
+    void lexAll(Tokens&);
+
     //NOTE: below functions assume the first char has already been consumed
     //('.' for directives, ';' for comments, etc.)
     Token lexDirective();
@@ -100,8 +126,14 @@ class Lexer
 
     //NOTE: assumes '.' has already been consumed after the integer part
     Token lexDecimal(std::string integerPart);
+    void lexExponent(std::string& decimalStr);
+
+    //NOTE: assumes a leading '-' has already been consumed when negative
+    Token lexNumber(bool negative);
+    Token lexHexNumber(bool negative);
 
-    Token lexNumber();
+    Token makeDecimalToken(std::string_view) const;
+    static Token::Number narrowInteger(std::int64_t);
 
     std::optional<Token> isKeywordToken(std::string_view);
 
@@ -119,15 +151,16 @@ class Lexer
     void consumeToEndOfLine();
     void consumeWhitespaceAndComments();
 
-    Token makeToken(Token::TokenType, std::string="") const;
+    Token makeToken(Token::TokenType, std::string_view="", Token::Number={}) const;
 
     //NOTE: these are defined statically to be more easily passed as functors
     //(apparently std functions are special and cant be passed directly)
-    static bool isAlpha(char c) { return std::isalpha(c); } 
-    static bool isDigit(char c) { return std::isdigit(c); } 
-    static bool isWhitespace(char c) { return std::isspace(c); }
+    static bool isAlpha(char c) { return std::isalpha(static_cast<unsigned char>(c)); } 
+    static bool isDigit(char c) { return std::isdigit(static_cast<unsigned char>(c)); } 
+    static bool isHexDigit(char c) { return std::isxdigit(static_cast<unsigned char>(c)); } 
+    static bool isWhitespace(char c) { return std::isspace(static_cast<unsigned char>(c)); }
     static bool isNewline(char c) { return c == '\n'; }
-    static bool isSpace(char c) { return c == ' ' || c == '\t'; }
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
     static bool isEOF(char c) { return c == EOF; }
 
     std::runtime_error error(std::string_view) const;
@@ -135,6 +168,7 @@ class Lexer
 
   private:
     InStream inputStream;
+    Token::MetaInfo tokenStart{1, 1, 0};
 };
 
 } //namespace: Jasmin
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+namespace Jasmin
+{
+
+//read only view of a whole file, memory mapped where the platform supports
+//it (read into memory otherwise). copies share the mapping
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+
+    //throws if the file cant be opened or mapped
+    static MappedFile Open(const std::filesystem::path&);
+
+    std::string_view Data() const { return data; }
+
+  private:
+    MappedFile(std::shared_ptr<const void> mapping, std::string_view data)
+    : mapping{std::move(mapping)}, data{data}
+    {
+    }
+
+    std::shared_ptr<const void> mapping;
+    std::string_view data;
+};
+
+//writes the file next to its destination (under a name unique to the call)
+//and renames it over it, so readers never map a partially written file and
+//concurrent writers dont clobber each others temporary file
+void WriteFileAtomically(const std::filesystem::path&, std::string_view contents);
+
+} //namespace: Jasmin
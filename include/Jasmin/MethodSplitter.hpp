@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <vector>
+
+namespace Jasmin
+{
+
+struct SplitOptions
+{
+  //the jvm rejects methods with more than 65535 bytes of code
+  size_t MaxCodeSize = 65535;
+};
+
+//moves the tail of every method whose encoded code would exceed
+//MaxCodeSize into a private static helper method (repeatedly, if the helper
+//is still too large). the helper gets the locals the tail reads as
+//arguments, the original method calls it and returns its result.
+//
+//a method is only cut where that is safe: the operand stack is empty, no
+//branch or exception range crosses the cut, and every local the tail reads
+//has a single known type at that point (taken from the method descriptor,
+//the stores before the cut, or a .var directive). methods using jsr/ret and
+//constructors are never split. throws if an oversized method cant be split.
+std::vector<NodePtr> SplitOversizedMethods(std::vector<NodePtr> nodes,
+                                           const SplitOptions& = {});
+
+//encoded size in bytes of the instructions in [begin, end)
+size_t CodeSize(std::vector<NodePtr>::const_iterator begin,
+                std::vector<NodePtr>::const_iterator end);
+
+} //namespace: Jasmin
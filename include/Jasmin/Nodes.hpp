@@ -1,10 +1,17 @@
 #pragma once
 
 #include "./Common.hpp"
+#include "./Lexer.hpp"
+#include "./Symbol.hpp"
 
+#include <cstdint>
 #include <memory>
+#include <memory_resource>
 #include <tuple>
+#include <type_traits>
 #include <optional>
+#include <utility>
+#include <vector>
 
 namespace Jasmin
 {
@@ -14,18 +21,106 @@ struct Node
   virtual ~Node(){}
   protected:
   Node(){}
+
+  private:
+  friend class NodeDeleter;
+
+  //NOTE: nodes made by MakeNode from a memory resource override this to give
+  //their memory back to it, so NodePtr needs no state of its own
+  virtual void destroy() { delete this; }
+};
+
+//releases a node the way it was made (see Node::destroy)
+class NodeDeleter
+{
+  public:
+    NodeDeleter() = default;
+
+    //lets nodes made with std::make_unique convert to NodePtr
+    template<typename T>
+    NodeDeleter(std::default_delete<T>) {}
+
+    void operator()(Node* pNode) const { pNode->destroy(); }
+};
+
+using NodePtr = std::unique_ptr<Node, NodeDeleter>;
+
+//a T made by MakeNode in memory from a resource, it remembers the resource to
+//give the memory back to it
+template<typename T>
+class ResourceNode final : public T
+{
+  public:
+    template<typename... Args>
+    explicit ResourceNode(std::pmr::memory_resource* pResource, Args&&... args)
+    : T(std::forward<Args>(args)...), pResource{pResource} {}
+
+  private:
+    void destroy() override
+    {
+      std::pmr::memory_resource* pFrom = pResource;
+      this->~ResourceNode();
+      pFrom->deallocate(this, sizeof(ResourceNode), alignof(ResourceNode));
+    }
+
+    std::pmr::memory_resource* pResource;
 };
-using NodePtr = std::unique_ptr<Node>;
+
+//makes a node in memory from the resource, nodes with Args/Cases take those
+//from it too. nullptr uses new/delete like std::make_unique
+template<typename T>
+std::unique_ptr<T, NodeDeleter> MakeNode(std::pmr::memory_resource* pResource = nullptr)
+{
+  if(!pResource)
+    return std::unique_ptr<T, NodeDeleter>{new T{}};
+
+  using Made = ResourceNode<T>;
+  void* pMemory = pResource->allocate(sizeof(Made), alignof(Made));
+  T* pNode;
+
+  try
+  {
+    if constexpr(std::is_constructible_v<T, std::pmr::memory_resource*>)
+      pNode = new(pMemory) Made{pResource, pResource};
+    else
+      pNode = new(pMemory) Made{pResource};
+  }
+  catch(...)
+  {
+    pResource->deallocate(pMemory, sizeof(Made), alignof(Made));
+    throw;
+  }
+
+  return std::unique_ptr<T, NodeDeleter>{pNode};
+}
 
 struct InstructionNode : public Node
 {
-  std::string Mnemonic;
-  std::vector<std::string> Args;
+  InstructionNode() = default;
+  explicit InstructionNode(std::pmr::memory_resource* pResource) : Args{pResource} {}
+
+  Symbol Mnemonic;
+  std::pmr::vector<Token> Args;
+};
+
+//key and target label of a tableswitch/lookupswitch case
+using SwitchCase = std::pair<std::int32_t, Symbol>;
+
+//tableswitch/lookupswitch, cases are given on the lines following the
+//instruction. for tableswitch Args holds the low (and optional high) key
+struct SwitchNode : public InstructionNode
+{
+  SwitchNode() = default;
+  explicit SwitchNode(std::pmr::memory_resource* pResource)
+  : InstructionNode{pResource}, Cases{pResource} {}
+
+  std::pmr::vector<SwitchCase> Cases;
+  Symbol DefaultLabel;
 };
 
 struct LabelNode : public Node
 {
-  std::string LabelName;
+  Symbol LabelName;
 };
 
 struct DirectiveNode : public Node 
@@ -37,8 +132,11 @@ struct DirectiveNode : public Node
 
 struct DUnimplemented : public DirectiveNode
 {
-  std::string DirectiveName;
-  std::vector<std::string> Args;
+  DUnimplemented() = default;
+  explicit DUnimplemented(std::pmr::memory_resource* pResource) : Args{pResource} {}
+
+  Symbol DirectiveName;
+  std::pmr::vector<Token> Args;
 };
 
 struct DBytecode : public DirectiveNode
@@ -48,18 +146,18 @@ struct DBytecode : public DirectiveNode
 
 struct DSource : public DirectiveNode
 {
-  std::string Source;
+  Symbol Source;
 };
 
 struct DClass : public DirectiveNode
 {
-  std::string ClassName;
+  Symbol ClassName;
   AccessSpec Access;
 };
 
 struct DSuper : public DirectiveNode
 {
-  std::string SuperName;
+  Symbol SuperName;
 };
 
 } //namespace: Jasmin
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace Jasmin
+{
+
+//the jvm instructions and the kind of their operands, shared by the run time
+//instruction table (see LookupInstruction) and the compile time assembler
+enum class Operand : std::uint8_t
+{
+  None,
+  Byte,            //bipush
+  Short,           //sipush
+  Local,           //u1 local index
+  Iinc,            //local, s1 increment
+  Branch,          //s2 offset to a label
+  BranchW,         //s4 offset to a label
+  Wide,            //prefix of the next load, store, iinc or ret
+  Ldc,             //u1 pool index
+  LdcW,            //u2 pool index
+  Ldc2W,           //u2 pool index of a long
+  Field,           //owner/name descriptor
+  Method,          //owner/name(args)ret
+  InterfaceMethod, //owner/name(args)ret count
+  Class,           //class name
+  NewArray,        //primitive type name
+  MultiANewArray,  //class name, dimensions
+  Switch,          //tableswitch/lookupswitch, padded and variable length
+  Dynamic,         //invokedynamic, u2 pool index and two zero bytes
+};
+
+struct Opcode
+{
+  std::string_view Mnemonic;
+  std::uint8_t Code;
+  Operand Kind;
+};
+
+constexpr Opcode Opcodes[] = {
+    {"nop", 0x00, Operand::None},
+    {"aconst_null", 0x01, Operand::None},
+    {"iconst_m1", 0x02, Operand::None},
+    {"iconst_0", 0x03, Operand::None},
+    {"iconst_1", 0x04, Operand::None},
+    {"iconst_2", 0x05, Operand::None},
+    {"iconst_3", 0x06, Operand::None},
+    {"iconst_4", 0x07, Operand::None},
+    {"iconst_5", 0x08, Operand::None},
+    {"lconst_0", 0x09, Operand::None},
+    {"lconst_1", 0x0a, Operand::None},
+    {"fconst_0", 0x0b, Operand::None},
+    {"fconst_1", 0x0c, Operand::None},
+    {"fconst_2", 0x0d, Operand::None},
+    {"dconst_0", 0x0e, Operand::None},
+    {"dconst_1", 0x0f, Operand::None},
+    {"bipush", 0x10, Operand::Byte},
+    {"sipush", 0x11, Operand::Short},
+    {"ldc", 0x12, Operand::Ldc},
+    {"ldc_w", 0x13, Operand::LdcW},
+    {"ldc2_w", 0x14, Operand::Ldc2W},
+    {"iload", 0x15, Operand::Local},
+    {"lload", 0x16, Operand::Local},
+    {"fload", 0x17, Operand::Local},
+    {"dload", 0x18, Operand::Local},
+    {"aload", 0x19, Operand::Local},
+    {"iload_0", 0x1a, Operand::None},
+    {"iload_1", 0x1b, Operand::None},
+    {"iload_2", 0x1c, Operand::None},
+    {"iload_3", 0x1d, Operand::None},
+    {"lload_0", 0x1e, Operand::None},
+    {"lload_1", 0x1f, Operand::None},
+    {"lload_2", 0x20, Operand::None},
+    {"lload_3", 0x21, Operand::None},
+    {"fload_0", 0x22, Operand::None},
+    {"fload_1", 0x23, Operand::None},
+    {"fload_2", 0x24, Operand::None},
+    {"fload_3", 0x25, Operand::None},
+    {"dload_0", 0x26, Operand::None},
+    {"dload_1", 0x27, Operand::None},
+    {"dload_2", 0x28, Operand::None},
+    {"dload_3", 0x29, Operand::None},
+    {"aload_0", 0x2a, Operand::None},
+    {"aload_1", 0x2b, Operand::None},
+    {"aload_2", 0x2c, Operand::None},
+    {"aload_3", 0x2d, Operand::None},
+    {"iaload", 0x2e, Operand::None},
+    {"laload", 0x2f, Operand::None},
+    {"faload", 0x30, Operand::None},
+    {"daload", 0x31, Operand::None},
+    {"aaload", 0x32, Operand::None},
+    {"baload", 0x33, Operand::None},
+    {"caload", 0x34, Operand::None},
+    {"saload", 0x35, Operand::None},
+    {"istore", 0x36, Operand::Local},
+    {"lstore", 0x37, Operand::Local},
+    {"fstore", 0x38, Operand::Local},
+    {"dstore", 0x39, Operand::Local},
+    {"astore", 0x3a, Operand::Local},
+    {"istore_0", 0x3b, Operand::None},
+    {"istore_1", 0x3c, Operand::None},
+    {"istore_2", 0x3d, Operand::None},
+    {"istore_3", 0x3e, Operand::None},
+    {"lstore_0", 0x3f, Operand::None},
+    {"lstore_1", 0x40, Operand::None},
+    {"lstore_2", 0x41, Operand::None},
+    {"lstore_3", 0x42, Operand::None},
+    {"fstore_0", 0x43, Operand::None},
+    {"fstore_1", 0x44, Operand::None},
+    {"fstore_2", 0x45, Operand::None},
+    {"fstore_3", 0x46, Operand::None},
+    {"dstore_0", 0x47, Operand::None},
+    {"dstore_1", 0x48, Operand::None},
+    {"dstore_2", 0x49, Operand::None},
+    {"dstore_3", 0x4a, Operand::None},
+    {"astore_0", 0x4b, Operand::None},
+    {"astore_1", 0x4c, Operand::None},
+    {"astore_2", 0x4d, Operand::None},
+    {"astore_3", 0x4e, Operand::None},
+    {"iastore", 0x4f, Operand::None},
+    {"lastore", 0x50, Operand::None},
+    {"fastore", 0x51, Operand::None},
+    {"dastore", 0x52, Operand::None},
+    {"aastore", 0x53, Operand::None},
+    {"bastore", 0x54, Operand::None},
+    {"castore", 0x55, Operand::None},
+    {"sastore", 0x56, Operand::None},
+    {"pop", 0x57, Operand::None},
+    {"pop2", 0x58, Operand::None},
+    {"dup", 0x59, Operand::None},
+    {"dup_x1", 0x5a, Operand::None},
+    {"dup_x2", 0x5b, Operand::None},
+    {"dup2", 0x5c, Operand::None},
+    {"dup2_x1", 0x5d, Operand::None},
+    {"dup2_x2", 0x5e, Operand::None},
+    {"swap", 0x5f, Operand::None},
+    {"iadd", 0x60, Operand::None},
+    {"ladd", 0x61, Operand::None},
+    {"fadd", 0x62, Operand::None},
+    {"dadd", 0x63, Operand::None},
+    {"isub", 0x64, Operand::None},
+    {"lsub", 0x65, Operand::None},
+    {"fsub", 0x66, Operand::None},
+    {"dsub", 0x67, Operand::None},
+    {"imul", 0x68, Operand::None},
+    {"lmul", 0x69, Operand::None},
+    {"fmul", 0x6a, Operand::None},
+    {"dmul", 0x6b, Operand::None},
+    {"idiv", 0x6c, Operand::None},
+    {"ldiv", 0x6d, Operand::None},
+    {"fdiv", 0x6e, Operand::None},
+    {"ddiv", 0x6f, Operand::None},
+    {"irem", 0x70, Operand::None},
+    {"lrem", 0x71, Operand::None},
+    {"frem", 0x72, Operand::None},
+    {"drem", 0x73, Operand::None},
+    {"ineg", 0x74, Operand::None},
+    {"lneg", 0x75, Operand::None},
+    {"fneg", 0x76, Operand::None},
+    {"dneg", 0x77, Operand::None},
+    {"ishl", 0x78, Operand::None},
+    {"lshl", 0x79, Operand::None},
+    {"ishr", 0x7a, Operand::None},
+    {"lshr", 0x7b, Operand::None},
+    {"iushr", 0x7c, Operand::None},
+    {"lushr", 0x7d, Operand::None},
+    {"iand", 0x7e, Operand::None},
+    {"land", 0x7f, Operand::None},
+    {"ior", 0x80, Operand::None},
+    {"lor", 0x81, Operand::None},
+    {"ixor", 0x82, Operand::None},
+    {"lxor", 0x83, Operand::None},
+    {"iinc", 0x84, Operand::Iinc},
+    {"i2l", 0x85, Operand::None},
+    {"i2f", 0x86, Operand::None},
+    {"i2d", 0x87, Operand::None},
+    {"l2i", 0x88, Operand::None},
+    {"l2f", 0x89, Operand::None},
+    {"l2d", 0x8a, Operand::None},
+    {"f2i", 0x8b, Operand::None},
+    {"f2l", 0x8c, Operand::None},
+    {"f2d", 0x8d, Operand::None},
+    {"d2i", 0x8e, Operand::None},
+    {"d2l", 0x8f, Operand::None},
+    {"d2f", 0x90, Operand::None},
+    {"i2b", 0x91, Operand::None},
+    {"i2c", 0x92, Operand::None},
+    {"i2s", 0x93, Operand::None},
+    {"lcmp", 0x94, Operand::None},
+    {"fcmpl", 0x95, Operand::None},
+    {"fcmpg", 0x96, Operand::None},
+    {"dcmpl", 0x97, Operand::None},
+    {"dcmpg", 0x98, Operand::None},
+    {"ifeq", 0x99, Operand::Branch},
+    {"ifne", 0x9a, Operand::Branch},
+    {"iflt", 0x9b, Operand::Branch},
+    {"ifge", 0x9c, Operand::Branch},
+    {"ifgt", 0x9d, Operand::Branch},
+    {"ifle", 0x9e, Operand::Branch},
+    {"if_icmpeq", 0x9f, Operand::Branch},
+    {"if_icmpne", 0xa0, Operand::Branch},
+    {"if_icmplt", 0xa1, Operand::Branch},
+    {"if_icmpge", 0xa2, Operand::Branch},
+    {"if_icmpgt", 0xa3, Operand::Branch},
+    {"if_icmple", 0xa4, Operand::Branch},
+    {"if_acmpeq", 0xa5, Operand::Branch},
+    {"if_acmpne", 0xa6, Operand::Branch},
+    {"goto", 0xa7, Operand::Branch},
+    {"jsr", 0xa8, Operand::Branch},
+    {"ret", 0xa9, Operand::Local},
+    {"tableswitch", 0xaa, Operand::Switch},
+    {"lookupswitch", 0xab, Operand::Switch},
+    {"ireturn", 0xac, Operand::None},
+    {"lreturn", 0xad, Operand::None},
+    {"freturn", 0xae, Operand::None},
+    {"dreturn", 0xaf, Operand::None},
+    {"areturn", 0xb0, Operand::None},
+    {"return", 0xb1, Operand::None},
+    {"getstatic", 0xb2, Operand::Field},
+    {"putstatic", 0xb3, Operand::Field},
+    {"getfield", 0xb4, Operand::Field},
+    {"putfield", 0xb5, Operand::Field},
+    {"invokevirtual", 0xb6, Operand::Method},
+    {"invokespecial", 0xb7, Operand::Method},
+    {"invokestatic", 0xb8, Operand::Method},
+    {"invokeinterface", 0xb9, Operand::InterfaceMethod},
+    {"invokedynamic", 0xba, Operand::Dynamic},
+    {"new", 0xbb, Operand::Class},
+    {"newarray", 0xbc, Operand::NewArray},
+    {"anewarray", 0xbd, Operand::Class},
+    {"arraylength", 0xbe, Operand::None},
+    {"athrow", 0xbf, Operand::None},
+    {"checkcast", 0xc0, Operand::Class},
+    {"instanceof", 0xc1, Operand::Class},
+    {"monitorenter", 0xc2, Operand::None},
+    {"monitorexit", 0xc3, Operand::None},
+    {"wide", 0xc4, Operand::Wide},
+    {"multianewarray", 0xc5, Operand::MultiANewArray},
+    {"ifnull", 0xc6, Operand::Branch},
+    {"ifnonnull", 0xc7, Operand::Branch},
+    {"goto_w", 0xc8, Operand::BranchW},
+    {"jsr_w", 0xc9, Operand::BranchW},
+};
+
+//bytes of operands following the opcode, -1 where it depends on the operands
+//(the switches). an explicit wide counts as 0, its bytes depend on the
+//instruction it widens
+constexpr std::int8_t OperandBytes(Operand kind)
+{
+  switch(kind)
+  {
+    case Operand::None:            return 0;
+    case Operand::Wide:            return 0;
+    case Operand::Byte:            return 1;
+    case Operand::Local:           return 1;
+    case Operand::Ldc:             return 1;
+    case Operand::NewArray:        return 1;
+    case Operand::MultiANewArray:  return 3;
+    case Operand::InterfaceMethod: return 4;
+    case Operand::Dynamic:         return 4;
+    case Operand::BranchW:         return 4;
+    case Operand::Switch:          return -1;
+    default:                       return 2;
+  }
+}
+
+} //namespace: Jasmin
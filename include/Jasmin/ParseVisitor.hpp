@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Lexer.hpp"
+#include "Nodes.hpp"
+
+#include <memory_resource>
+#include <vector>
+
+namespace Jasmin
+{
+
+//event based alternative to parsing into nodes: Parser::Visit calls these
+//for every statement in source order without allocating any nodes. the
+//argument vectors are reused between calls, copy what needs to be kept
+class ParseVisitor
+{
+  public:
+    virtual ~ParseVisitor(){}
+
+    virtual void OnDirective(const Token& directive, const std::vector<Token>& args) {}
+    virtual void OnInstruction(Symbol mnemonic, const std::vector<Token>& args) {}
+    virtual void OnLabel(Symbol label) {}
+
+    //tableswitch/lookupswitch, defaults to OnInstruction without the cases
+    virtual void OnSwitch(Symbol mnemonic, const std::vector<Token>& args,
+                          const std::vector<SwitchCase>& cases, Symbol defaultLabel)
+    {
+      OnInstruction(mnemonic, args);
+    }
+};
+
+//builds the nodes Parser::ParseAll returns from the visitor events, into a
+//std::vector or (with the list from the resource too) a std::pmr::vector
+template<typename NodeList>
+class BasicNodeBuilder : public ParseVisitor
+{
+  public:
+    //the nodes (with their arguments) come from the resource, nullptr uses
+    //new/delete
+    explicit BasicNodeBuilder(std::pmr::memory_resource* pResource = nullptr);
+
+    void OnDirective(const Token& directive, const std::vector<Token>& args) override;
+    void OnInstruction(Symbol mnemonic, const std::vector<Token>& args) override;
+    void OnLabel(Symbol label) override;
+    void OnSwitch(Symbol mnemonic, const std::vector<Token>& args,
+                  const std::vector<SwitchCase>& cases, Symbol defaultLabel) override;
+
+    NodeList Nodes;
+
+  private:
+    std::pmr::memory_resource* pResource;
+};
+
+using NodeBuilder = BasicNodeBuilder<std::vector<NodePtr>>;
+using PmrNodeBuilder = BasicNodeBuilder<std::pmr::vector<NodePtr>>;
+
+extern template class BasicNodeBuilder<std::vector<NodePtr>>;
+extern template class BasicNodeBuilder<std::pmr::vector<NodePtr>>;
+
+} //namespace: Jasmin
@@ -2,7 +2,10 @@
 
 #include "Lexer.hpp"
 #include "Nodes.hpp"
+#include "ParseVisitor.hpp"
 
+#include <memory_resource>
+#include <optional>
 #include <vector>
 #include <string_view>
 
@@ -13,28 +16,85 @@ class Parser
 {
   public:
     Parser(const std::vector<Token>& tokens);
+    Parser(const std::pmr::vector<Token>& tokens);
     Parser(Lexer lexer);
+
+    //NOTE: a copy would view the tokens owned by the original
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
+    Parser(Parser&&) = default;
+    Parser& operator=(Parser&&) = default;
+
     std::vector<NodePtr> ParseAll();
     static std::vector<NodePtr> ParseAll(const std::vector<Token>& tokens);
     static std::vector<NodePtr> ParseAll(const std::vector<Token>&& tokens);
 
+    //the nodes, their arguments and the list are allocated from the resource
+    //(e.g. a std::pmr::monotonic_buffer_resource per request), which must
+    //outlive them
+    std::pmr::vector<NodePtr> ParseAll(std::pmr::memory_resource*);
+    static std::pmr::vector<NodePtr> ParseAll(const std::pmr::vector<Token>& tokens,
+                                              std::pmr::memory_resource*);
+
+    //reports the remaining statements to the visitor instead of making nodes
+    void Visit(ParseVisitor&);
+
+    //streams tokens straight from the lexer (one token of lookahead), so
+    //memory use doesnt grow with the size of the input
+    static void Visit(Lexer lexer, ParseVisitor&);
+
     bool HasMore() const;
     NodePtr ParseNext();
 
   private:
+    Parser(Lexer* streamingLexer);
+
     Token consumeNextToken();
     Token peekNextToken() const;
-    std::string consumeExpected(TT);
+    const Token* lookaheadToken() const;
+    Symbol consumeExpected(TT);
     Token consumeDirective();
 
-    NodePtr parseDirective();
-    NodePtr parseInstruction();
-    NodePtr parseLabel();
+    void parseStatement(ParseVisitor&);
+    void parseDirective(ParseVisitor&);
+    void parseInstruction(ParseVisitor&);
+    void parseSwitch(Symbol mnemonic, ParseVisitor&);
+    void parseLabel(ParseVisitor&);
 
     std::runtime_error error(std::string_view) const;
 
-    const std::vector<Token>& tokens;
+    //tokens of a std::vector or std::pmr::vector
+    class TokenSpan
+    {
+      public:
+        TokenSpan() = default;
+        TokenSpan(const Token* pData, size_t count) : pData{pData}, count{count} {}
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const Token& operator[](size_t i) const { return pData[i]; }
+
+      private:
+        const Token* pData = nullptr;
+        size_t count = 0;
+    };
+
+    //NOTE: only used when the parser lexes its own tokens, declared before
+    //tokens so it is initialized first. moving the parser keeps the vector's
+    //buffer, so tokens stays valid
+    std::vector<Token> ownedTokens;
+    TokenSpan tokens;
     size_t currentToken = 0;
+
+    //streaming mode, the lookahead is filled lazily (also by the const
+    //peek functions)
+    Lexer* pLexer = nullptr;
+    mutable std::optional<Token> lookahead;
+    mutable bool lexerDrained = false;
+
+    //reused for every statement
+    std::vector<Token> argBuffer;
+    std::vector<SwitchCase> caseBuffer;
 };
 
 } //namespace: Jasmin
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Lexer.hpp"
+#include "MappedFile.hpp"
+#include "Nodes.hpp"
+#include "ParseVisitor.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Jasmin
+{
+
+//compact binary image of a lexed and parsed source, used to skip the lexer
+//and parser when a source hasnt changed since the image was written.
+//
+//layout (native byte order, every section 8 byte aligned):
+//  header     magic, byte order mark, version, hash and size of the source,
+//             count and offset of every section
+//  strings    {offset, length} per distinct symbol, indexing the text section
+//  tokens     fixed size records of the whole token stream
+//  nodes      fixed size records, one per parsed statement
+//  args       token records of the statement arguments
+//  cases      {key, label} records of tableswitch/lookupswitch cases
+//  text       the symbol characters
+//
+//NOTE: records refer to symbols by string table index, the table is
+//interned once on load so reading tokens/nodes needs no hashing per token
+class SourceCache
+{
+  public:
+    //bumped whenever the layout or the lexer/parser output changes, images
+    //of other versions are rejected
+    static constexpr std::uint32_t Version = 1;
+
+    //lexes and parses the source and returns its image
+    static std::string Build(std::string_view source);
+
+    //writes an image returned by Build to the file (atomically, via a rename)
+    static void Write(const std::filesystem::path&, std::string_view image);
+
+    //maps the file into memory, throws if it isnt a valid image
+    static SourceCache Open(const std::filesystem::path&);
+
+    //views an image in memory, which must outlive the cache
+    explicit SourceCache(std::string_view image);
+
+    static std::uint64_t HashSource(std::string_view source);
+
+    //true if the image was built from this source
+    bool Matches(std::string_view source) const;
+
+    std::vector<Token> Tokens() const;
+    std::vector<NodePtr> Nodes() const;
+
+    //nodes allocated from the resource, like Parser::ParseAll
+    std::pmr::vector<NodePtr> Nodes(std::pmr::memory_resource*) const;
+
+    //reports the cached statements like Parser::Visit
+    void Visit(ParseVisitor&) const;
+
+  private:
+    struct Header;
+    struct StringRecord;
+    struct TokenRecord;
+    struct NodeRecord;
+    struct CaseRecord;
+
+    SourceCache(MappedFile file, std::string_view image);
+
+    template<typename Record>
+    const Record* section(std::uint64_t offset, std::uint32_t count) const;
+
+    void validate() const;
+    Token makeToken(const TokenRecord&) const;
+
+    //keeps a mapped image alive (shared between copies)
+    MappedFile file;
+    std::string_view image;
+
+    const Header* pHeader = nullptr;
+    const StringRecord* pStrings = nullptr;
+    const TokenRecord* pTokens = nullptr;
+    const NodeRecord* pNodes = nullptr;
+    const TokenRecord* pArgs = nullptr;
+    const CaseRecord* pCases = nullptr;
+    const char* pText = nullptr;
+
+    std::vector<Symbol> symbols;
+};
+
+} //namespace: Jasmin
@@ -3,6 +3,8 @@
 #include<string>
 #include<sstream>
 #include<istream>
+#include<memory>
+#include<stdexcept>
 
 namespace Jasmin
 {
@@ -10,8 +12,10 @@ namespace Jasmin
 class InStream
 {
   public:
-    InStream(std::string in) : InStream(std::stringstream{in}) {}
-    InStream(const char* in) : InStream(std::stringstream{in}) {}
+    //NOTE: string input is copied into a stream owned (and shared between
+    //copies) by the InStream, istreams passed in must outlive it
+    InStream(std::string in) : InStream(std::make_shared<std::stringstream>(std::move(in))) {}
+    InStream(const char* in) : InStream(std::string{in}) {}
     InStream(std::istream&& in) : InStream(in) {}
     InStream(std::istream& in) : inputStream{in} 
     {
@@ -44,6 +48,12 @@ class InStream
     size_t         CurrentFileOffset() const { return fileOffset; }
 
   private:
+    InStream(std::shared_ptr<std::istream> owned) 
+    : ownedStream{std::move(owned)}, inputStream{*ownedStream} 
+    {
+    }
+
+    std::shared_ptr<std::istream> ownedStream;
     std::istream& inputStream;
 
     unsigned int   lineNumber{1};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Nodes.hpp"
+
+#include <vector>
+
+namespace Jasmin
+{
+
+struct SwitchLoweringOptions
+{
+  //a run of keys only becomes a tableswitch when at least this fraction of
+  //its range has cases
+  double MinTableDensity = 0.4;
+
+  //dense runs with fewer cases are left to a lookupswitch
+  size_t MinTableCases = 4;
+
+  //bytes of code one more dispatch step (a compare or a binary search
+  //probe) is worth
+  size_t StepCost = 8;
+};
+
+//lowers every "switch" pseudo instruction:
+//
+//  switch
+//    1 : One
+//    1000 : Thousand
+//    default : Other
+//
+//into the cheapest of a single tableswitch, a single lookupswitch, or dense
+//tableswitch clusters and lookupswitches over the remaining sparse keys,
+//picked between by a binary search of dup/push/if_icmpge compares. the cost
+//of each form is its size in bytes (with worst case alignment padding) plus
+//StepCost for every dispatch step on its longest path. methods needing the
+//compares get 2 more slots of .limit stack. throws on duplicate keys.
+std::vector<NodePtr> LowerSwitches(std::vector<NodePtr> nodes,
+                                   const SwitchLoweringOptions& = {});
+
+} //namespace: Jasmin
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace Jasmin
+{
+
+//handle to a string interned in a process wide pool, equal strings always get
+//the same 32 bit id so comparing/hashing symbols never touches the characters.
+//interning is thread safe and interned strings live until the process exits.
+class Symbol
+{
+  public:
+    using ID = std::uint32_t;
+
+    //an interned string, the pool never moves or frees one
+    struct Entry
+    {
+      std::string Str;
+      ID Id;
+    };
+
+    //id 0 is reserved for the empty string
+    Symbol() = default;
+    explicit Symbol(std::string_view str) : pEntry{intern(str)} {}
+
+    ID Id() const { return pEntry ? pEntry->Id : 0; }
+    bool Empty() const { return !pEntry; }
+
+    //NOTE: takes no lock, the entry was complete before the symbol existed
+    std::string_view View() const { return pEntry ? std::string_view{pEntry->Str} : std::string_view{}; }
+    std::string Str() const { return std::string{View()}; }
+    size_t Length() const { return View().length(); }
+
+    static ID Intern(std::string_view str) { return Symbol{str}.Id(); }
+    static size_t PoolSize();
+
+  private:
+    static const Entry* intern(std::string_view);
+
+    //nullptr for the empty string
+    const Entry* pEntry = nullptr;
+};
+
+inline bool operator==(Symbol a, Symbol b) { return a.Id() == b.Id(); }
+inline bool operator!=(Symbol a, Symbol b) { return a.Id() != b.Id(); }
+inline bool operator==(Symbol a, std::string_view b) { return a.View() == b; }
+inline bool operator!=(Symbol a, std::string_view b) { return a.View() != b; }
+inline bool operator==(std::string_view a, Symbol b) { return b == a; }
+inline bool operator!=(std::string_view a, Symbol b) { return b != a; }
+
+//NOTE: orders by id (interning order), not lexicographically
+inline bool operator<(Symbol a, Symbol b) { return a.Id() < b.Id(); }
+
+inline std::ostream& operator<<(std::ostream& out, Symbol sym)
+{
+  return out << sym.View();
+}
+
+} //namespace: Jasmin
+
+template<>
+struct std::hash<Jasmin::Symbol>
+{
+  size_t operator()(Jasmin::Symbol sym) const noexcept
+  {
+    return std::hash<Jasmin::Symbol::ID>{}(sym.Id());
+  }
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//zip format constants shared by the JAR writer and the classpath reader
+namespace Jasmin
+{
+namespace Zip
+{
+
+constexpr std::uint32_t LocalHeaderSignature    = 0x04034b50;
+constexpr std::uint32_t CentralHeaderSignature  = 0x02014b50;
+constexpr std::uint32_t EndOfDirectorySignature = 0x06054b50;
+
+//fixed part of each record, the variable length fields (name, extra,
+//comment) follow it
+constexpr size_t LocalHeaderSize    = 30;
+constexpr size_t CentralHeaderSize  = 46;
+constexpr size_t EndOfDirectorySize = 22;
+
+constexpr std::uint16_t MethodStored   = 0;
+constexpr std::uint16_t MethodDeflated = 8;
+
+constexpr std::uint16_t FlagEncrypted = 0x0001;
+constexpr std::uint16_t FlagUtf8Names = 0x0800;
+
+} //namespace: Zip
+} //namespace: Jasmin
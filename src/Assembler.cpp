@@ -1,16 +1,168 @@
 #include "Jasmin/Assembler.hpp"
+#include "Jasmin/ConstantPool.hpp"
+#include "Jasmin/MethodSplitter.hpp"
+#include "Jasmin/SourceCache.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <optional>
 
 namespace Jasmin
 {
 
-ClassFile::ClassFile Assembler::Assemble(Parser parser)
+namespace
 {
-  return {};
+
+//the passes work on std::vector node lists, the parsed nodes stay in the
+//resource (new nodes the passes create dont)
+std::vector<NodePtr> takeNodes(std::pmr::vector<NodePtr>&& nodes)
+{
+  return {std::make_move_iterator(nodes.begin()), std::make_move_iterator(nodes.end())};
+}
+
+bool isDirective(const NodePtr& pNode, std::string_view name, std::string_view firstArg = {})
+{
+  auto pDir = dynamic_cast<const DUnimplemented*>(pNode.get());
+  return pDir && pDir->DirectiveName == name &&
+         (firstArg.empty() || (!pDir->Args.empty() && pDir->Args.front().Value == firstArg));
+}
+
+//builds the debug info of every method (and the source file) to reject
+//malformed .line, .var and .source directives
+void checkDebugInfo(const std::vector<NodePtr>& nodes, DebugInfoPolicy policy,
+                    const ConstantPoolLayout& pool)
+{
+  SourceFile(nodes, policy);
+
+  for(auto it = nodes.begin(); it != nodes.end(); ++it)
+  {
+    if(!isDirective(*it, "method"))
+      continue;
+
+    auto end = std::find_if(it + 1, nodes.end(), [](const NodePtr& pNode)
+    {
+      return isDirective(pNode, "end", "method");
+    });
+    BuildDebugInfo(it + 1, end, policy, &pool);
+
+    if(end == nodes.end())
+      break;
+    it = end;
+  }
+}
+
+} //namespace: anonymous
+
+ClassFile::ClassFile Assembler::Assemble(Parser parser, const AssemblerOptions& options,
+                                         std::pmr::memory_resource* pResource)
+{
+  if(!pResource)
+    return assemble(parser.ParseAll(), options);
+
+  return assemble(takeNodes(parser.ParseAll(pResource)), options);
+}
+
+ClassFile::ClassFile Assembler::Assemble(InStream stream, const AssemblerOptions& options,
+                                         std::pmr::memory_resource* pResource)
+{
+  if(!pResource)
+    return Assemble( Parser{ Lexer{stream} }, options );
+
+  std::pmr::vector<Token> tokens = Lexer::LexAll(stream, pResource);
+  return Assemble(Parser{tokens}, options, pResource);
+}
+
+ClassFile::ClassFile Assembler::AssembleFile(const std::filesystem::path& path,
+                                             const AssemblerOptions& options,
+                                             std::pmr::memory_resource* pResource)
+{
+  std::ifstream in{path, std::ios::binary};
+  if(!in)
+    throw std::runtime_error{fmt::format("Assembler error: cant open '{}'", path.string())};
+
+  std::string source{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+
+  if(options.SourceCacheDir.empty())
+    return Assemble(InStream{std::move(source)}, options, pResource);
+
+  //NOTE: sources with the same name in different directories get their own
+  //entry, keyed by a hash of the full path
+  std::string fullPath = std::filesystem::absolute(path).lexically_normal().generic_string();
+  std::filesystem::path cachePath = options.SourceCacheDir /
+      fmt::format("{}.{:016x}.jcache", path.filename().string(), SourceCache::HashSource(fullPath));
+
+  auto cachedNodes = [pResource](const SourceCache& cache)
+  {
+    return pResource ? takeNodes(cache.Nodes(pResource)) : cache.Nodes();
+  };
+
+  //NOTE: a missing, stale or unreadable image is a cache miss, and so is one
+  //whose nodes cant be read back: it gets rebuilt and overwritten below.
+  //errors assembling the nodes arent cache problems and propagate
+  std::optional<std::vector<NodePtr>> nodes;
+  try
+  {
+    SourceCache cache = SourceCache::Open(cachePath);
+    if(cache.Matches(source))
+      nodes = cachedNodes(cache);
+  }
+  catch(const std::runtime_error&)
+  {
+  }
+
+  if(nodes)
+    return assemble(std::move(*nodes), options);
+
+  std::string image = SourceCache::Build(source);
+
+  try
+  {
+    std::filesystem::create_directories(options.SourceCacheDir);
+    SourceCache::Write(cachePath, image);
+  }
+  catch(const std::exception&)
+  {
+    //NOTE: failing to update the cache doesnt fail the assembly
+  }
+
+  return assemble(cachedNodes(SourceCache{image}), options);
 }
 
-ClassFile::ClassFile Assembler::Assemble(InStream stream)
+ClassFile::ClassFile Assembler::assemble(std::vector<NodePtr> nodes, const AssemblerOptions& options)
 {
-  return Assemble( Parser{ Lexer{stream} } );
+  if(options.DebugInfo == DebugInfoPolicy::Strip)
+    nodes = StripDebugInfo(std::move(nodes));
+
+  nodes = LowerSwitches(std::move(nodes), options.SwitchLowering);
+
+  if(options.Profile)
+    nodes = ReorderBlocks(std::move(nodes), *options.Profile, options.BlockLayout);
+
+  if(options.ClassPath)
+    CheckReferences(nodes, *options.ClassPath, options.ReferenceCheck);
+
+  if(options.SplitOversizedMethods)
+    nodes = SplitOversizedMethods(std::move(nodes));
+
+  //NOTE: the pool is laid out last, once no pass adds constants or
+  //references anymore, so ldc/ldc_w can be picked from the final indices
+  ConstantPoolLayout pool;
+  pool.Profile(nodes);
+  pool.Finalize();
+  nodes = LowerConstantLoads(std::move(nodes), pool);
+
+  //NOTE: there is no class writer to take the tables yet, building them
+  //still validates the debug info the policy keeps
+  if(options.DebugInfo != DebugInfoPolicy::Strip)
+    checkDebugInfo(nodes, options.DebugInfo, pool);
+
+  if(options.PoolLayout)
+    *options.PoolLayout = std::move(pool);
+
+  return {};
 }
 
 
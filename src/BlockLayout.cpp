@@ -0,0 +1,549 @@
+#include "Jasmin/BlockLayout.hpp"
+#include "Jasmin/ControlFlowGraph.hpp"
+#include "Jasmin/Instructions.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace Jasmin
+{
+
+namespace
+{
+
+using BlockId = ControlFlowGraph::BlockId;
+using Flow = InstructionInfo::Flow;
+
+constexpr BlockId NoBlock = ControlFlowGraph::NoBlock;
+
+DUnimplemented* asDirective(const NodePtr& pNode, std::string_view name)
+{
+  auto pDir = dynamic_cast<DUnimplemented*>(pNode.get());
+  return pDir && pDir->DirectiveName == name ? pDir : nullptr;
+}
+
+bool isEndMethod(const NodePtr& pNode)
+{
+  auto pEnd = asDirective(pNode, "end");
+  return pEnd && !pEnd->Args.empty() && pEnd->Args.front().Value == "method";
+}
+
+//the last symbol argument of a directive, e.g. the name of .method
+Symbol lastSymbolArg(const DUnimplemented& dir)
+{
+  for(auto it = dir.Args.rbegin(); it != dir.Args.rend(); ++it)
+    if(it->Type == TT::Symbol)
+      return it->Value;
+
+  return Symbol{};
+}
+
+//the argument following a keyword argument, e.g. the label after "from"
+Token* argAfter(DUnimplemented& dir, std::string_view keyword)
+{
+  for(size_t i = 0; i + 1 < dir.Args.size(); ++i)
+    if(dir.Args[i].Type == TT::Symbol && dir.Args[i].Value == keyword)
+      return &dir.Args[i + 1];
+
+  return nullptr;
+}
+
+Token labelArg(Symbol label)
+{
+  return Token{TT::Symbol, label, {}, {0, 0, 0}};
+}
+
+NodePtr makeLabel(Symbol name)
+{
+  auto pLNode = std::make_unique<LabelNode>();
+  pLNode->LabelName = name;
+  return pLNode;
+}
+
+NodePtr makeGoto(Symbol label)
+{
+  auto pINode = std::make_unique<InstructionNode>();
+  pINode->Mnemonic = Symbol{"goto"};
+  pINode->Args = {labelArg(label)};
+  return pINode;
+}
+
+NodePtr makeDirective(std::string_view name, std::pmr::vector<Token> args)
+{
+  auto pDir = std::make_unique<DUnimplemented>();
+  pDir->DirectiveName = Symbol{name};
+  pDir->Args = std::move(args);
+  return pDir;
+}
+
+//the conditional branch taken exactly when the given one isnt
+Symbol invertedBranch(Symbol mnemonic)
+{
+  static const auto inverses = []
+  {
+    std::unordered_map<Symbol, Symbol> m;
+    auto add = [&m](std::string_view a, std::string_view b)
+    {
+      m.emplace(Symbol{a}, Symbol{b});
+      m.emplace(Symbol{b}, Symbol{a});
+    };
+
+    add("ifeq", "ifne");
+    add("iflt", "ifge");
+    add("ifgt", "ifle");
+    add("ifnull", "ifnonnull");
+    add("if_icmpeq", "if_icmpne");
+    add("if_icmplt", "if_icmpge");
+    add("if_icmpgt", "if_icmple");
+    add("if_acmpeq", "if_acmpne");
+    return m;
+  }();
+
+  auto it = inverses.find(mnemonic);
+  if(it == inverses.end())
+    throw std::runtime_error{fmt::format(
+        "Assembler error: cant invert branch {}", mnemonic.View())};
+
+  return it->second;
+}
+
+class Layout
+{
+  public:
+    Layout(const std::vector<NodePtr>& nodes, const BlockProfile& profile,
+           const BlockLayoutOptions& options)
+    : profile{profile}, options{options}
+    {
+      for(const auto& pNode : nodes)
+        if(auto pLabel = dynamic_cast<const LabelNode*>(pNode.get()))
+          usedLabels.insert(pLabel->LabelName);
+    }
+
+    std::vector<NodePtr> Reorder(Symbol method, std::vector<NodePtr> body)
+    {
+      //NOTE: .var ranges would need the same splitting as .catch ranges, and
+      //subroutines are entered and left in ways the cfg doesnt model
+      for(const auto& pNode : body)
+      {
+        if(auto pVar = asDirective(pNode, "var"); pVar && argAfter(*pVar, "from"))
+          return body;
+
+        if(auto pINode = dynamic_cast<const InstructionNode*>(pNode.get()))
+        {
+          Flow flow = GetInstruction(*pINode).ControlFlow;
+          if(flow == Flow::Jsr || flow == Flow::Ret)
+            return body;
+        }
+      }
+
+      ControlFlowGraph cfg{body.begin(), body.end()};
+      size_t blockCount = cfg.BlockCount();
+
+      //the entry block never moves, so there is nothing to reorder
+      if(blockCount < 3)
+        return body;
+
+      if(!measure(method, body, cfg))
+        return body;
+
+      std::vector<BlockId> order = chooseOrder(cfg);
+
+      bool isUnchanged = true;
+      for(size_t i = 0; i < order.size(); ++i)
+        isUnchanged &= order[i] == i;
+
+      if(isUnchanged)
+        return body;
+
+      return emit(std::move(body), cfg, order);
+    }
+
+  private:
+    //what happens to the terminator of a block in the new order
+    enum class Fixup
+    {
+      None,
+      DropGoto,     //jumps to the block now following it
+      InvertBranch, //its target now follows it, branch to the old fallthrough
+      AppendGoto,   //its fallthrough block moved away
+    };
+
+    std::optional<std::uint64_t> lookup(Symbol method, Symbol label) const
+    {
+      auto it = profile.find(Symbol{fmt::format("{}:{}", method.View(), label.View())});
+      if(it == profile.end())
+        it = profile.find(label);
+
+      if(it == profile.end())
+        return std::nullopt;
+
+      return it->second;
+    }
+
+    //fills the block labels and counts, false if no label is profiled
+    bool measure(Symbol method, const std::vector<NodePtr>& body, const ControlFlowGraph& cfg)
+    {
+      size_t blockCount = cfg.BlockCount();
+      blockLabels.assign(blockCount, Symbol{});
+      newLabels.assign(blockCount, false);
+      labelPositions.clear();
+
+      std::vector<std::optional<std::uint64_t>> counts(blockCount);
+      std::vector<bool> hasCode(blockCount, false);
+      bool isProfiled = false;
+
+      for(size_t pos = 0; pos < body.size(); ++pos)
+      {
+        BlockId block = cfg.BlockAt(pos);
+
+        if(dynamic_cast<const InstructionNode*>(body[pos].get()))
+        {
+          hasCode[block] = true;
+          continue;
+        }
+
+        auto pLabel = dynamic_cast<const LabelNode*>(body[pos].get());
+        if(!pLabel)
+          continue;
+
+        labelPositions[pLabel->LabelName] = pos;
+
+        //only labels in front of the first instruction lead into the block
+        if(hasCode[block])
+          continue;
+
+        if(blockLabels[block].Empty())
+          blockLabels[block] = pLabel->LabelName;
+
+        if(auto count = lookup(method, pLabel->LabelName))
+        {
+          counts[block] = std::max(counts[block].value_or(0), *count);
+          isProfiled = true;
+        }
+      }
+
+      if(!isProfiled)
+        return false;
+
+      std::uint64_t hottest = 0;
+      for(const auto& count : counts)
+        hottest = std::max(hottest, count.value_or(0));
+
+      frequencies.assign(blockCount, 0);
+      frequencies[0] = counts[0].value_or(hottest);
+
+      for(BlockId b = 1; b < blockCount; ++b)
+      {
+        auto& last = static_cast<const InstructionNode&>(*body[cfg.Terminator(b - 1)]);
+
+        if(counts[b])
+          frequencies[b] = *counts[b];
+        else if(!FallsThrough(last))
+          frequencies[b] = 0;
+        else
+          frequencies[b] = frequencies[b - 1];
+
+        //whatever a forward branch doesnt take falls through (the count of a
+        //loop header also has the entries into the loop, so back edges are
+        //left out)
+        if(!counts[b] && GetInstruction(last).ControlFlow == Flow::Branch)
+        {
+          BlockId target = cfg.BlockOf(BranchTargets(last).front());
+          if(target >= b && counts[target])
+            frequencies[b] -= std::min(frequencies[b], *counts[target]);
+        }
+      }
+
+      return true;
+    }
+
+    //greedy chains: follow the hottest unplaced successor, when there is none
+    //continue with the hottest unplaced block, cold blocks go last
+    std::vector<BlockId> chooseOrder(const ControlFlowGraph& cfg) const
+    {
+      size_t blockCount = cfg.BlockCount();
+
+      auto isCold = [&](BlockId b) { return b != 0 && frequencies[b] <= options.ColdCount; };
+
+      std::vector<BlockId> seeds;
+      for(BlockId b = 1; b < blockCount; ++b)
+        if(!isCold(b))
+          seeds.push_back(b);
+
+      std::stable_sort(seeds.begin(), seeds.end(),
+          [&](BlockId a, BlockId b) { return frequencies[a] > frequencies[b]; });
+
+      std::vector<BlockId> order;
+      order.reserve(blockCount);
+      std::vector<bool> placed(blockCount, false);
+      size_t nextSeed = 0;
+
+      BlockId current = 0;
+      while(current != NoBlock)
+      {
+        placed[current] = true;
+        order.push_back(current);
+
+        //ties go to the fallthrough block, then to the earlier block
+        BlockId next = NoBlock;
+        for(BlockId succ : cfg.Successors(current))
+        {
+          if(placed[succ] || isCold(succ))
+            continue;
+
+          if(next == NoBlock || frequencies[succ] > frequencies[next] ||
+             (frequencies[succ] == frequencies[next] &&
+              (succ == current + 1 || (next != current + 1 && succ < next))))
+            next = succ;
+        }
+
+        while(next == NoBlock && nextSeed < seeds.size())
+          if(!placed[seeds[nextSeed++]])
+            next = seeds[nextSeed - 1];
+
+        current = next;
+      }
+
+      for(BlockId b = 0; b < blockCount; ++b)
+        if(!placed[b])
+          order.push_back(b);
+
+      return order;
+    }
+
+    static size_t firstInstruction(const std::vector<NodePtr>& body, const ControlFlowGraph& cfg,
+                                   BlockId block)
+    {
+      size_t pos = cfg.BlockBegin(block);
+      while(!dynamic_cast<const InstructionNode*>(body[pos].get()))
+        ++pos;
+
+      return pos;
+    }
+
+    Symbol labelOf(BlockId block)
+    {
+      if(blockLabels[block].Empty())
+      {
+        blockLabels[block] = freshLabel();
+        newLabels[block] = true;
+      }
+
+      return blockLabels[block];
+    }
+
+    Symbol freshLabel()
+    {
+      Symbol label;
+      do
+        label = Symbol{fmt::format("layout${}", nextLabel++)};
+      while(usedLabels.count(label));
+
+      usedLabels.insert(label);
+      return label;
+    }
+
+    std::vector<NodePtr> emit(std::vector<NodePtr> body, const ControlFlowGraph& cfg,
+                              const std::vector<BlockId>& order)
+    {
+      size_t blockCount = cfg.BlockCount();
+
+      std::vector<Fixup> fixups(blockCount, Fixup::None);
+      for(size_t i = 0; i < order.size(); ++i)
+      {
+        BlockId block = order[i];
+        BlockId next = i + 1 < order.size() ? order[i + 1] : NoBlock;
+        auto& last = static_cast<const InstructionNode&>(*body[cfg.Terminator(block)]);
+        Flow flow = GetInstruction(last).ControlFlow;
+
+        if(flow == Flow::Goto && cfg.BlockOf(BranchTargets(last).front()) == next)
+        {
+          fixups[block] = Fixup::DropGoto;
+        }
+        else if(FallsThrough(last) && block + 1 < blockCount && block + 1 != next)
+        {
+          bool canInvert = flow == Flow::Branch && cfg.BlockOf(BranchTargets(last).front()) == next;
+          fixups[block] = canInvert ? Fixup::InvertBranch : Fixup::AppendGoto;
+          labelOf(block + 1);
+        }
+      }
+
+      //each .catch becomes one range per run of its blocks in the new order
+      std::vector<NodePtr> catches;
+      Symbol endLabel;
+
+      for(auto& pNode : body)
+      {
+        auto pCatch = asDirective(pNode, "catch");
+        if(!pCatch)
+          continue;
+
+        Token* pFrom = argAfter(*pCatch, "from");
+        Token* pTo = argAfter(*pCatch, "to");
+
+        BlockId from = cfg.BlockOf(pFrom->Value);
+        BlockId to = labelPositions.at(pTo->Value) > cfg.Terminator(blockCount - 1) ?
+                     static_cast<BlockId>(blockCount) : cfg.BlockOf(pTo->Value);
+
+        if(from >= to)
+        {
+          catches.push_back(std::move(pNode));
+          continue;
+        }
+
+        auto isCovered = [&](size_t i) { return order[i] >= from && order[i] < to; };
+
+        for(size_t i = 0; i < order.size(); ++i)
+        {
+          if(!isCovered(i) || (i > 0 && isCovered(i - 1)))
+            continue;
+
+          size_t j = i;
+          while(j < order.size() && isCovered(j))
+            ++j;
+
+          if(j == order.size() && endLabel.Empty())
+            endLabel = freshLabel();
+
+          auto pRange = std::make_unique<DUnimplemented>(*pCatch);
+          argAfter(*pRange, "from")->Value = labelOf(order[i]);
+          argAfter(*pRange, "to")->Value = j < order.size() ? labelOf(order[j]) : endLabel;
+          catches.push_back(std::move(pRange));
+        }
+
+        pNode.reset();
+      }
+
+      //.line applies to the code following it, so a moved block restates the
+      //line its first instruction had
+      std::vector<const Token*> blockLines(blockCount, nullptr);
+      std::vector<bool> hasCode(blockCount, false);
+      const Token* pLine = nullptr;
+
+      for(size_t pos = 0; pos < body.size(); ++pos)
+      {
+        if(auto pDir = asDirective(body[pos], "line"); pDir && pDir->Args.size() == 1)
+        {
+          pLine = &pDir->Args.front();
+        }
+        else if(dynamic_cast<const InstructionNode*>(body[pos].get()) && !hasCode[cfg.BlockAt(pos)])
+        {
+          hasCode[cfg.BlockAt(pos)] = true;
+          blockLines[cfg.BlockAt(pos)] = pLine;
+        }
+      }
+
+      std::vector<NodePtr> out;
+      out.reserve(body.size() + 3 * blockCount + catches.size());
+      std::optional<std::int64_t> currentLine;
+
+      for(BlockId block : order)
+      {
+        if(newLabels[block])
+          out.push_back(makeLabel(blockLabels[block]));
+
+        size_t first = firstInstruction(body, cfg, block);
+
+        for(size_t pos = cfg.BlockBegin(block); pos < cfg.BlockEnd(block); ++pos)
+        {
+          if(!body[pos])
+            continue;
+
+          if(auto pDir = asDirective(body[pos], "line"); pDir && pDir->Args.size() == 1)
+            currentLine = pDir->Args.front().IntValue();
+
+          if(pos == first && blockLines[block] && currentLine != blockLines[block]->IntValue())
+          {
+            out.push_back(makeDirective("line", {*blockLines[block]}));
+            currentLine = blockLines[block]->IntValue();
+          }
+
+          if(pos != cfg.Terminator(block))
+          {
+            out.push_back(std::move(body[pos]));
+            continue;
+          }
+
+          auto& last = static_cast<InstructionNode&>(*body[pos]);
+
+          switch(fixups[block])
+          {
+            case Fixup::None:
+              out.push_back(std::move(body[pos]));
+              break;
+
+            case Fixup::DropGoto:
+              break;
+
+            case Fixup::InvertBranch:
+              last.Mnemonic = invertedBranch(last.Mnemonic);
+              last.Args.front().Value = blockLabels[block + 1];
+              out.push_back(std::move(body[pos]));
+              break;
+
+            case Fixup::AppendGoto:
+              out.push_back(std::move(body[pos]));
+              out.push_back(makeGoto(blockLabels[block + 1]));
+              break;
+          }
+        }
+      }
+
+      if(!endLabel.Empty())
+        out.push_back(makeLabel(endLabel));
+
+      for(auto& pCatch : catches)
+        out.push_back(std::move(pCatch));
+
+      return out;
+    }
+
+    const BlockProfile& profile;
+    const BlockLayoutOptions& options;
+    std::unordered_set<Symbol> usedLabels;
+    size_t nextLabel = 0;
+
+    //per method
+    std::vector<Symbol> blockLabels;
+    std::vector<bool> newLabels;
+    std::vector<std::uint64_t> frequencies;
+    std::unordered_map<Symbol, size_t> labelPositions;
+};
+
+} //namespace: anonymous
+
+std::vector<NodePtr> ReorderBlocks(std::vector<NodePtr> nodes, const BlockProfile& profile,
+                                   const BlockLayoutOptions& options)
+{
+  if(profile.empty())
+    return nodes;
+
+  Layout layout{nodes, profile, options};
+
+  std::vector<NodePtr> out;
+  out.reserve(nodes.size());
+
+  for(size_t i = 0; i < nodes.size(); ++i)
+  {
+    auto pMethod = asDirective(nodes[i], "method");
+    out.push_back(std::move(nodes[i]));
+
+    if(!pMethod)
+      continue;
+
+    std::vector<NodePtr> body;
+    while(i + 1 < nodes.size() && !isEndMethod(nodes[i + 1]))
+      body.push_back(std::move(nodes[++i]));
+
+    for(auto& pNode : layout.Reorder(lastSymbolArg(*pMethod), std::move(body)))
+      out.push_back(std::move(pNode));
+  }
+
+  return out;
+}
+
+} //namespace: Jasmin
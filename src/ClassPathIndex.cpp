@@ -0,0 +1,797 @@
+#include "Jasmin/ClassPathIndex.hpp"
+#include "Jasmin/Zip.hpp"
+
+#include <fmt/core.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Jasmin
+{
+
+struct ClassPathIndex::Header
+{
+  char Magic[4];
+  std::uint32_t ByteOrderMark;
+  std::uint32_t Version;
+  std::uint32_t ClassCount;
+  std::uint32_t MemberCount;
+  std::uint32_t InterfaceCount;
+  std::uint64_t ClassesOffset;
+  std::uint64_t MembersOffset;
+  std::uint64_t InterfacesOffset;
+  std::uint64_t TextOffset;
+  std::uint64_t TextSize;
+};
+
+struct ClassPathIndex::StringRef
+{
+  std::uint32_t Offset;
+  std::uint32_t Length;
+};
+
+//NOTE: an empty Super means the class has none (java/lang/Object)
+struct ClassPathIndex::ClassRecord
+{
+  StringRef Name;
+  StringRef Super;
+  std::uint32_t FirstInterface;
+  std::uint32_t InterfaceCount;
+  std::uint32_t FirstMember;
+  std::uint32_t MemberCount;
+  std::uint16_t Access;
+  std::uint16_t Reserved;
+};
+
+struct ClassPathIndex::MemberRecord
+{
+  StringRef Name;
+  StringRef Descriptor;
+  std::uint16_t Access;
+  std::uint8_t Kind;
+  std::uint8_t Reserved;
+};
+
+namespace
+{
+
+namespace fs = std::filesystem;
+using MemberKind = ClassPathIndex::MemberKind;
+
+constexpr char Magic[4] = {'J', 'C', 'P', 'I'};
+constexpr std::uint32_t ByteOrderMark = 0x01020304;
+
+constexpr std::uint16_t AccVarargs = 0x0080;
+constexpr std::uint16_t AccNative  = 0x0100;
+
+std::runtime_error classPathError(std::string_view message)
+{
+  return std::runtime_error{fmt::format("Classpath error: {}", message)};
+}
+
+std::uint64_t align8(std::uint64_t offset)
+{
+  return (offset + 7) & ~std::uint64_t{7};
+}
+
+struct MemberInfo
+{
+  MemberKind Kind;
+  std::string Name;
+  std::string Descriptor;
+  std::uint16_t Access;
+};
+
+struct ClassInfo
+{
+  std::string Super;
+  std::vector<std::string> Interfaces;
+  std::vector<MemberInfo> Members;
+  std::uint16_t Access;
+};
+
+//bounds checked big endian reader over a class file
+class ClassReader
+{
+  public:
+    ClassReader(std::string_view data, std::string_view source) : data{data}, source{source} {}
+
+    std::uint8_t U1() { return static_cast<std::uint8_t>(Bytes(1)[0]); }
+
+    std::uint16_t U2()
+    {
+      std::string_view b = Bytes(2);
+      return static_cast<std::uint16_t>(byte(b, 0) << 8 | byte(b, 1));
+    }
+
+    std::uint32_t U4()
+    {
+      std::string_view b = Bytes(4);
+      return std::uint32_t{byte(b, 0)} << 24 | std::uint32_t{byte(b, 1)} << 16 |
+             std::uint32_t{byte(b, 2)} << 8  | std::uint32_t{byte(b, 3)};
+    }
+
+    std::string_view Bytes(size_t n)
+    {
+      if(n > data.size() - pos)
+        throw Error("truncated");
+
+      std::string_view bytes = data.substr(pos, n);
+      pos += n;
+      return bytes;
+    }
+
+    std::runtime_error Error(std::string_view message) const
+    {
+      return classPathError(fmt::format("malformed class file {} ({})", source, message));
+    }
+
+  private:
+    static std::uint8_t byte(std::string_view b, size_t i) { return static_cast<std::uint8_t>(b[i]); }
+
+    std::string_view data;
+    std::string_view source;
+    size_t pos = 0;
+};
+
+//reads the names, supertypes and members of a class file, skipping
+//everything else
+std::pair<std::string, ClassInfo> readClass(std::string_view bytes, std::string_view source)
+{
+  ClassReader in{bytes, source};
+
+  if(in.U4() != 0xCAFEBABE)
+    throw in.Error("bad magic");
+
+  in.Bytes(4); //minor, major version
+
+  std::uint16_t poolCount = in.U2();
+  std::vector<std::string_view> utf8s(poolCount);
+  std::vector<std::uint16_t> classNames(poolCount, 0);
+
+  for(std::uint16_t i = 1; i < poolCount; ++i)
+  {
+    switch(std::uint8_t tag = in.U1())
+    {
+      case 1:  utf8s[i] = in.Bytes(in.U2()); break;          //Utf8
+      case 7:  classNames[i] = in.U2(); break;                //Class
+      case 8: case 16: case 19: case 20: in.Bytes(2); break;  //String, MethodType, Module, Package
+      case 15: in.Bytes(3); break;                            //MethodHandle
+      case 3: case 4: case 9: case 10: case 11: case 12: case 17: case 18:
+        in.Bytes(4);
+        break;
+
+      //Long and Double take up two pool slots
+      case 5: case 6:
+        in.Bytes(8);
+        ++i;
+        break;
+
+      default:
+        throw in.Error(fmt::format("unknown constant pool tag {}", tag));
+    }
+  }
+
+  auto utf8 = [&](std::uint16_t index)
+  {
+    if(index == 0 || index >= poolCount || utf8s[index].data() == nullptr)
+      throw in.Error("bad utf8 index");
+    return std::string{utf8s[index]};
+  };
+
+  auto className = [&](std::uint16_t index)
+  {
+    if(index == 0 || index >= poolCount || classNames[index] == 0)
+      throw in.Error("bad class index");
+    return utf8(classNames[index]);
+  };
+
+  ClassInfo info;
+  info.Access = in.U2();
+  std::string name = className(in.U2());
+
+  std::uint16_t superIndex = in.U2();
+  if(superIndex != 0)
+    info.Super = className(superIndex);
+
+  for(std::uint16_t n = in.U2(); n > 0; --n)
+    info.Interfaces.push_back(className(in.U2()));
+
+  for(MemberKind kind : {MemberKind::Field, MemberKind::Method})
+  {
+    for(std::uint16_t n = in.U2(); n > 0; --n)
+    {
+      MemberInfo member;
+      member.Kind = kind;
+      member.Access = in.U2();
+      member.Name = utf8(in.U2());
+      member.Descriptor = utf8(in.U2());
+
+      for(std::uint16_t attributes = in.U2(); attributes > 0; --attributes)
+      {
+        in.Bytes(2);
+        in.Bytes(in.U4());
+      }
+
+      info.Members.push_back(std::move(member));
+    }
+  }
+
+  return {std::move(name), std::move(info)};
+}
+
+std::uint16_t le16(std::string_view data, size_t pos)
+{
+  return static_cast<std::uint16_t>(static_cast<std::uint8_t>(data[pos]) |
+                                    static_cast<std::uint8_t>(data[pos + 1]) << 8);
+}
+
+std::uint32_t le32(std::string_view data, size_t pos)
+{
+  return std::uint32_t{le16(data, pos)} | std::uint32_t{le16(data, pos + 2)} << 16;
+}
+
+std::string inflateEntry(std::string_view compressed, size_t size, std::string_view source)
+{
+  //NOTE: size comes from the JAR and isnt trusted, so the buffer grows with
+  //the output instead of being allocated up front (one byte past size at
+  //most, to notice entries inflating to more than they claim)
+  std::string out(std::min(size + 1, compressed.size() * 4 + 1024), '\0');
+
+  z_stream stream{};
+  if(inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+    throw classPathError("cant initialize zlib");
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = static_cast<uInt>(compressed.size());
+
+  int result = Z_OK;
+  while(result == Z_OK)
+  {
+    if(stream.total_out == out.size())
+    {
+      if(out.size() > size)
+        break;
+      out.resize(std::min(size + 1, out.size() * 2));
+    }
+
+    stream.next_out = reinterpret_cast<Bytef*>(out.data() + stream.total_out);
+    stream.avail_out = static_cast<uInt>(std::min<size_t>(out.size() - stream.total_out,
+                                                          std::numeric_limits<uInt>::max()));
+    result = inflate(&stream, Z_NO_FLUSH);
+  }
+
+  bool complete = result == Z_STREAM_END && stream.total_out == size;
+  inflateEnd(&stream);
+
+  if(!complete)
+    throw classPathError(fmt::format("cant inflate {}", source));
+
+  out.resize(size);
+  return out;
+}
+
+//calls onClass with the contents of every .class entry of the JAR (except
+//the ones under META-INF, like multi release versions)
+void readJar(const fs::path& path,
+             const std::function<void(std::string_view, std::string_view)>& onClass)
+{
+  MappedFile jar = MappedFile::Open(path);
+  std::string_view data = jar.Data();
+  std::string source = path.string();
+
+  auto error = [&source](std::string_view message)
+  {
+    return classPathError(fmt::format("malformed JAR {} ({})", source, message));
+  };
+
+  //the end of central directory record is at most 22 + 65535 (comment)
+  //bytes from the end
+  if(data.size() < Zip::EndOfDirectorySize)
+    throw error("too small");
+
+  size_t endPos = data.size() - Zip::EndOfDirectorySize;
+  size_t lowest = endPos > 0xFFFF ? endPos - 0xFFFF : 0;
+  while(le32(data, endPos) != Zip::EndOfDirectorySignature)
+  {
+    if(endPos == lowest)
+      throw error("no end of central directory");
+    --endPos;
+  }
+
+  std::uint16_t entries = le16(data, endPos + 10);
+  std::uint32_t dirOffset = le32(data, endPos + 16);
+
+  if(entries == 0xFFFF || dirOffset == 0xFFFFFFFF)
+    throw error("zip64 archives arent supported");
+
+  size_t pos = dirOffset;
+  for(std::uint16_t i = 0; i < entries; ++i)
+  {
+    if(pos > data.size() || data.size() - pos < Zip::CentralHeaderSize ||
+       le32(data, pos) != Zip::CentralHeaderSignature)
+      throw error("bad central directory entry");
+
+    std::uint16_t flags = le16(data, pos + 8);
+    std::uint16_t method = le16(data, pos + 10);
+    std::uint32_t compressedSize = le32(data, pos + 20);
+    std::uint32_t size = le32(data, pos + 24);
+    std::uint16_t nameLength = le16(data, pos + 28);
+    std::uint16_t extraLength = le16(data, pos + 30);
+    std::uint16_t commentLength = le16(data, pos + 32);
+    std::uint32_t localOffset = le32(data, pos + 42);
+
+    if(data.size() - pos - Zip::CentralHeaderSize < nameLength)
+      throw error("bad central directory entry");
+
+    std::string_view name = data.substr(pos + Zip::CentralHeaderSize, nameLength);
+    pos += Zip::CentralHeaderSize + size_t{nameLength} + extraLength + commentLength;
+
+    bool isClass = name.size() > 6 && name.substr(name.size() - 6) == ".class";
+    if(!isClass || name.substr(0, 9) == "META-INF/")
+      continue;
+
+    if(flags & Zip::FlagEncrypted)
+      throw error(fmt::format("{} is encrypted", name));
+
+    if(localOffset > data.size() || data.size() - localOffset < Zip::LocalHeaderSize ||
+       le32(data, localOffset) != Zip::LocalHeaderSignature)
+      throw error(fmt::format("bad local header for {}", name));
+
+    size_t dataPos = localOffset + Zip::LocalHeaderSize + size_t{le16(data, localOffset + 26)} +
+                     le16(data, localOffset + 28);
+    if(dataPos > data.size() || data.size() - dataPos < compressedSize)
+      throw error(fmt::format("{} is truncated", name));
+
+    std::string_view stored = data.substr(dataPos, compressedSize);
+    std::string entrySource = fmt::format("{}!{}", source, name);
+
+    if(method == Zip::MethodStored)
+      onClass(stored, entrySource);
+    else if(method == Zip::MethodDeflated)
+      onClass(inflateEntry(stored, size, entrySource), entrySource);
+    else
+      throw error(fmt::format("{} uses unsupported compression method {}", name, method));
+  }
+}
+
+//images refer to strings by {offset, length} into one deduplicated text
+class ImageBuilder
+{
+  public:
+    template<typename StringRef>
+    StringRef String(const std::string& str)
+    {
+      auto [it, inserted] = offsets.emplace(str, static_cast<std::uint32_t>(Text.size()));
+      if(inserted)
+        Text += str;
+
+      return StringRef{it->second, static_cast<std::uint32_t>(str.size())};
+    }
+
+    std::string Text;
+
+  private:
+    std::unordered_map<std::string, std::uint32_t> offsets;
+};
+
+template<typename T>
+void put(std::string& image, std::uint64_t offset, const T* pData, size_t count)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+  if(count)
+    std::memcpy(image.data() + offset, pData, count * sizeof(T));
+}
+
+//java/lang/Object is rarely on the classpath given to the assembler (it
+//lives in the jdk's modules), its methods are known though and it has no
+//fields
+bool isObjectMethod(std::string_view name, std::string_view descriptor)
+{
+  static const std::unordered_set<std::string_view> methods = {
+    "<init>()V", "getClass()Ljava/lang/Class;", "hashCode()I", "equals(Ljava/lang/Object;)Z",
+    "clone()Ljava/lang/Object;", "toString()Ljava/lang/String;", "notify()V", "notifyAll()V",
+    "wait()V", "wait(J)V", "wait(JI)V", "finalize()V",
+  };
+
+  std::string signature{name};
+  signature += descriptor;
+  return methods.count(signature) > 0;
+}
+
+} //namespace: anonymous
+
+std::string ClassPathIndex::Build(const std::vector<fs::path>& classpath)
+{
+  std::map<std::string, ClassInfo> classes;
+
+  auto addClass = [&classes](std::string_view bytes, std::string_view source)
+  {
+    auto [name, info] = readClass(bytes, source);
+    classes.emplace(std::move(name), std::move(info));
+  };
+
+  for(const fs::path& entry : classpath)
+  {
+    if(fs::is_directory(entry))
+    {
+      //NOTE: sorted so duplicate classes in one directory resolve the same
+      //way every time
+      std::vector<fs::path> files;
+      for(const auto& file : fs::recursive_directory_iterator{entry})
+        if(file.is_regular_file() && file.path().extension() == ".class")
+          files.push_back(file.path());
+
+      std::sort(files.begin(), files.end());
+
+      for(const fs::path& file : files)
+        addClass(MappedFile::Open(file).Data(), file.string());
+    }
+    else if(fs::is_regular_file(entry))
+    {
+      readJar(entry, addClass);
+    }
+    else
+    {
+      throw classPathError(fmt::format("{} is not a directory or JAR", entry.string()));
+    }
+  }
+
+  ImageBuilder builder;
+  std::vector<ClassRecord> classRecords;
+  std::vector<MemberRecord> memberRecords;
+  std::vector<StringRef> interfaces;
+  classRecords.reserve(classes.size());
+
+  for(auto& [name, info] : classes)
+  {
+    std::sort(info.Members.begin(), info.Members.end(),
+        [](const MemberInfo& a, const MemberInfo& b)
+        {
+          return std::tie(a.Kind, a.Name, a.Descriptor) < std::tie(b.Kind, b.Name, b.Descriptor);
+        });
+
+    ClassRecord record{};
+    record.Name           = builder.String<StringRef>(name);
+    record.Super          = builder.String<StringRef>(info.Super);
+    record.FirstInterface = static_cast<std::uint32_t>(interfaces.size());
+    record.InterfaceCount = static_cast<std::uint32_t>(info.Interfaces.size());
+    record.FirstMember    = static_cast<std::uint32_t>(memberRecords.size());
+    record.MemberCount    = static_cast<std::uint32_t>(info.Members.size());
+    record.Access         = info.Access;
+
+    for(const auto& interface : info.Interfaces)
+      interfaces.push_back(builder.String<StringRef>(interface));
+
+    for(const auto& member : info.Members)
+    {
+      MemberRecord memberRecord{};
+      memberRecord.Name       = builder.String<StringRef>(member.Name);
+      memberRecord.Descriptor = builder.String<StringRef>(member.Descriptor);
+      memberRecord.Access     = member.Access;
+      memberRecord.Kind       = static_cast<std::uint8_t>(member.Kind);
+      memberRecords.push_back(memberRecord);
+    }
+
+    classRecords.push_back(record);
+  }
+
+  Header header{};
+  std::memcpy(header.Magic, Magic, sizeof(Magic));
+  header.ByteOrderMark    = ByteOrderMark;
+  header.Version          = Version;
+  header.ClassCount       = static_cast<std::uint32_t>(classRecords.size());
+  header.MemberCount      = static_cast<std::uint32_t>(memberRecords.size());
+  header.InterfaceCount   = static_cast<std::uint32_t>(interfaces.size());
+  header.ClassesOffset    = align8(sizeof(Header));
+  header.MembersOffset    = align8(header.ClassesOffset + header.ClassCount * sizeof(ClassRecord));
+  header.InterfacesOffset = align8(header.MembersOffset + header.MemberCount * sizeof(MemberRecord));
+  header.TextOffset       = align8(header.InterfacesOffset + header.InterfaceCount * sizeof(StringRef));
+  header.TextSize         = builder.Text.size();
+
+  std::string image(align8(header.TextOffset + header.TextSize), '\0');
+  put(image, 0, &header, 1);
+  put(image, header.ClassesOffset,    classRecords.data(),  classRecords.size());
+  put(image, header.MembersOffset,    memberRecords.data(), memberRecords.size());
+  put(image, header.InterfacesOffset, interfaces.data(),    interfaces.size());
+  put(image, header.TextOffset,       builder.Text.data(),  builder.Text.size());
+
+  return image;
+}
+
+void ClassPathIndex::Write(const fs::path& path, std::string_view image)
+{
+  WriteFileAtomically(path, image);
+}
+
+ClassPathIndex ClassPathIndex::Open(const fs::path& path)
+{
+  MappedFile file;
+  try
+  {
+    file = MappedFile::Open(path);
+  }
+  catch(const std::runtime_error& e)
+  {
+    throw classPathError(e.what());
+  }
+
+  std::string_view image = file.Data();
+  return ClassPathIndex{std::move(file), image};
+}
+
+ClassPathIndex::ClassPathIndex(std::string_view image) : ClassPathIndex{MappedFile{}, image}
+{
+}
+
+ClassPathIndex::ClassPathIndex(MappedFile file, std::string_view image)
+: file{std::move(file)}, image{image}
+{
+  static_assert(sizeof(Header)       == 64);
+  static_assert(sizeof(StringRef)    == 8);
+  static_assert(sizeof(ClassRecord)  == 36);
+  static_assert(sizeof(MemberRecord) == 20);
+
+  if(image.size() < sizeof(Header) ||
+     reinterpret_cast<std::uintptr_t>(image.data()) % alignof(std::uint64_t) != 0)
+    throw classPathError("index is truncated or misaligned");
+
+  pHeader = reinterpret_cast<const Header*>(image.data());
+
+  if(std::memcmp(pHeader->Magic, Magic, sizeof(Magic)) != 0)
+    throw classPathError("not a classpath index");
+  if(pHeader->ByteOrderMark != ByteOrderMark)
+    throw classPathError("index was written with a different byte order");
+  if(pHeader->Version != Version)
+    throw classPathError(fmt::format("index version {} (expected {})", pHeader->Version, Version));
+
+  pClasses    = section<ClassRecord>(pHeader->ClassesOffset, pHeader->ClassCount);
+  pMembers    = section<MemberRecord>(pHeader->MembersOffset, pHeader->MemberCount);
+  pInterfaces = section<StringRef>(pHeader->InterfacesOffset, pHeader->InterfaceCount);
+
+  if(pHeader->TextOffset > image.size() || pHeader->TextSize > image.size() - pHeader->TextOffset)
+    throw classPathError("text section out of bounds");
+  pText = image.data() + pHeader->TextOffset;
+
+  validate();
+}
+
+template<typename Record>
+const Record* ClassPathIndex::section(std::uint64_t offset, std::uint32_t count) const
+{
+  if(offset % alignof(Record) != 0 || offset > image.size() ||
+     (image.size() - offset) / sizeof(Record) < count)
+    throw classPathError("section out of bounds");
+
+  return reinterpret_cast<const Record*>(image.data() + offset);
+}
+
+//NOTE: every reference is checked once here so lookups can trust them
+void ClassPathIndex::validate() const
+{
+  auto checkString = [this](const StringRef& ref)
+  {
+    if(ref.Offset > pHeader->TextSize || ref.Length > pHeader->TextSize - ref.Offset)
+      throw classPathError("string out of bounds");
+  };
+
+  for(std::uint32_t i = 0; i < pHeader->ClassCount; ++i)
+  {
+    const ClassRecord& record = pClasses[i];
+    checkString(record.Name);
+    checkString(record.Super);
+
+    if(record.FirstInterface > pHeader->InterfaceCount ||
+       record.InterfaceCount > pHeader->InterfaceCount - record.FirstInterface ||
+       record.FirstMember > pHeader->MemberCount ||
+       record.MemberCount > pHeader->MemberCount - record.FirstMember)
+      throw classPathError("invalid class record");
+
+    if(i > 0 && !(str(pClasses[i-1].Name) < str(record.Name)))
+      throw classPathError("classes arent sorted");
+  }
+
+  for(std::uint32_t i = 0; i < pHeader->MemberCount; ++i)
+  {
+    checkString(pMembers[i].Name);
+    checkString(pMembers[i].Descriptor);
+  }
+
+  for(std::uint32_t i = 0; i < pHeader->InterfaceCount; ++i)
+    checkString(pInterfaces[i]);
+}
+
+std::string_view ClassPathIndex::str(const StringRef& ref) const
+{
+  return std::string_view{pText + ref.Offset, ref.Length};
+}
+
+size_t ClassPathIndex::ClassCount() const
+{
+  return pHeader->ClassCount;
+}
+
+const ClassPathIndex::ClassRecord* ClassPathIndex::findClass(std::string_view className) const
+{
+  const ClassRecord* pEnd = pClasses + pHeader->ClassCount;
+  const ClassRecord* pClass = std::lower_bound(pClasses, pEnd, className,
+      [this](const ClassRecord& record, std::string_view name) { return str(record.Name) < name; });
+
+  return pClass != pEnd && str(pClass->Name) == className ? pClass : nullptr;
+}
+
+bool ClassPathIndex::HasClass(std::string_view className) const
+{
+  return findClass(className) != nullptr;
+}
+
+bool ClassPathIndex::declares(const ClassRecord& record, MemberKind kind,
+                              std::string_view name, std::string_view descriptor) const
+{
+  auto key = [this](const MemberRecord& member)
+  {
+    return std::make_tuple(member.Kind, str(member.Name), str(member.Descriptor));
+  };
+
+  auto wanted = std::make_tuple(static_cast<std::uint8_t>(kind), name, descriptor);
+
+  const MemberRecord* pBegin = pMembers + record.FirstMember;
+  const MemberRecord* pEnd = pBegin + record.MemberCount;
+  const MemberRecord* pMember = std::lower_bound(pBegin, pEnd, wanted,
+      [&key](const MemberRecord& member, const auto& value) { return key(member) < value; });
+
+  if(pMember != pEnd && key(*pMember) == wanted)
+    return true;
+
+  //signature polymorphic methods (MethodHandle.invokeExact, ...) accept any
+  //descriptor, they are native varargs methods of these two classes
+  std::string_view className = str(record.Name);
+  if(kind != MemberKind::Method ||
+     (className != "java/lang/invoke/MethodHandle" && className != "java/lang/invoke/VarHandle"))
+    return false;
+
+  for(; pMember != pBegin && str((pMember-1)->Name) == name; --pMember);
+  for(; pMember != pEnd && str(pMember->Name) == name; ++pMember)
+    if(pMember->Kind == static_cast<std::uint8_t>(kind) &&
+       (pMember->Access & AccVarargs) && (pMember->Access & AccNative))
+      return true;
+
+  return false;
+}
+
+ClassPathIndex::Lookup ClassPathIndex::FindMember(std::string_view className, MemberKind kind,
+                                                  std::string_view name,
+                                                  std::string_view descriptor) const
+{
+  //breadth first over the class, its superclasses and superinterfaces
+  std::vector<std::string_view> pending{className};
+  std::unordered_set<std::string_view> seen{className};
+  bool complete = true;
+
+  for(size_t i = 0; i < pending.size(); ++i)
+  {
+    const ClassRecord* pClass = findClass(pending[i]);
+
+    if(!pClass)
+    {
+      if(pending[i] == "java/lang/Object")
+      {
+        if(kind == MemberKind::Method && isObjectMethod(name, descriptor))
+          return Lookup::Found;
+      }
+      else
+      {
+        complete = false;
+      }
+
+      continue;
+    }
+
+    if(declares(*pClass, kind, name, descriptor))
+      return Lookup::Found;
+
+    auto visit = [&](std::string_view ancestor)
+    {
+      if(!ancestor.empty() && seen.insert(ancestor).second)
+        pending.push_back(ancestor);
+    };
+
+    visit(str(pClass->Super));
+    for(std::uint32_t n = 0; n < pClass->InterfaceCount; ++n)
+      visit(str(pInterfaces[pClass->FirstInterface + n]));
+  }
+
+  return complete ? Lookup::Missing : Lookup::Unknown;
+}
+
+void CheckReferences(const std::vector<NodePtr>& nodes, const ClassPathIndex& classpath,
+                     const ReferenceCheckOptions& options)
+{
+  //classes defined by the source arent on the classpath yet
+  std::unordered_set<std::string_view> ownClasses;
+  for(const auto& pNode : nodes)
+  {
+    auto pDir = dynamic_cast<const DUnimplemented*>(pNode.get());
+    if(pDir && (pDir->DirectiveName == "class" || pDir->DirectiveName == "interface") &&
+       !pDir->Args.empty())
+      ownClasses.insert(pDir->Args.back().Value.View());
+  }
+
+  for(const auto& pNode : nodes)
+  {
+    auto pINode = dynamic_cast<const InstructionNode*>(pNode.get());
+    if(!pINode || pINode->Args.empty())
+      continue;
+
+    std::string_view mnemonic = pINode->Mnemonic.View();
+    bool isField = mnemonic == "getstatic" || mnemonic == "putstatic" ||
+                   mnemonic == "getfield"  || mnemonic == "putfield";
+    bool isMethod = mnemonic == "invokevirtual" || mnemonic == "invokespecial" ||
+                    mnemonic == "invokestatic"  || mnemonic == "invokeinterface";
+
+    if(!isField && !isMethod)
+      continue;
+
+    const Token& ref = pINode->Args.front();
+    auto error = [&](std::string_view message)
+    {
+      return std::runtime_error{fmt::format("Assembler error: {} {} on line {} col {}",
+          mnemonic, message, ref.Info.LineNumber, ref.Info.LineOffset)};
+    };
+
+    //"owner/name(args)ret" for methods, "owner/name" + descriptor for fields
+    std::string_view member = ref.Value.View();
+    std::string_view descriptor;
+
+    if(isMethod)
+    {
+      size_t paren = member.find('(');
+      if(paren == std::string_view::npos)
+        throw error(fmt::format("malformed method reference {}", member));
+
+      descriptor = member.substr(paren);
+      member = member.substr(0, paren);
+    }
+    else
+    {
+      if(pINode->Args.size() < 2)
+        throw error("is missing the field descriptor");
+
+      descriptor = pINode->Args[1].Value.View();
+    }
+
+    size_t slash = member.rfind('/');
+    if(slash == std::string_view::npos || slash == 0)
+      throw error(fmt::format("reference {} has no class", ref.Value.View()));
+
+    std::string_view owner = member.substr(0, slash);
+    std::string_view name = member.substr(slash + 1);
+
+    //arrays (e.g. clone()) and the classes being assembled cant be checked
+    if(owner.front() == '[' || ownClasses.count(owner))
+      continue;
+
+    if(!classpath.HasClass(owner))
+    {
+      if(options.RequireKnownClasses)
+        throw error(fmt::format("class {} not found on the classpath", owner));
+      continue;
+    }
+
+    auto kind = isField ? ClassPathIndex::MemberKind::Field : ClassPathIndex::MemberKind::Method;
+    if(classpath.FindMember(owner, kind, name, descriptor) == ClassPathIndex::Lookup::Missing)
+      throw error(fmt::format("{} {}.{}{}{} not found on the classpath",
+            isField ? "field" : "method", owner, name, isField ? " " : "", descriptor));
+  }
+}
+
+} //namespace: Jasmin
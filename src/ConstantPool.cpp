@@ -0,0 +1,571 @@
+#include "Jasmin/ConstantPool.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+namespace Jasmin
+{
+
+namespace
+{
+
+std::uint32_t bitsOf(float f)
+{
+  std::uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+std::uint64_t bitsOf(double d)
+{
+  std::uint64_t bits;
+  std::memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+//NOTE: floating point constants are compared by bit pattern so 0.0 and -0.0
+//end up as separate pool entries
+template<typename T>
+auto comparable(const T& value)
+{
+  if constexpr(std::is_floating_point_v<T>)
+    return bitsOf(value);
+  else if constexpr(std::is_same_v<T, Symbol>)
+    return value.Id();
+  else if constexpr(std::is_same_v<T, MemberRef>)
+    return std::make_tuple(value.Owner.Id(), value.Name.Id(), value.Descriptor.Id());
+  else if constexpr(std::is_same_v<T, MethodHandleRef>)
+    return std::make_tuple(value.ReferenceKind, value.IsInterface, comparable(value.Member));
+  else if constexpr(std::is_same_v<T, DynamicRef>)
+    return std::make_tuple(value.BootstrapMethod, value.Name.Id(), value.Descriptor.Id());
+  else
+    return value;
+}
+
+std::runtime_error loadError(const InstructionNode& node, std::string_view message)
+{
+  const Token& token = node.Args.front();
+  return std::runtime_error{fmt::format("Assembler error: {} {} on line {} col {}",
+      node.Mnemonic.View(), message, token.Info.LineNumber, token.Info.LineOffset)};
+}
+
+//NOTE: converting a double past the float range is undefined, and silently
+//rounding to inf or 0 isnt what was written
+std::optional<float> toFloat(double value)
+{
+  if(std::abs(value) > std::numeric_limits<float>::max())
+    return std::nullopt;
+
+  float narrowed = static_cast<float>(value);
+  if(narrowed == 0 && value != 0)
+    return std::nullopt;
+
+  return narrowed;
+}
+
+Constant utf8(Symbol text)
+{
+  return Constant{Constant::Kind::Utf8, text};
+}
+
+Constant nameAndType(Symbol name, Symbol descriptor)
+{
+  return Constant{Constant::Kind::NameAndType, MemberRef{Symbol{}, name, descriptor}};
+}
+
+//"owner/name(args)ret" for methods, "owner/name" + descriptor for fields
+MemberRef memberRef(const InstructionNode& node, bool isMethod)
+{
+  std::string_view member = node.Args.front().Value.View();
+  std::string_view descriptor;
+
+  if(isMethod)
+  {
+    size_t paren = member.find('(');
+    if(paren == std::string_view::npos)
+      throw loadError(node, fmt::format("malformed method reference {}", member));
+
+    descriptor = member.substr(paren);
+    member = member.substr(0, paren);
+  }
+  else
+  {
+    if(node.Args.size() < 2)
+      throw loadError(node, "is missing the field descriptor");
+
+    descriptor = node.Args[1].Value.View();
+  }
+
+  size_t slash = member.rfind('/');
+  if(slash == std::string_view::npos || slash == 0 || slash + 1 == member.size())
+    throw loadError(node, fmt::format("reference {} has no class", node.Args.front().Value.View()));
+
+  return MemberRef{Symbol{member.substr(0, slash)}, Symbol{member.substr(slash + 1)},
+                   Symbol{descriptor}};
+}
+
+const Token* lastSymbolArg(const DUnimplemented& dir)
+{
+  for(auto it = dir.Args.rbegin(); it != dir.Args.rend(); ++it)
+    if(it->Type == TT::Symbol)
+      return &*it;
+
+  return nullptr;
+}
+
+//.field <access> <name> <descriptor> [= <value>]
+std::optional<Constant> fieldValue(const DUnimplemented& dir, size_t nameIndex)
+{
+  if(dir.Args.size() != nameIndex + 4 || dir.Args[nameIndex + 2].Value != "=")
+    return std::nullopt;
+
+  std::string_view descriptor = dir.Args[nameIndex + 1].Value.View();
+  const Token& value = dir.Args[nameIndex + 3];
+
+  if(value.Type == TT::String)
+    return Constant{Constant::Kind::String, value.Value};
+
+  std::optional<double> number = value.DecimalValue();
+  if(!number && value.IntValue())
+    number = static_cast<double>(*value.IntValue());
+
+  bool isWide = descriptor == "J" || descriptor == "D";
+
+  if(descriptor == "J" && value.IntValue())
+    return Constant{Constant::Kind::Long, *value.IntValue()};
+  if(descriptor == "D" && number)
+    return Constant{Constant::Kind::Double, *number};
+  if(descriptor == "F" && number && toFloat(*number))
+    return Constant{Constant::Kind::Float, *toFloat(*number)};
+  if(!isWide && descriptor != "F" && value.Int32Value())
+    return Constant{Constant::Kind::Integer, *value.Int32Value()};
+
+  throw std::runtime_error{fmt::format(
+      "Assembler error: .field {} has an invalid constant value on line {}",
+      dir.Args[nameIndex].Value.View(), value.Info.LineNumber)};
+}
+
+} //namespace: anonymous
+
+bool Constant::IsLdcLoadable() const
+{
+  return Type == Kind::Integer || Type == Kind::Float ||
+         Type == Kind::String  || Type == Kind::Class ||
+         Type == Kind::MethodHandle || Type == Kind::MethodType;
+}
+
+unsigned Constant::SlotCount() const
+{
+  return Type == Kind::Long || Type == Kind::Double ? 2 : 1;
+}
+
+std::vector<Constant> Constant::References() const
+{
+  switch(Type)
+  {
+    case Kind::Class:
+    case Kind::String:
+    case Kind::MethodType:
+      return {utf8(std::get<Symbol>(Value))};
+
+    case Kind::Fieldref:
+    case Kind::Methodref:
+    case Kind::InterfaceMethodref:
+    {
+      const auto& member = std::get<MemberRef>(Value);
+      return {Constant{Kind::Class, member.Owner}, nameAndType(member.Name, member.Descriptor)};
+    }
+
+    case Kind::NameAndType:
+    {
+      const auto& member = std::get<MemberRef>(Value);
+      return {utf8(member.Name), utf8(member.Descriptor)};
+    }
+
+    case Kind::MethodHandle:
+    {
+      const auto& handle = std::get<MethodHandleRef>(Value);
+      Kind kind = handle.ReferenceKind <= 4 ? Kind::Fieldref :
+                  handle.IsInterface ? Kind::InterfaceMethodref : Kind::Methodref;
+      return {Constant{kind, handle.Member}};
+    }
+
+    case Kind::InvokeDynamic:
+    {
+      const auto& site = std::get<DynamicRef>(Value);
+      return {nameAndType(site.Name, site.Descriptor)};
+    }
+
+    default:
+      return {};
+  }
+}
+
+std::optional<Constant> Constant::FromLoad(const InstructionNode& node)
+{
+  bool isLdc  = node.Mnemonic == "ldc" || node.Mnemonic == "ldc_w";
+  bool isLdc2 = node.Mnemonic == "ldc2_w";
+
+  if(!isLdc && !isLdc2)
+    return std::nullopt;
+
+  if(node.Args.size() != 1)
+    throw std::runtime_error{fmt::format(
+        "Assembler error: {} expects 1 operand, got {}", node.Mnemonic.View(), node.Args.size())};
+
+  const Token& arg = node.Args.front();
+
+  if(isLdc2)
+  {
+    if(auto intValue = arg.IntValue())
+      return Constant{Kind::Long, *intValue};
+
+    if(auto decimalValue = arg.DecimalValue())
+      return Constant{Kind::Double, *decimalValue};
+
+    throw loadError(node, "operand must be an integer or decimal");
+  }
+
+  switch(arg.Type)
+  {
+    case TT::Integer:
+      if(auto intValue = arg.Int32Value())
+        return Constant{Kind::Integer, *intValue};
+      throw loadError(node, "operand out of int range (use ldc2_w)");
+
+    case TT::Decimal:
+      if(auto value = toFloat(*arg.DecimalValue()))
+        return Constant{Kind::Float, *value};
+      throw loadError(node, "operand out of float range (use ldc2_w)");
+
+    case TT::String:
+      return Constant{Kind::String, arg.Value};
+
+    case TT::Symbol:
+      return Constant{Kind::Class, arg.Value};
+
+    default:
+      throw loadError(node, "operand must be a number, string or class name");
+  }
+}
+
+std::optional<Constant> Constant::FromReference(const InstructionNode& node)
+{
+  std::string_view mnemonic = node.Mnemonic.View();
+
+  bool isField = mnemonic == "getstatic" || mnemonic == "putstatic" ||
+                 mnemonic == "getfield"  || mnemonic == "putfield";
+  bool isInterface = mnemonic == "invokeinterface";
+  bool isMethod = isInterface || mnemonic == "invokevirtual" ||
+                  mnemonic == "invokespecial" || mnemonic == "invokestatic";
+  bool isClass = mnemonic == "new" || mnemonic == "anewarray" || mnemonic == "checkcast" ||
+                 mnemonic == "instanceof" || mnemonic == "multianewarray";
+
+  if(!isField && !isMethod && !isClass)
+    return std::nullopt;
+
+  if(node.Args.empty())
+    throw std::runtime_error{fmt::format("Assembler error: {} is missing an operand", mnemonic)};
+
+  if(isClass)
+    return Constant{Kind::Class, node.Args.front().Value};
+
+  Kind kind = isField ? Kind::Fieldref : isInterface ? Kind::InterfaceMethodref : Kind::Methodref;
+  return Constant{kind, memberRef(node, isMethod)};
+}
+
+bool operator==(const Constant& a, const Constant& b)
+{
+  return !(a < b) && !(b < a);
+}
+
+bool operator<(const Constant& a, const Constant& b)
+{
+  if(a.Type != b.Type)
+    return a.Type < b.Type;
+
+  if(a.Value.index() != b.Value.index())
+    return a.Value.index() < b.Value.index();
+
+  return std::visit([&b](const auto& aValue)
+  {
+    using T = std::decay_t<decltype(aValue)>;
+    return comparable(aValue) < comparable(std::get<T>(b.Value));
+  }, a.Value);
+}
+
+void ConstantPoolLayout::Profile(const std::vector<NodePtr>& nodes)
+{
+  //attribute names are added once, where they are first needed
+  auto attribute = [this](std::string_view name) { Add(utf8(Symbol{name})); };
+  bool hasCode = false;
+
+  for(const auto& pNode : nodes)
+  {
+    if(auto pINode = dynamic_cast<const InstructionNode*>(pNode.get()))
+    {
+      if(!hasCode)
+        attribute("Code");
+      hasCode = true;
+
+      if(std::optional<Constant> constant = Constant::FromLoad(*pINode))
+      {
+        if(!FoldConstantLoad(*constant))
+          CountLdc(*constant);
+      }
+      else if(std::optional<Constant> reference = Constant::FromReference(*pINode))
+      {
+        Add(*reference);
+      }
+
+      continue;
+    }
+
+    auto pDir = dynamic_cast<const DUnimplemented*>(pNode.get());
+    if(!pDir)
+      continue;
+
+    std::string_view name = pDir->DirectiveName.View();
+    const Token* pSymbol = lastSymbolArg(*pDir);
+
+    if((name == "class" || name == "interface" || name == "super" || name == "implements") &&
+       pSymbol)
+    {
+      Add(Constant{Constant::Kind::Class, pSymbol->Value});
+    }
+    else if(name == "throws" && pSymbol)
+    {
+      attribute("Exceptions");
+      Add(Constant{Constant::Kind::Class, pSymbol->Value});
+    }
+    else if(name == "catch" && !pDir->Args.empty() && pDir->Args.front().Value != "all")
+    {
+      Add(Constant{Constant::Kind::Class, pDir->Args.front().Value});
+    }
+    else if(name == "method" && pSymbol)
+    {
+      std::string_view method = pSymbol->Value.View();
+      size_t paren = std::min(method.find('('), method.size());
+      Add(utf8(Symbol{method.substr(0, paren)}));
+      Add(utf8(Symbol{method.substr(paren)}));
+    }
+    else if(name == "field")
+    {
+      //the name is the first symbol after the access flags
+      auto it = std::find_if(pDir->Args.begin(), pDir->Args.end(),
+          [](const Token& arg) { return arg.Type == TT::Symbol; });
+      size_t nameIndex = static_cast<size_t>(it - pDir->Args.begin());
+      if(nameIndex + 1 >= pDir->Args.size())
+        continue;
+
+      Add(utf8(pDir->Args[nameIndex].Value));
+      Add(utf8(pDir->Args[nameIndex + 1].Value));
+
+      if(std::optional<Constant> value = fieldValue(*pDir, nameIndex))
+      {
+        attribute("ConstantValue");
+        Add(*value);
+      }
+    }
+    else if(name == "source" && pDir->Args.size() == 1)
+    {
+      attribute("SourceFile");
+      Add(utf8(pDir->Args.front().Value));
+    }
+    else if(name == "line")
+    {
+      attribute("LineNumberTable");
+    }
+    else if(name == "var" && pDir->Args.size() >= 4)
+    {
+      attribute("LocalVariableTable");
+      Add(utf8(pDir->Args[2].Value));
+      Add(utf8(pDir->Args[3].Value));
+    }
+  }
+}
+
+void ConstantPoolLayout::CountLdc(const Constant& constant)
+{
+  Add(constant);
+  ++ldcUses[constant];
+}
+
+void ConstantPoolLayout::Add(const Constant& constant)
+{
+  if(isFinal)
+    throw std::logic_error{"constant added to a finalized pool layout"};
+
+  if(ldcUses.emplace(constant, 0).second)
+    seen.push_back(constant);
+}
+
+void ConstantPoolLayout::Finalize()
+{
+  if(isFinal)
+    return;
+
+  std::vector<Constant> hot;
+  for(const auto& constant : seen)
+    if(constant.IsLdcLoadable() && ldcUses.at(constant) > 0)
+      hot.push_back(constant);
+
+  std::stable_sort(hot.begin(), hot.end(),
+      [this](const Constant& a, const Constant& b)
+      {
+        return ldcUses.at(a) > ldcUses.at(b);
+      });
+
+  for(const auto& constant : hot)
+    place(constant);
+
+  for(const auto& constant : seen)
+    place(constant);
+
+  //entries only pointed at (the Class and NameAndType of a Fieldref, the
+  //Utf8 holding the text of a String, ...) are never loaded directly so
+  //they go last. NOTE: entries grows while its references are placed
+  for(size_t i = 0; i < entries.size(); ++i)
+    for(const Constant& referenced : entries[i].References())
+      place(referenced);
+
+  isFinal = true;
+}
+
+U16 ConstantPoolLayout::IndexOf(const Constant& constant) const
+{
+  if(!isFinal)
+    throw std::logic_error{"constant pool index requested before Finalize()"};
+
+  auto it = indices.find(constant);
+  if(it == indices.end())
+    throw std::logic_error{"constant pool index requested for unknown constant"};
+
+  return it->second;
+}
+
+void ConstantPoolLayout::place(const Constant& constant)
+{
+  if(indices.count(constant))
+    return;
+
+  if(nextIndex + constant.SlotCount() > 0xFFFF)
+    throw std::runtime_error{"Assembler error: constant pool exceeds 65535 entries"};
+
+  indices.emplace(constant, nextIndex);
+  entries.push_back(constant);
+  nextIndex += constant.SlotCount();
+}
+
+std::optional<ConstantLoad> FoldConstantLoad(const Constant& constant)
+{
+  switch(constant.Type)
+  {
+    case Constant::Kind::Integer:
+    {
+      std::int32_t value = std::get<std::int32_t>(constant.Value);
+
+      if(value == -1)
+        return ConstantLoad{Symbol{"iconst_m1"}, std::nullopt};
+      if(value >= 0 && value <= 5)
+        return ConstantLoad{Symbol{fmt::format("iconst_{}", value)}, std::nullopt};
+      if(value >= -128 && value <= 127)
+        return ConstantLoad{Symbol{"bipush"}, value};
+      if(value >= -32768 && value <= 32767)
+        return ConstantLoad{Symbol{"sipush"}, value};
+
+      return std::nullopt;
+    }
+
+    case Constant::Kind::Float:
+    {
+      std::uint32_t bits = bitsOf(std::get<float>(constant.Value));
+
+      for(int n : {0, 1, 2})
+        if(bits == bitsOf(static_cast<float>(n)))
+          return ConstantLoad{Symbol{fmt::format("fconst_{}", n)}, std::nullopt};
+
+      return std::nullopt;
+    }
+
+    case Constant::Kind::Long:
+    {
+      std::int64_t value = std::get<std::int64_t>(constant.Value);
+
+      if(value == 0 || value == 1)
+        return ConstantLoad{Symbol{fmt::format("lconst_{}", value)}, std::nullopt};
+
+      return std::nullopt;
+    }
+
+    case Constant::Kind::Double:
+    {
+      std::uint64_t bits = bitsOf(std::get<double>(constant.Value));
+
+      for(int n : {0, 1})
+        if(bits == bitsOf(static_cast<double>(n)))
+          return ConstantLoad{Symbol{fmt::format("dconst_{}", n)}, std::nullopt};
+
+      return std::nullopt;
+    }
+
+    default:
+      return std::nullopt;
+  }
+}
+
+ConstantLoad LowerConstantLoad(const Constant& constant, const ConstantPoolLayout& layout)
+{
+  if(auto folded = FoldConstantLoad(constant))
+    return *folded;
+
+  U16 index = layout.IndexOf(constant);
+
+  if(constant.SlotCount() == 2)
+    return ConstantLoad{Symbol{"ldc2_w"}, std::nullopt, index};
+
+  if(index <= ConstantPoolLayout::MaxLdcIndex)
+    return ConstantLoad{Symbol{"ldc"}, std::nullopt, index};
+
+  return ConstantLoad{Symbol{"ldc_w"}, std::nullopt, index};
+}
+
+std::vector<NodePtr> LowerConstantLoads(std::vector<NodePtr> nodes, const ConstantPoolLayout& layout)
+{
+  for(auto& pNode : nodes)
+  {
+    auto pINode = dynamic_cast<InstructionNode*>(pNode.get());
+    if(!pINode)
+      continue;
+
+    std::optional<Constant> constant = Constant::FromLoad(*pINode);
+    if(!constant)
+      continue;
+
+    ConstantLoad load = LowerConstantLoad(*constant, layout);
+    std::string_view mnemonic = load.Mnemonic.View();
+
+    //NOTE: ldc operands stay as written, the index comes from the layout
+    if(mnemonic != "ldc" && mnemonic != "ldc_w" && mnemonic != "ldc2_w")
+    {
+      Token::MetaInfo info = pINode->Args.front().Info;
+      pINode->Args.clear();
+
+      if(load.Immediate)
+        pINode->Args.push_back(Token{TT::Integer, Symbol{std::to_string(*load.Immediate)},
+                                     *load.Immediate, info});
+    }
+
+    pINode->Mnemonic = load.Mnemonic;
+  }
+
+  return nodes;
+}
+
+} //namespace: Jasmin
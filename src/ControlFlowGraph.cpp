@@ -0,0 +1,388 @@
+#include "Jasmin/ControlFlowGraph.hpp"
+#include "Jasmin/Instructions.hpp"
+
+#include <fmt/core.h>
+
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+namespace Jasmin
+{
+
+namespace
+{
+
+using BlockId = ControlFlowGraph::BlockId;
+
+struct CatchLabels
+{
+  Symbol From, To, Using;
+};
+
+//.catch <class> from <label> to <label> using <label>
+CatchLabels catchLabels(const DUnimplemented& dir)
+{
+  CatchLabels labels;
+
+  for(size_t i = 0; i + 1 < dir.Args.size(); ++i)
+  {
+    if(dir.Args[i].Type != TT::Symbol)
+      continue;
+
+    if(dir.Args[i].Value == "from")
+      labels.From = dir.Args[i+1].Value;
+    else if(dir.Args[i].Value == "to")
+      labels.To = dir.Args[i+1].Value;
+    else if(dir.Args[i].Value == "using")
+      labels.Using = dir.Args[i+1].Value;
+  }
+
+  if(labels.From.Empty() || labels.To.Empty() || labels.Using.Empty())
+    throw std::runtime_error{"Assembler error: .catch expects from, to and using labels"};
+
+  return labels;
+}
+
+//counting sort of the edges by one end into CSR offsets + targets
+void buildCsr(size_t blockCount, const std::vector<std::pair<BlockId, BlockId>>& edges,
+              bool byTarget, std::vector<std::uint32_t>& offsets, std::vector<BlockId>& out)
+{
+  offsets.assign(blockCount + 1, 0);
+  for(const auto& [from, to] : edges)
+    ++offsets[(byTarget ? to : from) + 1];
+
+  for(size_t b = 0; b < blockCount; ++b)
+    offsets[b+1] += offsets[b];
+
+  std::vector<std::uint32_t> next(offsets.begin(), offsets.end() - 1);
+  out.resize(edges.size());
+
+  for(const auto& [from, to] : edges)
+  {
+    BlockId key = byTarget ? to : from;
+    out[next[key]++] = byTarget ? from : to;
+  }
+}
+
+} //namespace: anonymous
+
+ControlFlowGraph::ControlFlowGraph(std::vector<NodePtr>::const_iterator begin,
+                                   std::vector<NodePtr>::const_iterator end)
+: nodeCount{static_cast<size_t>(end - begin)}
+{
+  //labels that start a block: branch targets and .catch labels
+  std::unordered_set<Symbol> leaderLabels;
+  std::vector<const DUnimplemented*> catches;
+
+  //flow of the instruction at each position, nullopt for other nodes
+  std::vector<std::optional<InstructionInfo::Flow>> flows(nodeCount);
+
+  for(size_t pos = 0; pos < nodeCount; ++pos)
+  {
+    const Node* pNode = begin[pos].get();
+
+    if(auto pLNode = dynamic_cast<const LabelNode*>(pNode))
+    {
+      labels[pLNode->LabelName] = pos;
+    }
+    else if(auto pINode = dynamic_cast<const InstructionNode*>(pNode))
+    {
+      flows[pos] = GetInstruction(*pINode).ControlFlow;
+
+      if(flows[pos] != InstructionInfo::Flow::Next)
+        for(Symbol target : BranchTargets(*pINode))
+          leaderLabels.insert(target);
+    }
+    else if(auto pDir = dynamic_cast<const DUnimplemented*>(pNode);
+            pDir && pDir->DirectiveName == "catch")
+    {
+      CatchLabels range = catchLabels(*pDir);
+      leaderLabels.insert({range.From, range.To, range.Using});
+      catches.push_back(pDir);
+    }
+  }
+
+  //NOTE: a block starts right after the last instruction of the previous
+  //one, so the directives and labels in between belong to the new block
+  blockAt.resize(nodeCount);
+  bool startsBlock = true;
+  size_t nextStart = 0;
+
+  for(size_t pos = 0; pos < nodeCount; ++pos)
+  {
+    if(!flows[pos])
+    {
+      if(auto pLNode = dynamic_cast<const LabelNode*>(begin[pos].get()))
+        startsBlock |= leaderLabels.count(pLNode->LabelName) > 0;
+    }
+    else
+    {
+      if(startsBlock)
+      {
+        for(size_t p = nextStart; p < pos; ++p)
+          blockAt[p] = static_cast<BlockId>(blockStarts.size());
+
+        blockStarts.push_back(nextStart);
+        terminators.push_back(pos);
+        startsBlock = false;
+      }
+
+      blockAt[pos] = static_cast<BlockId>(blockStarts.size() - 1);
+      terminators.back() = pos;
+      nextStart = pos + 1;
+
+      startsBlock = *flows[pos] != InstructionInfo::Flow::Next;
+    }
+  }
+
+  //trailing directives and labels belong to the last block
+  for(size_t p = nextStart; p < nodeCount; ++p)
+    blockAt[p] = blockStarts.empty() ? NoBlock : static_cast<BlockId>(blockStarts.size() - 1);
+
+  size_t blockCount = blockStarts.size();
+
+  //normal edges, duplicates (e.g. switch cases sharing a label) are dropped
+  //by stamping each target with the block that last added it
+  std::vector<std::pair<BlockId, BlockId>> edges;
+  std::vector<BlockId> stamp(blockCount, NoBlock);
+
+  for(BlockId b = 0; b < blockCount; ++b)
+  {
+    auto& last = static_cast<const InstructionNode&>(*begin[terminators[b]]);
+    InstructionInfo::Flow flow = *flows[terminators[b]];
+
+    auto addEdge = [&](BlockId to)
+    {
+      if(stamp[to] != b)
+      {
+        stamp[to] = b;
+        edges.emplace_back(b, to);
+      }
+    };
+
+    if(flow != InstructionInfo::Flow::Next)
+      for(Symbol target : BranchTargets(last))
+        addEdge(BlockOf(target));
+
+    if(FallsThrough(last) && b + 1 < blockCount)
+      addEdge(b + 1);
+  }
+
+  buildCsr(blockCount, edges, false, successorOffsets, successors);
+
+  std::vector<std::pair<BlockId, BlockId>> handlerEdges;
+  for(const DUnimplemented* pCatch : catches)
+  {
+    CatchLabels range = catchLabels(*pCatch);
+    BlockId from = BlockOf(range.From);
+    BlockId handler = BlockOf(range.Using);
+
+    //a to label after the last instruction covers the rest of the code
+    BlockId to = BlockOf(range.To);
+    if(labels.at(range.To) >= nextStart)
+      to = static_cast<BlockId>(blockCount);
+
+    for(BlockId b = from; b < to; ++b)
+      handlerEdges.emplace_back(b, handler);
+  }
+
+  buildCsr(blockCount, handlerEdges, false, handlerOffsets, handlers);
+
+  edges.insert(edges.end(), handlerEdges.begin(), handlerEdges.end());
+  buildCsr(blockCount, edges, true, predecessorOffsets, predecessors);
+
+  computeReversePostorder();
+}
+
+size_t ControlFlowGraph::BlockEnd(BlockId block) const
+{
+  return block + 1 < blockStarts.size() ? blockStarts[block + 1] : nodeCount;
+}
+
+ControlFlowGraph::BlockId ControlFlowGraph::BlockOf(Symbol label) const
+{
+  auto it = labels.find(label);
+  if(it == labels.end())
+    throw std::runtime_error{fmt::format(
+        "Assembler error: undefined label \"{}\"", label.View())};
+
+  if(blockAt.empty() || blockStarts.empty())
+    throw std::runtime_error{fmt::format(
+        "Assembler error: label \"{}\" has no code", label.View())};
+
+  return blockAt[it->second];
+}
+
+ControlFlowGraph::BlockRange ControlFlowGraph::range(const std::vector<std::uint32_t>& offsets,
+                                                     const std::vector<BlockId>& edges, BlockId block)
+{
+  return BlockRange{edges.data() + offsets[block], edges.data() + offsets[block + 1]};
+}
+
+ControlFlowGraph::BlockRange ControlFlowGraph::Successors(BlockId block) const
+{
+  return range(successorOffsets, successors, block);
+}
+
+ControlFlowGraph::BlockRange ControlFlowGraph::Handlers(BlockId block) const
+{
+  return range(handlerOffsets, handlers, block);
+}
+
+ControlFlowGraph::BlockRange ControlFlowGraph::Predecessors(BlockId block) const
+{
+  return range(predecessorOffsets, predecessors, block);
+}
+
+void ControlFlowGraph::computeReversePostorder()
+{
+  size_t blockCount = BlockCount();
+  rpoRank.assign(blockCount, NoBlock);
+
+  if(blockCount == 0)
+    return;
+
+  //iterative dfs, each frame remembers how many of its edges (successors
+  //first, then handlers) it has followed
+  std::vector<bool> visited(blockCount, false);
+  std::vector<std::pair<BlockId, std::uint32_t>> stack;
+  std::vector<BlockId> postorder;
+  postorder.reserve(blockCount);
+
+  visited[0] = true;
+  stack.emplace_back(0, 0);
+
+  while(!stack.empty())
+  {
+    auto& [block, edge] = stack.back();
+    BlockRange succs = Successors(block);
+    BlockRange excs  = Handlers(block);
+
+    if(edge < succs.size() + excs.size())
+    {
+      BlockId next = edge < succs.size() ? succs[edge] : excs[edge - succs.size()];
+      ++edge;
+
+      if(!visited[next])
+      {
+        visited[next] = true;
+        stack.emplace_back(next, 0);
+      }
+
+      continue;
+    }
+
+    postorder.push_back(block);
+    stack.pop_back();
+  }
+
+  reversePostorder.assign(postorder.rbegin(), postorder.rend());
+  for(size_t i = 0; i < reversePostorder.size(); ++i)
+    rpoRank[reversePostorder[i]] = static_cast<BlockId>(i);
+}
+
+DominatorTree::DominatorTree(const ControlFlowGraph& cfg)
+{
+  constexpr BlockId NoBlock = ControlFlowGraph::NoBlock;
+
+  size_t blockCount = cfg.BlockCount();
+  idoms.assign(blockCount, NoBlock);
+  preorder.assign(blockCount, 0);
+  postorder.assign(blockCount, 0);
+
+  const auto& rpo = cfg.ReversePostorder();
+  if(rpo.empty())
+    return;
+
+  //NOTE: the entry is its own idom while iterating so intersect terminates
+  idoms[rpo.front()] = rpo.front();
+
+  auto intersect = [&](BlockId a, BlockId b)
+  {
+    while(a != b)
+    {
+      while(cfg.PostorderRank(a) > cfg.PostorderRank(b))
+        a = idoms[a];
+      while(cfg.PostorderRank(b) > cfg.PostorderRank(a))
+        b = idoms[b];
+    }
+
+    return a;
+  };
+
+  bool changed = true;
+  while(changed)
+  {
+    changed = false;
+
+    for(size_t i = 1; i < rpo.size(); ++i)
+    {
+      BlockId block = rpo[i];
+      BlockId newIdom = NoBlock;
+
+      for(BlockId pred : cfg.Predecessors(block))
+      {
+        if(idoms[pred] == NoBlock)
+          continue;
+
+        newIdom = newIdom == NoBlock ? pred : intersect(pred, newIdom);
+      }
+
+      if(newIdom != idoms[block])
+      {
+        idoms[block] = newIdom;
+        changed = true;
+      }
+    }
+  }
+
+  idoms[rpo.front()] = NoBlock;
+
+  //number the tree (children in CSR form again) with an iterative dfs
+  std::vector<std::uint32_t> childOffsets(blockCount + 1, 0);
+  for(BlockId block : rpo)
+    if(idoms[block] != NoBlock)
+      ++childOffsets[idoms[block] + 1];
+
+  for(size_t b = 0; b < blockCount; ++b)
+    childOffsets[b+1] += childOffsets[b];
+
+  std::vector<BlockId> children(childOffsets.back());
+  std::vector<std::uint32_t> next(childOffsets.begin(), childOffsets.end() - 1);
+  for(BlockId block : rpo)
+    if(idoms[block] != NoBlock)
+      children[next[idoms[block]]++] = block;
+
+  std::uint32_t counter = 1;
+  std::vector<std::pair<BlockId, std::uint32_t>> stack{{rpo.front(), childOffsets[rpo.front()]}};
+  preorder[rpo.front()] = counter++;
+
+  while(!stack.empty())
+  {
+    auto& [block, child] = stack.back();
+
+    if(child < childOffsets[block + 1])
+    {
+      BlockId next = children[child++];
+      preorder[next] = counter++;
+      stack.emplace_back(next, childOffsets[next]);
+      continue;
+    }
+
+    postorder[block] = counter++;
+    stack.pop_back();
+  }
+}
+
+bool DominatorTree::Dominates(BlockId dominator, BlockId block) const
+{
+  //unreachable blocks keep preorder 0
+  if(preorder[dominator] == 0 || preorder[block] == 0)
+    return false;
+
+  return preorder[dominator] <= preorder[block] && postorder[block] <= postorder[dominator];
+}
+
+} //namespace: Jasmin
@@ -0,0 +1,211 @@
+#include "Jasmin/DebugInfo.hpp"
+#include "Jasmin/Instructions.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+namespace Jasmin
+{
+
+namespace
+{
+
+const DUnimplemented* asDirective(const NodePtr& pNode, std::string_view name)
+{
+  auto pDir = dynamic_cast<const DUnimplemented*>(pNode.get());
+  return pDir && pDir->DirectiveName == name ? pDir : nullptr;
+}
+
+//the argument following a keyword argument, e.g. the label after "from"
+const Token* argAfter(const DUnimplemented& dir, std::string_view keyword)
+{
+  for(size_t i = 0; i + 1 < dir.Args.size(); ++i)
+    if(dir.Args[i].Type == TT::Symbol && dir.Args[i].Value == keyword)
+      return &dir.Args[i + 1];
+
+  return nullptr;
+}
+
+std::uint16_t codeOffset(size_t offset)
+{
+  if(offset > 0xFFFF)
+    throw std::runtime_error{"Assembler error: debug info past the 64KB code limit"};
+
+  return static_cast<std::uint16_t>(offset);
+}
+
+//.line <number>
+std::uint16_t lineNumber(const DUnimplemented& dir)
+{
+  auto number = dir.Args.size() == 1 ? dir.Args.front().IntValue() : std::nullopt;
+  if(!number || *number < 0 || *number > 0xFFFF)
+    throw std::runtime_error{"Assembler error: .line expects a line number (0-65535)"};
+
+  return static_cast<std::uint16_t>(*number);
+}
+
+//.var <index> is <name> <descriptor> [from <label> to <label>]
+LocalVariableEntry localVariable(const DUnimplemented& dir,
+                                 const std::unordered_map<Symbol, size_t>& labelOffsets,
+                                 size_t codeSize)
+{
+  constexpr auto usage = "Assembler error: .var expects <index> is <name> <descriptor> "
+                         "[from <label> to <label>]";
+
+  auto index = dir.Args.empty() ? std::nullopt : dir.Args.front().IntValue();
+  if(!index || *index < 0 || *index > 0xFFFF || dir.Args.size() < 4 ||
+     dir.Args[1].Value != "is" || dir.Args[2].Type != TT::Symbol || dir.Args[3].Type != TT::Symbol)
+    throw std::runtime_error{usage};
+
+  const Token* pFrom = argAfter(dir, "from");
+  const Token* pTo = argAfter(dir, "to");
+  if(!pFrom != !pTo || (!pFrom && dir.Args.size() != 4))
+    throw std::runtime_error{usage};
+
+  auto offsetOf = [&labelOffsets](const Token* pLabel, size_t fallback)
+  {
+    if(!pLabel)
+      return fallback;
+
+    auto it = labelOffsets.find(pLabel->Value);
+    if(it == labelOffsets.end())
+      throw std::runtime_error{fmt::format(
+          "Assembler error: undefined label \"{}\"", pLabel->Value.View())};
+
+    return it->second;
+  };
+
+  size_t start = offsetOf(pFrom, 0);
+  size_t end = offsetOf(pTo, codeSize);
+  if(end < start)
+    throw std::runtime_error{fmt::format(
+        "Assembler error: .var {} ends before it starts", dir.Args[2].Value.View())};
+
+  return LocalVariableEntry{codeOffset(start), codeOffset(end - start),
+                            dir.Args[2].Value, dir.Args[3].Value,
+                            static_cast<std::uint16_t>(*index)};
+}
+
+//merges ranges of the same variable that overlap or touch
+std::vector<LocalVariableEntry> mergeRanges(std::vector<LocalVariableEntry> entries)
+{
+  auto key = [](const LocalVariableEntry& e)
+  {
+    return std::make_tuple(e.Index, e.Name.View(), e.Descriptor.View(), e.StartPc);
+  };
+
+  std::sort(entries.begin(), entries.end(),
+      [&key](const LocalVariableEntry& a, const LocalVariableEntry& b) { return key(a) < key(b); });
+
+  std::vector<LocalVariableEntry> merged;
+  for(const LocalVariableEntry& entry : entries)
+  {
+    if(!merged.empty())
+    {
+      LocalVariableEntry& last = merged.back();
+      size_t lastEnd = size_t{last.StartPc} + last.Length;
+
+      if(last.Index == entry.Index && last.Name == entry.Name &&
+         last.Descriptor == entry.Descriptor && entry.StartPc <= lastEnd)
+      {
+        size_t end = std::max(lastEnd, size_t{entry.StartPc} + entry.Length);
+        last.Length = static_cast<std::uint16_t>(end - last.StartPc);
+        continue;
+      }
+    }
+
+    merged.push_back(entry);
+  }
+
+  std::stable_sort(merged.begin(), merged.end(),
+      [](const LocalVariableEntry& a, const LocalVariableEntry& b) { return a.StartPc < b.StartPc; });
+
+  return merged;
+}
+
+} //namespace: anonymous
+
+std::vector<NodePtr> StripDebugInfo(std::vector<NodePtr> nodes)
+{
+  nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [](const NodePtr& pNode)
+  {
+    return asDirective(pNode, "line") || asDirective(pNode, "var") || asDirective(pNode, "source");
+  }), nodes.end());
+
+  return nodes;
+}
+
+MethodDebugInfo BuildDebugInfo(std::vector<NodePtr>::const_iterator begin,
+                               std::vector<NodePtr>::const_iterator end,
+                               DebugInfoPolicy policy, const ConstantPoolLayout* pPool)
+{
+  MethodDebugInfo info;
+  if(policy == DebugInfoPolicy::Strip)
+    return info;
+
+  std::vector<size_t> offsets = CodeOffsets(begin, end, pPool);
+  size_t instruction = 0;
+  size_t offset = 0;
+
+  std::unordered_map<Symbol, size_t> labelOffsets;
+
+  std::optional<std::uint16_t> line;
+  bool isLineChanged = false;
+
+  for(auto it = begin; it != end; ++it)
+  {
+    if(auto pLabel = dynamic_cast<const LabelNode*>(it->get()))
+    {
+      labelOffsets[pLabel->LabelName] = offset;
+    }
+    else if(dynamic_cast<const InstructionNode*>(it->get()))
+    {
+      if(line && (isLineChanged || policy == DebugInfoPolicy::Full))
+        info.LineNumbers.push_back(LineNumberEntry{codeOffset(offset), *line});
+
+      isLineChanged = false;
+      offset = offsets[++instruction];
+    }
+    else if(auto pLine = asDirective(*it, "line"))
+    {
+      std::uint16_t number = lineNumber(*pLine);
+      isLineChanged |= line != number;
+      line = number;
+    }
+  }
+
+  for(auto it = begin; it != end; ++it)
+    if(auto pVar = asDirective(*it, "var"))
+      info.LocalVariables.push_back(localVariable(*pVar, labelOffsets, offset));
+
+  if(policy == DebugInfoPolicy::Compact)
+    info.LocalVariables = mergeRanges(std::move(info.LocalVariables));
+
+  return info;
+}
+
+std::optional<Symbol> SourceFile(const std::vector<NodePtr>& nodes, DebugInfoPolicy policy)
+{
+  if(policy == DebugInfoPolicy::Strip)
+    return std::nullopt;
+
+  for(const auto& pNode : nodes)
+  {
+    auto pSource = asDirective(pNode, "source");
+    if(!pSource)
+      continue;
+
+    if(pSource->Args.size() != 1)
+      throw std::runtime_error{"Assembler error: .source expects a file name"};
+
+    return pSource->Args.front().Value;
+  }
+
+  return std::nullopt;
+}
+
+} //namespace: Jasmin
@@ -0,0 +1,582 @@
+#include "Jasmin/Instructions.hpp"
+#include "Jasmin/ConstantPool.hpp"
+#include "Jasmin/Opcodes.hpp"
+
+#include <fmt/core.h>
+
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace Jasmin
+{
+
+namespace
+{
+
+using Flow = InstructionInfo::Flow;
+
+const std::unordered_map<Symbol, InstructionInfo>& instructionTable()
+{
+  static const auto table = []
+  {
+    std::unordered_map<Symbol, InstructionInfo> t;
+
+    //NOTE: the operand bytes and opcodes are filled in from Opcodes below
+    auto add = [&t](std::string_view name, int pops, int pushes, Flow flow = Flow::Next)
+    {
+      t.emplace(Symbol{name}, InstructionInfo{0,
+          static_cast<std::int8_t>(pops),
+          static_cast<std::int8_t>(pushes),
+          flow});
+    };
+
+    //<x>load/<x>store with an index operand and their <x>load_<n> forms
+    auto addLocal = [&t](std::string_view name, int width, bool isStore)
+    {
+      int pops   = isStore ? width : 0;
+      int pushes = isStore ? 0 : width;
+
+      InstructionInfo info{0,
+          static_cast<std::int8_t>(pops), static_cast<std::int8_t>(pushes),
+          Flow::Next, InstructionInfo::Variable, static_cast<std::int8_t>(width), isStore};
+      t.emplace(Symbol{name}, info);
+
+      for(int n = 0; n <= 3; ++n)
+      {
+        info.ImplicitLocal = static_cast<std::int8_t>(n);
+        t.emplace(Symbol{fmt::format("{}_{}", name, n)}, info);
+      }
+    };
+
+    constexpr int V = InstructionInfo::Variable;
+
+    add("nop", 0, 0);
+    add("aconst_null", 0, 1);
+    for(auto name : {"iconst_m1", "iconst_0", "iconst_1", "iconst_2",
+                     "iconst_3", "iconst_4", "iconst_5",
+                     "fconst_0", "fconst_1", "fconst_2"})
+      add(name, 0, 1);
+    for(auto name : {"lconst_0", "lconst_1", "dconst_0", "dconst_1"})
+      add(name, 0, 2);
+
+    add("bipush", 0, 1);
+    add("sipush", 0, 1);
+    add("ldc",    0, 1);
+    add("ldc_w",  0, 1);
+    add("ldc2_w", 0, 2);
+
+    addLocal("iload", 1, false);
+    addLocal("lload", 2, false);
+    addLocal("fload", 1, false);
+    addLocal("dload", 2, false);
+    addLocal("aload", 1, false);
+    addLocal("istore", 1, true);
+    addLocal("lstore", 2, true);
+    addLocal("fstore", 1, true);
+    addLocal("dstore", 2, true);
+    addLocal("astore", 1, true);
+
+    for(auto name : {"iaload", "faload", "aaload", "baload", "caload", "saload"})
+      add(name, 2, 1);
+    add("laload", 2, 2);
+    add("daload", 2, 2);
+
+    for(auto name : {"iastore", "fastore", "aastore", "bastore", "castore", "sastore"})
+      add(name, 3, 0);
+    add("lastore", 4, 0);
+    add("dastore", 4, 0);
+
+    add("pop",     1, 0);
+    add("pop2",    2, 0);
+    add("dup",     1, 2);
+    add("dup_x1",  2, 3);
+    add("dup_x2",  3, 4);
+    add("dup2",    2, 4);
+    add("dup2_x1", 3, 5);
+    add("dup2_x2", 4, 6);
+    add("swap",    2, 2);
+
+    for(auto op : {"add", "sub", "mul", "div", "rem", "and", "or", "xor"})
+    {
+      add(fmt::format("i{}", op), 2, 1);
+      add(fmt::format("l{}", op), 4, 2);
+    }
+    for(auto op : {"add", "sub", "mul", "div", "rem"})
+    {
+      add(fmt::format("f{}", op), 2, 1);
+      add(fmt::format("d{}", op), 4, 2);
+    }
+    for(auto op : {"shl", "shr", "ushr"})
+    {
+      add(fmt::format("i{}", op), 2, 1);
+      add(fmt::format("l{}", op), 3, 2);
+    }
+    add("ineg", 1, 1);
+    add("lneg", 2, 2);
+    add("fneg", 1, 1);
+    add("dneg", 2, 2);
+
+    t.emplace(Symbol{"iinc"}, InstructionInfo{0, 0, 0, Flow::Next, V, 1, true});
+
+    add("i2l", 1, 2);
+    add("i2f", 1, 1);
+    add("i2d", 1, 2);
+    add("l2i", 2, 1);
+    add("l2f", 2, 1);
+    add("l2d", 2, 2);
+    add("f2i", 1, 1);
+    add("f2l", 1, 2);
+    add("f2d", 1, 2);
+    add("d2i", 2, 1);
+    add("d2l", 2, 2);
+    add("d2f", 2, 1);
+    add("i2b", 1, 1);
+    add("i2c", 1, 1);
+    add("i2s", 1, 1);
+
+    add("lcmp",  4, 1);
+    add("fcmpl", 2, 1);
+    add("fcmpg", 2, 1);
+    add("dcmpl", 4, 1);
+    add("dcmpg", 4, 1);
+
+    for(auto name : {"ifeq", "ifne", "iflt", "ifge", "ifgt", "ifle", "ifnull", "ifnonnull"})
+      add(name, 1, 0, Flow::Branch);
+    for(auto name : {"if_icmpeq", "if_icmpne", "if_icmplt", "if_icmpge",
+                     "if_icmpgt", "if_icmple", "if_acmpeq", "if_acmpne"})
+      add(name, 2, 0, Flow::Branch);
+
+    add("goto",   0, 0, Flow::Goto);
+    add("goto_w", 0, 0, Flow::Goto);
+    add("jsr",    0, 1, Flow::Jsr);
+    add("jsr_w",  0, 1, Flow::Jsr);
+    t.emplace(Symbol{"ret"}, InstructionInfo{0, 0, 0, Flow::Ret, V, 1, false});
+
+    add("tableswitch",  1, 0, Flow::Switch);
+    add("lookupswitch", 1, 0, Flow::Switch);
+
+    add("ireturn", 1, 0, Flow::Return);
+    add("lreturn", 2, 0, Flow::Return);
+    add("freturn", 1, 0, Flow::Return);
+    add("dreturn", 2, 0, Flow::Return);
+    add("areturn", 1, 0, Flow::Return);
+    add("return",  0, 0, Flow::Return);
+
+    for(auto name : {"getstatic", "putstatic", "getfield", "putfield",
+                     "invokevirtual", "invokespecial", "invokestatic"})
+      add(name, V, V);
+    add("invokeinterface", V, V);
+    add("invokedynamic",   V, V);
+
+    add("new",          0, 1);
+    add("newarray",     1, 1);
+    add("anewarray",    1, 1);
+    add("arraylength",  1, 1);
+    add("athrow",       1, 0, Flow::Throw);
+    add("checkcast",    1, 1);
+    add("instanceof",   1, 1);
+    add("monitorenter", 1, 0);
+    add("monitorexit",  1, 0);
+    add("multianewarray", V, 1);
+
+    //NOTE: the operand bytes of an explicit wide depend on the instruction it
+    //widens, see EncodedSize and CodeOffsets
+    add("wide", 0, 0);
+
+    //NOTE: the compile time assembler encodes from the same table, so the
+    //two cant disagree on the mnemonics or operand sizes
+    for(const Opcode& opcode : Opcodes)
+    {
+      auto it = t.find(Symbol{opcode.Mnemonic});
+      if(it == t.end())
+        throw std::logic_error{fmt::format("no stack effect for opcode '{}'", opcode.Mnemonic)};
+
+      it->second.OperandBytes = OperandBytes(opcode.Kind);
+      it->second.Code = opcode.Code;
+    }
+
+    if(t.size() != std::size(Opcodes))
+      throw std::logic_error{"instruction without an opcode"};
+
+    return t;
+  }();
+
+  return table;
+}
+
+std::runtime_error instructionError(const InstructionNode& node, std::string_view message)
+{
+  if(node.Args.empty())
+    return std::runtime_error{fmt::format(
+        "Assembler error: {} {}", node.Mnemonic.View(), message)};
+
+  const Token& token = node.Args.front();
+  return std::runtime_error{fmt::format("Assembler error: {} {} on line {} col {}",
+      node.Mnemonic.View(), message, token.Info.LineNumber, token.Info.LineOffset)};
+}
+
+std::int64_t intArg(const InstructionNode& node, size_t i)
+{
+  if(i >= node.Args.size())
+    throw instructionError(node, "is missing an operand");
+
+  auto value = node.Args[i].IntValue();
+  if(!value)
+    throw instructionError(node, fmt::format("operand {} must be an integer", i+1));
+
+  return *value;
+}
+
+std::string_view symbolArg(const InstructionNode& node, size_t i)
+{
+  if(i >= node.Args.size())
+    throw instructionError(node, "is missing an operand");
+
+  return node.Args[i].Value.View();
+}
+
+} //namespace: anonymous
+
+const InstructionInfo* LookupInstruction(Symbol mnemonic)
+{
+  const auto& table = instructionTable();
+
+  auto it = table.find(mnemonic);
+  return it == table.end() ? nullptr : &it->second;
+}
+
+const InstructionInfo& GetInstruction(const InstructionNode& node)
+{
+  const InstructionInfo* pInfo = LookupInstruction(node.Mnemonic);
+  if(!pInfo)
+    throw instructionError(node, "is not a supported instruction");
+
+  return *pInfo;
+}
+
+size_t SwitchPadding(size_t offset)
+{
+  return (4 - (offset + 1) % 4) % 4;
+}
+
+size_t EncodedSize(const InstructionNode& node, size_t offset, const ConstantPoolLayout* pPool)
+{
+  const InstructionInfo& info = GetInstruction(node);
+
+  //wide iinc adds 3 bytes to iinc, a wide load/store/ret 2
+  if(node.Mnemonic == "wide")
+    return 1 + 2;
+
+  //ldc may become ldc_w (or fold into a shorter instruction)
+  if(node.Mnemonic == "ldc")
+  {
+    if(!pPool)
+      return 3;
+
+    std::optional<Constant> constant = Constant::FromLoad(node);
+    return 1 + LookupInstruction(LowerConstantLoad(*constant, *pPool).Mnemonic)->OperandBytes;
+  }
+
+  if(info.ControlFlow == Flow::Switch)
+  {
+    auto pSwitch = dynamic_cast<const SwitchNode*>(&node);
+    if(!pSwitch)
+      throw instructionError(node, "has no case list");
+
+    //opcode, padding to a 4 byte boundary, then default + table/pairs
+    size_t padding = SwitchPadding(offset);
+    size_t cases = pSwitch->Cases.size();
+
+    if(node.Mnemonic == "tableswitch")
+      return 1 + padding + 12 + 4 * cases;
+
+    return 1 + padding + 8 + 8 * cases;
+  }
+
+  if(node.Mnemonic == "iinc")
+  {
+    std::int64_t index = intArg(node, 0);
+    std::int64_t increment = intArg(node, 1);
+
+    if(index > 0xFF || increment < -128 || increment > 127)
+      return 6; //wide iinc
+
+    return 3;
+  }
+
+  //locals past 255 need the wide prefix and a 2 byte index
+  if(info.LocalWidth != 0 && info.ImplicitLocal == InstructionInfo::Variable)
+    return intArg(node, 0) > 0xFF ? 4 : 2;
+
+  return 1 + info.OperandBytes;
+}
+
+std::vector<size_t> CodeOffsets(std::vector<NodePtr>::const_iterator begin,
+                                std::vector<NodePtr>::const_iterator end,
+                                const ConstantPoolLayout* pPool)
+{
+  std::vector<const InstructionNode*> instrs;
+  std::unordered_map<Symbol, size_t> labels;
+
+  for(auto it = begin; it != end; ++it)
+  {
+    if(auto pLabel = dynamic_cast<const LabelNode*>(it->get()))
+      labels[pLabel->LabelName] = instrs.size();
+    else if(auto pINode = dynamic_cast<const InstructionNode*>(it->get()))
+      instrs.push_back(pINode);
+  }
+
+  size_t n = instrs.size();
+
+  //an explicit wide and the instruction it widens are sized as one
+  auto isWide = [&instrs](size_t i) { return instrs[i]->Mnemonic == "wide"; };
+  for(size_t i = 0; i < n; ++i)
+  {
+    if(!isWide(i))
+      continue;
+
+    const InstructionInfo* pNext = i + 1 < n ? &GetInstruction(*instrs[i + 1]) : nullptr;
+    if(!pNext || pNext->LocalWidth == 0 || pNext->ImplicitLocal != InstructionInfo::Variable)
+      throw instructionError(*instrs[i], "must be followed by a load, store, iinc or ret");
+  }
+
+  //goto/jsr/if<cond> with a 2 byte offset that cant reach their target
+  std::vector<bool> isFar(n, false);
+  std::vector<size_t> offsets(n + 1);
+
+  //NOTE: widening a branch only ever moves code further apart, so this
+  //stops once a pass widens nothing
+  while(true)
+  {
+    size_t offset = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+      offsets[i] = offset;
+
+      const InstructionNode& node = *instrs[i];
+      Flow flow = GetInstruction(node).ControlFlow;
+
+      if(isWide(i))
+        offset += 1;
+      else if(i > 0 && isWide(i - 1))
+        offset += node.Mnemonic == "iinc" ? 5 : 3;
+      else if(isFar[i])
+        offset += flow == Flow::Branch ? 3 + 5 : 5;
+      else
+        offset += EncodedSize(node, offset, pPool);
+    }
+    offsets[n] = offset;
+
+    bool isWidened = false;
+    for(size_t i = 0; i < n; ++i)
+    {
+      const InstructionNode& node = *instrs[i];
+      const InstructionInfo& info = GetInstruction(node);
+
+      bool isShortBranch = info.OperandBytes == 2 &&
+          (info.ControlFlow == Flow::Branch || info.ControlFlow == Flow::Goto ||
+           info.ControlFlow == Flow::Jsr);
+      if(isFar[i] || !isShortBranch || node.Args.empty())
+        continue;
+
+      //NOTE: undefined labels are reported by the passes resolving them
+      auto it = labels.find(node.Args.front().Value);
+      if(it == labels.end())
+        continue;
+
+      auto distance = static_cast<std::int64_t>(offsets[it->second]) -
+                      static_cast<std::int64_t>(offsets[i]);
+      if(distance < -32768 || distance > 32767)
+        isFar[i] = isWidened = true;
+    }
+
+    if(!isWidened)
+      return offsets;
+  }
+}
+
+std::pair<int, int> StackEffect(const InstructionNode& node)
+{
+  const InstructionInfo& info = GetInstruction(node);
+
+  if(info.Pops != InstructionInfo::Variable && info.Pushes != InstructionInfo::Variable)
+    return {info.Pops, info.Pushes};
+
+  std::string_view mnemonic = node.Mnemonic.View();
+
+  if(mnemonic == "multianewarray")
+    return {static_cast<int>(intArg(node, 1)), 1};
+
+  bool isStaticField = mnemonic == "getstatic" || mnemonic == "putstatic";
+  bool isField = mnemonic == "getfield" || mnemonic == "putfield";
+
+  if(isStaticField || isField)
+  {
+    int fieldSlots = static_cast<int>(DescriptorSlots(symbolArg(node, 1)));
+    int receiver = isField ? 1 : 0;
+
+    if(mnemonic.front() == 'g')
+      return {receiver, fieldSlots};
+
+    return {receiver + fieldSlots, 0};
+  }
+
+  auto [argSlots, returnSlots] = MethodDescriptorSlots(symbolArg(node, 0));
+  int pops = static_cast<int>(argSlots);
+
+  //invokevirtual, invokespecial, invokeinterface also pop the receiver
+  if(mnemonic != "invokestatic" && mnemonic != "invokedynamic")
+    ++pops;
+
+  return {pops, static_cast<int>(returnSlots)};
+}
+
+std::vector<Symbol> BranchTargets(const InstructionNode& node)
+{
+  const InstructionInfo& info = GetInstruction(node);
+
+  switch(info.ControlFlow)
+  {
+    case Flow::Branch:
+    case Flow::Goto:
+    case Flow::Jsr:
+    {
+      //NOTE: the operand already is an interned symbol, dont look it up again
+      if(node.Args.empty())
+        throw instructionError(node, "is missing an operand");
+
+      return {node.Args.front().Value};
+    }
+
+    case Flow::Switch:
+    {
+      auto pSwitch = dynamic_cast<const SwitchNode*>(&node);
+      if(!pSwitch)
+        throw instructionError(node, "has no case list");
+
+      std::vector<Symbol> targets;
+      targets.reserve(pSwitch->Cases.size() + 1);
+
+      for(const auto& [key, label] : pSwitch->Cases)
+        targets.push_back(label);
+
+      targets.push_back(pSwitch->DefaultLabel);
+      return targets;
+    }
+
+    default:
+      return {};
+  }
+}
+
+bool FallsThrough(const InstructionNode& node)
+{
+  switch(GetInstruction(node).ControlFlow)
+  {
+    case Flow::Goto:
+    case Flow::Switch:
+    case Flow::Return:
+    case Flow::Throw:
+    case Flow::Ret:
+      return false;
+
+    default:
+      return true;
+  }
+}
+
+std::optional<unsigned> LocalSlot(const InstructionNode& node)
+{
+  const InstructionInfo& info = GetInstruction(node);
+
+  if(info.LocalWidth == 0)
+    return std::nullopt;
+
+  if(info.ImplicitLocal != InstructionInfo::Variable)
+    return static_cast<unsigned>(info.ImplicitLocal);
+
+  std::int64_t slot = intArg(node, 0);
+  if(slot < 0 || slot > 0xFFFF)
+    throw instructionError(node, "local variable index out of range");
+
+  return static_cast<unsigned>(slot);
+}
+
+unsigned DescriptorSlots(std::string_view descriptor)
+{
+  if(descriptor.empty())
+    throw std::runtime_error{"Assembler error: empty type descriptor"};
+
+  switch(descriptor.front())
+  {
+    case 'V': return 0;
+    case 'J':
+    case 'D': return 2;
+    default:  return 1;
+  }
+}
+
+std::string_view MethodDescriptorOf(std::string_view methodRef)
+{
+  size_t open = methodRef.find('(');
+  if(open == std::string_view::npos)
+    throw std::runtime_error{fmt::format(
+        "Assembler error: \"{}\" has no method descriptor", methodRef)};
+
+  return methodRef.substr(open);
+}
+
+std::vector<std::string_view> MethodParameters(std::string_view methodDescriptor)
+{
+  std::string_view descriptor = MethodDescriptorOf(methodDescriptor);
+
+  auto invalid = [&]()
+  {
+    return std::runtime_error{fmt::format(
+        "Assembler error: invalid method descriptor \"{}\"", descriptor)};
+  };
+
+  std::vector<std::string_view> params;
+  size_t i = 1;
+
+  while(i < descriptor.size() && descriptor[i] != ')')
+  {
+    size_t start = i;
+
+    while(i < descriptor.size() && descriptor[i] == '[')
+      ++i;
+
+    if(i >= descriptor.size())
+      throw invalid();
+
+    if(descriptor[i] == 'L')
+    {
+      i = descriptor.find(';', i);
+      if(i == std::string_view::npos)
+        throw invalid();
+    }
+
+    ++i;
+    params.push_back(descriptor.substr(start, i - start));
+  }
+
+  if(i >= descriptor.size())
+    throw invalid();
+
+  return params;
+}
+
+std::pair<unsigned, unsigned> MethodDescriptorSlots(std::string_view methodRef)
+{
+  std::string_view descriptor = MethodDescriptorOf(methodRef);
+
+  unsigned argSlots = 0;
+  for(std::string_view param : MethodParameters(descriptor))
+    argSlots += DescriptorSlots(param);
+
+  std::string_view returnType = descriptor.substr(descriptor.find(')') + 1);
+  return {argSlots, DescriptorSlots(returnType)};
+}
+
+} //namespace: Jasmin
@@ -0,0 +1,262 @@
+#include "Jasmin/JarWriter.hpp"
+#include "Jasmin/MappedFile.hpp"
+#include "Jasmin/Zip.hpp"
+
+#include <fmt/core.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace Jasmin
+{
+
+namespace
+{
+
+//every entry gets 1980-01-01 00:00 (the earliest dos date), real
+//timestamps would make every build differ
+constexpr std::uint16_t DosTime = 0;
+constexpr std::uint16_t DosDate = (1 << 5) | 1;
+
+constexpr std::string_view ManifestName = "META-INF/MANIFEST.MF";
+constexpr std::string_view Manifest = "Manifest-Version: 1.0\r\nCreated-By: Jasmin\r\n\r\n";
+
+std::runtime_error jarError(std::string_view message)
+{
+  return std::runtime_error{fmt::format("Jar error: {}", message)};
+}
+
+struct CompressedEntry
+{
+  std::uint16_t Method = Zip::MethodStored;
+  std::uint32_t Crc = 0;
+  size_t Size = 0;  //size in the JAR
+  std::string Data; //empty when stored, the entry contents are written then
+};
+
+CompressedEntry compress(std::string_view contents, int level)
+{
+  CompressedEntry entry;
+  entry.Crc = static_cast<std::uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(contents.data()),
+                                               static_cast<uInt>(contents.size())));
+  entry.Size = contents.size();
+  if(level == 0 || contents.empty())
+    return entry;
+
+  z_stream stream{};
+  if(deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    throw jarError("cant initialize zlib");
+
+  std::string out(deflateBound(&stream, static_cast<uLong>(contents.size())), '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(contents.data()));
+  stream.avail_in = static_cast<uInt>(contents.size());
+  stream.next_out = reinterpret_cast<Bytef*>(out.data());
+  stream.avail_out = static_cast<uInt>(out.size());
+
+  int result = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  if(result != Z_STREAM_END)
+    throw jarError("cant deflate entry");
+
+  //small entries (and already compressed data) can grow
+  if(out.size() < contents.size())
+  {
+    entry.Method = Zip::MethodDeflated;
+    entry.Size = out.size();
+    entry.Data = std::move(out);
+  }
+
+  return entry;
+}
+
+//runs func(0..count-1) on the calling thread and threads-1 workers, the
+//first exception is rethrown once all of them finished
+template<typename Func>
+void parallelFor(size_t count, unsigned threads, Func func)
+{
+  std::atomic<size_t> next{0};
+  std::vector<std::exception_ptr> errors(threads);
+
+  auto work = [&](unsigned worker)
+  {
+    try
+    {
+      for(size_t i = next++; i < count; i = next++)
+        func(i);
+    }
+    catch(...)
+    {
+      errors[worker] = std::current_exception();
+      next = count;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for(unsigned worker = 1; worker < threads; ++worker)
+    workers.emplace_back(work, worker);
+
+  work(0);
+  for(auto& thread : workers)
+    thread.join();
+
+  for(auto& error : errors)
+    if(error)
+      std::rethrow_exception(error);
+}
+
+void put16(std::string& out, std::uint16_t value)
+{
+  out += static_cast<char>(value & 0xFF);
+  out += static_cast<char>(value >> 8);
+}
+
+void put32(std::string& out, std::uint32_t value)
+{
+  put16(out, static_cast<std::uint16_t>(value & 0xFFFF));
+  put16(out, static_cast<std::uint16_t>(value >> 16));
+}
+
+std::uint32_t zipOffset(size_t offset)
+{
+  if(offset > 0xFFFFFFFF)
+    throw jarError("JAR past 4GB (zip64 isnt supported)");
+
+  return static_cast<std::uint32_t>(offset);
+}
+
+bool isAscii(std::string_view name)
+{
+  return std::all_of(name.begin(), name.end(),
+      [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+}
+
+//fields shared by the local and the central header, from "version needed"
+//up to the name length
+void putEntryFields(std::string& out, const JarEntry& entry, const CompressedEntry& compressed)
+{
+  put16(out, compressed.Method == Zip::MethodStored ? 10 : 20);
+  put16(out, isAscii(entry.Name) ? 0 : Zip::FlagUtf8Names);
+  put16(out, compressed.Method);
+  put16(out, DosTime);
+  put16(out, DosDate);
+  put32(out, compressed.Crc);
+  put32(out, zipOffset(compressed.Size));
+  put32(out, zipOffset(entry.Contents.size()));
+  put16(out, static_cast<std::uint16_t>(entry.Name.size()));
+}
+
+} //namespace: anonymous
+
+std::string BuildJar(std::vector<JarEntry> entries, const JarOptions& options)
+{
+  if(options.CompressionLevel < 0 || options.CompressionLevel > 9)
+    throw jarError(fmt::format("compression level {} isnt 0-9", options.CompressionLevel));
+
+  bool hasManifest = std::any_of(entries.begin(), entries.end(),
+      [](const JarEntry& entry) { return entry.Name == ManifestName; });
+  if(options.AddManifest && !hasManifest)
+    entries.push_back(JarEntry{std::string{ManifestName}, std::string{Manifest}});
+
+  //checked up front so errors dont depend on which worker gets there first.
+  //NOTE: 0xFFFF itself is the zip64 marker, readers (ClassPathIndex too)
+  //take a count of 65535 to mean the real one is in a zip64 record
+  if(entries.size() >= 0xFFFF)
+    throw jarError(fmt::format("{} entries (zip64 isnt supported)", entries.size()));
+
+  for(const JarEntry& entry : entries)
+  {
+    if(entry.Name.empty() || entry.Name.size() > 0xFFFF)
+      throw jarError("entry names must be 1-65535 bytes");
+    if(entry.Contents.size() > 0xFFFFFFFF)
+      throw jarError(fmt::format("{} is past 4GB (zip64 isnt supported)", entry.Name));
+  }
+
+  //the manifest first, where java.util.jar.JarInputStream looks for it
+  std::sort(entries.begin(), entries.end(), [](const JarEntry& a, const JarEntry& b)
+  {
+    return std::make_pair(a.Name != ManifestName, std::string_view{a.Name}) <
+           std::make_pair(b.Name != ManifestName, std::string_view{b.Name});
+  });
+
+  auto duplicate = std::adjacent_find(entries.begin(), entries.end(),
+      [](const JarEntry& a, const JarEntry& b) { return a.Name == b.Name; });
+  if(duplicate != entries.end())
+    throw jarError(fmt::format("duplicate entry {}", duplicate->Name));
+
+  unsigned threads = options.Threads ? options.Threads : std::thread::hardware_concurrency();
+  threads = static_cast<unsigned>(std::clamp<size_t>(threads, 1, std::max<size_t>(entries.size(), 1)));
+
+  std::vector<CompressedEntry> compressed(entries.size());
+  parallelFor(entries.size(), threads, [&](size_t i)
+  {
+    compressed[i] = compress(entries[i].Contents, options.CompressionLevel);
+  });
+
+  //NOTE: only the deflating above runs in parallel, the layout below is a
+  //single pass over the entries in their sorted order
+  size_t total = Zip::EndOfDirectorySize;
+  for(size_t i = 0; i < entries.size(); ++i)
+    total += Zip::LocalHeaderSize + Zip::CentralHeaderSize + 2 * entries[i].Name.size() +
+             compressed[i].Size;
+
+  std::string out;
+  out.reserve(total);
+
+  std::vector<std::uint32_t> offsets(entries.size());
+  for(size_t i = 0; i < entries.size(); ++i)
+  {
+    offsets[i] = zipOffset(out.size());
+
+    put32(out, Zip::LocalHeaderSignature);
+    putEntryFields(out, entries[i], compressed[i]);
+    put16(out, 0); //extra field length
+    out += entries[i].Name;
+    out += compressed[i].Method == Zip::MethodStored ? entries[i].Contents : compressed[i].Data;
+
+    //frees the memory as soon as the entry is in the JAR
+    compressed[i].Data = {};
+  }
+
+  size_t directoryOffset = out.size();
+  for(size_t i = 0; i < entries.size(); ++i)
+  {
+    put32(out, Zip::CentralHeaderSignature);
+    put16(out, 20); //version made by (2.0, ms-dos attributes)
+    putEntryFields(out, entries[i], compressed[i]);
+    put16(out, 0); //extra field length
+    put16(out, 0); //comment length
+    put16(out, 0); //disk number
+    put16(out, 0); //internal attributes
+    put32(out, 0); //external attributes
+    put32(out, offsets[i]);
+    out += entries[i].Name;
+  }
+
+  size_t directorySize = out.size() - directoryOffset;
+  put32(out, Zip::EndOfDirectorySignature);
+  put16(out, 0); //this disk
+  put16(out, 0); //disk with the central directory
+  put16(out, static_cast<std::uint16_t>(entries.size()));
+  put16(out, static_cast<std::uint16_t>(entries.size()));
+  put32(out, zipOffset(directorySize));
+  put32(out, zipOffset(directoryOffset));
+  put16(out, 0); //comment length
+
+  return out;
+}
+
+void WriteJar(const std::filesystem::path& path, std::vector<JarEntry> entries,
+              const JarOptions& options)
+{
+  WriteFileAtomically(path, BuildJar(std::move(entries), options));
+}
+
+} //namespace: Jasmin
@@ -4,6 +4,9 @@
 
 #include <fmt/core.h>
 
+#include <charconv>
+#include <limits>
+
 namespace Jasmin
 {
 
@@ -65,6 +68,39 @@ bool Token::IsDirective() const
   return this->Type >= TT::Catch && this->Type <= TT::Var;
 }
 
+std::optional<std::int64_t> Token::IntValue() const
+{
+  if(auto pInt = std::get_if<std::int32_t>(&Num))
+    return *pInt;
+
+  if(auto pLong = std::get_if<std::int64_t>(&Num))
+    return *pLong;
+
+  return std::nullopt;
+}
+
+std::optional<std::int32_t> Token::Int32Value() const
+{
+  if(auto pInt = std::get_if<std::int32_t>(&Num))
+    return *pInt;
+
+  //positive hex literals up to 0xFFFFFFFF are int bit patterns, like in java
+  auto pLong = std::get_if<std::int64_t>(&Num);
+  if(pLong && *pLong > 0 && *pLong <= std::numeric_limits<std::uint32_t>::max() &&
+     Value.View().substr(0, 2) == "0x")
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(*pLong));
+
+  return std::nullopt;
+}
+
+std::optional<double> Token::DecimalValue() const
+{
+  if(auto pDouble = std::get_if<double>(&Num))
+    return *pDouble;
+
+  return std::nullopt;
+}
+
 bool Lexer::HasMore() const
 {
   return !isEOF(peek());
@@ -74,6 +110,10 @@ Token Lexer::LexNext()
 {
   consumeWhitespaceAndComments();
 
+  //NOTE: token text can differ from its value (quotes, escapes, ".5"), so
+  //tokens are located by where they start rather than by their length
+  tokenStart = {CurrentLineNumber(), CurrentLineOffset(), CurrentFileOffset()};
+
   if(consumeNextCharIf('\n'))
     return makeToken(TT::Newline);
 
@@ -92,21 +132,29 @@ Token Lexer::LexNext()
     return lexString();
 
   if(consumeNextCharIf('-'))
-    return makeToken(TT::Minus);
+  {
+    if( isDigit(peek()) )
+      return lexNumber(true);
+    else
+      return makeToken(TT::Minus);
+  }
 
   if(isDigit(peek()))
-    return lexNumber();
+    return lexNumber(false);
 
   std::string tokenStr;
 
   while( !isWhitespace(peek()) && !isEOF(peek()) )
     tokenStr += get();
 
+  if(tokenStr.empty())
+    throw error(fmt::format("unexpected character '{}'", peek()));
+
   if(tokenStr == ":")
     return makeToken(TT::Colon);
 
   if(tokenStr.back() == ':')
-    return makeToken(TT::Label, std::move(tokenStr));
+    return makeToken(TT::Label, tokenStr);
 
   std::optional<Token> token = isKeywordToken(tokenStr);
   if(token)
@@ -116,21 +164,25 @@ Token Lexer::LexNext()
   //getting its opcode
   auto errOrOp = ClassFile::GetOpCode(tokenStr);
   if(!errOrOp.IsError())
-    return makeToken(TT::Instruction, std::move(tokenStr));
+    return makeToken(TT::Instruction, tokenStr);
 
-  return makeToken(TT::Symbol, std::move(tokenStr));
+  return makeToken(TT::Symbol, tokenStr);
 }
 
-std::vector<Token> Lexer::LexAll()
+template<typename Tokens>
+void Lexer::lexAll(Tokens& tokens)
 {
-  std::vector<Token> tokens;
-
   while(HasMore())
     tokens.emplace_back(LexNext());
 
-  if(tokens.back().Type != TT::Newline)
+  if(tokens.empty() || tokens.back().Type != TT::Newline)
     tokens.emplace_back(makeToken(TT::Newline));
+}
 
+std::vector<Token> Lexer::LexAll()
+{
+  std::vector<Token> tokens;
+  lexAll(tokens);
   return tokens;
 }
 
@@ -145,6 +197,24 @@ std::vector<Token> Lexer::LexAll(InStream&& in)
   return Lexer::LexAll(in);
 }
 
+std::pmr::vector<Token> Lexer::LexAll(std::pmr::memory_resource* pResource)
+{
+  std::pmr::vector<Token> tokens{pResource};
+  lexAll(tokens);
+  return tokens;
+}
+
+std::pmr::vector<Token> Lexer::LexAll(InStream& in, std::pmr::memory_resource* pResource)
+{
+  Lexer lexer{in};
+  return lexer.LexAll(pResource);
+}
+
+std::pmr::vector<Token> Lexer::LexAll(InStream&& in, std::pmr::memory_resource* pResource)
+{
+  return Lexer::LexAll(in, pResource);
+}
+
 Lexer::Lexer(InStream in)
 : inputStream{in}
 {
@@ -200,7 +270,7 @@ Token Lexer::lexDirective()
   if(it == directiveTokenMap.end())
     throw error(fmt::format("invalid directive name \"{}\"", dirName));
 
-  return makeToken(it->second);
+  return makeToken(it->second, dirName);
 }
 
 Token Lexer::lexString()
@@ -229,7 +299,7 @@ Token Lexer::lexString()
 
   get(); 
 
-  return makeToken(TT::String, std::move(str));
+  return makeToken(TT::String, str);
 }
 
 Token Lexer::lexDecimal( std::string integerPart )
@@ -249,21 +319,37 @@ Token Lexer::lexDecimal( std::string integerPart )
   decimalStr += '.';
   decimalStr += std::move(fractionPart);
 
-  return makeToken(TT::Decimal, std::move(decimalStr));
+  lexExponent(decimalStr);
+
+  return makeDecimalToken(decimalStr);
 }
 
-Token Lexer::lexNumber()
+void Lexer::lexExponent(std::string& decimalStr)
 {
-  std::string integerStr;
+  if(peek() != 'e' && peek() != 'E')
+    return;
+
+  decimalStr += get();
+
+  if(peek() == '+' || peek() == '-')
+    decimalStr += get();
+
+  ensureNextChar(isDigit, "exponent must have digits");
+
+  while( isDigit(peek()) )
+    decimalStr += get();
+}
+
+Token Lexer::lexNumber(bool negative)
+{
+  std::string integerStr = negative ? "-" : "";
 
   if(consumeNextCharIf('0'))
   {
     integerStr += '0';
 
-    if(consumeNextCharIf('x'))
-      integerStr += 'x';
-    else if(consumeNextCharIf('.'))
-      return lexDecimal("0");
+    if(consumeNextCharIf('x') || consumeNextCharIf('X'))
+      return lexHexNumber(negative);
 
     if(peek() == '0')
       throw error("double zero encountered in integer");
@@ -272,10 +358,93 @@ Token Lexer::lexNumber()
   while( isDigit(peek()) )
     integerStr += get();
 
-  if(integerStr.empty())
+  if(integerStr.empty() || integerStr == "-")
     throw logicError("lexNumber() called but no digits consumed");
 
-  return makeToken(TT::Integer, std::move(integerStr));
+  if(consumeNextCharIf('.'))
+    return lexDecimal(std::move(integerStr));
+
+  if(peek() == 'e' || peek() == 'E')
+  {
+    lexExponent(integerStr);
+    return makeDecimalToken(integerStr);
+  }
+
+  std::int64_t value = 0;
+  auto [end, ec] = std::from_chars(
+      integerStr.data(), integerStr.data() + integerStr.size(), value);
+
+  if(ec == std::errc::result_out_of_range)
+    throw error(fmt::format("integer {} out of range", integerStr));
+
+  if(ec != std::errc{} || end != integerStr.data() + integerStr.size())
+    throw logicError(fmt::format("failed to convert integer {}", integerStr));
+
+  return makeToken(TT::Integer, integerStr, narrowInteger(value));
+}
+
+//NOTE: assumes the "0x" prefix has already been consumed. the value is the
+//magnitude as written (0xFFFFFFFF is 4294967295), Token::Int32Value applies
+//javas int bit pattern reading (-1) where an int is expected
+Token Lexer::lexHexNumber(bool negative)
+{
+  std::string digits;
+  while( isHexDigit(peek()) )
+    digits += get();
+
+  if(digits.empty())
+    throw error("invalid hex integer with no digits");
+
+  std::string hexStr = fmt::format("{}0x{}", negative ? "-" : "", digits);
+
+  std::uint64_t magnitude = 0;
+  auto [end, ec] = std::from_chars(
+      digits.data(), digits.data() + digits.size(), magnitude, 16);
+
+  if(ec == std::errc::result_out_of_range)
+    throw error(fmt::format("integer {} out of range", hexStr));
+
+  if(ec != std::errc{} || end != digits.data() + digits.size())
+    throw logicError(fmt::format("failed to convert integer {}", hexStr));
+
+  if(!negative)
+  {
+    if(magnitude > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()))
+      throw error(fmt::format("integer {} out of range", hexStr));
+
+    return makeToken(TT::Integer, hexStr, narrowInteger(static_cast<std::int64_t>(magnitude)));
+  }
+
+  if(magnitude > std::uint64_t{1} << 63)
+    throw error(fmt::format("integer {} out of range", hexStr));
+
+  //NOTE: negate in unsigned arithmetic so -0x8000000000000000 doesnt overflow
+  return makeToken(TT::Integer, hexStr, 
+      narrowInteger(static_cast<std::int64_t>(~magnitude + 1)));
+}
+
+Token Lexer::makeDecimalToken(std::string_view decimalStr) const
+{
+  double value = 0;
+  auto [end, ec] = std::from_chars(
+      decimalStr.data(), decimalStr.data() + decimalStr.size(), value);
+
+  if(ec == std::errc::result_out_of_range)
+    throw error(fmt::format("decimal {} out of range", decimalStr));
+
+  if(ec != std::errc{} || end != decimalStr.data() + decimalStr.size())
+    throw logicError(fmt::format("failed to convert decimal {}", decimalStr));
+
+  return makeToken(TT::Decimal, decimalStr, value);
+}
+
+Token::Number Lexer::narrowInteger(std::int64_t value)
+{
+  if(value >= std::numeric_limits<std::int32_t>::min() && 
+     value <= std::numeric_limits<std::int32_t>::max())
+    return static_cast<std::int32_t>(value);
+
+  return value;
 }
 
 std::optional<Token> Lexer::isKeywordToken(std::string_view keywordStr)
@@ -321,17 +490,14 @@ void Lexer::consumeWhitespaceAndComments()
 }
 
 
-Token Lexer::makeToken(TT type, std::string val) const
+Token Lexer::makeToken(TT type, std::string_view val, Token::Number num) const
 {
   return Token
   {
     type, 
-    std::move(val), 
-    {
-      this->CurrentLineNumber(),
-      static_cast<unsigned short>(this->CurrentLineOffset() - val.length()),
-      static_cast<unsigned int>  (this->CurrentFileOffset() - val.length())
-    }
+    Symbol{val}, 
+    num,
+    tokenStart
   };
 }
 
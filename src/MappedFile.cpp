@@ -0,0 +1,106 @@
+#include "Jasmin/MappedFile.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JASMIN_HAS_MMAP 1
+#endif
+
+namespace Jasmin
+{
+
+MappedFile MappedFile::Open(const std::filesystem::path& path)
+{
+#ifdef JASMIN_HAS_MMAP
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+    throw std::runtime_error{fmt::format("cant open '{}'", path.string())};
+
+  struct stat st;
+  if(::fstat(fd, &st) != 0)
+  {
+    ::close(fd);
+    throw std::runtime_error{fmt::format("cant stat '{}'", path.string())};
+  }
+
+  size_t size = static_cast<size_t>(st.st_size);
+
+  //NOTE: mapping 0 bytes fails
+  if(size == 0)
+  {
+    ::close(fd);
+    return MappedFile{};
+  }
+
+  void* pMapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if(pMapped == MAP_FAILED)
+    throw std::runtime_error{fmt::format("cant map '{}'", path.string())};
+
+  std::shared_ptr<const void> mapping{pMapped, [size](const void* p)
+  {
+    ::munmap(const_cast<void*>(p), size);
+  }};
+
+  return MappedFile{std::move(mapping), std::string_view{static_cast<const char*>(pMapped), size}};
+#else
+  std::ifstream in{path, std::ios::binary};
+  if(!in)
+    throw std::runtime_error{fmt::format("cant open '{}'", path.string())};
+
+  auto pBuffer = std::make_shared<std::string>(std::istreambuf_iterator<char>{in},
+                                               std::istreambuf_iterator<char>{});
+  std::string_view data = *pBuffer;
+  return MappedFile{std::move(pBuffer), data};
+#endif
+}
+
+void WriteFileAtomically(const std::filesystem::path& path, std::string_view contents)
+{
+  //NOTE: the temporary name has to be unique, other processes may be
+  //writing the same file (e.g. refreshing the same cache entry) at once
+  std::random_device random;
+  std::uint64_t suffix = std::uint64_t{random()} << 32 | random();
+
+  std::filesystem::path tmpPath = path;
+#ifdef JASMIN_HAS_MMAP
+  tmpPath += fmt::format(".{}.{:016x}.tmp", ::getpid(), suffix);
+#else
+  tmpPath += fmt::format(".{:016x}.tmp", suffix);
+#endif
+
+  std::error_code ec;
+
+  {
+    std::ofstream out{tmpPath, std::ios::binary | std::ios::trunc};
+    out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    out.close();
+
+    if(!out)
+    {
+      std::filesystem::remove(tmpPath, ec);
+      throw std::runtime_error{fmt::format("cant write '{}'", tmpPath.string())};
+    }
+  }
+
+  std::filesystem::rename(tmpPath, path, ec);
+  if(ec)
+  {
+    std::filesystem::remove(tmpPath, ec);
+    throw std::runtime_error{fmt::format("cant replace '{}'", path.string())};
+  }
+}
+
+} //namespace: Jasmin
@@ -0,0 +1,1079 @@
+#include "Jasmin/MethodSplitter.hpp"
+#include "Jasmin/ControlFlowGraph.hpp"
+#include "Jasmin/Instructions.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace Jasmin
+{
+
+namespace
+{
+
+constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+DUnimplemented* asDirective(const NodePtr& pNode, std::string_view name)
+{
+  auto pDir = dynamic_cast<DUnimplemented*>(pNode.get());
+  return pDir && pDir->DirectiveName == name ? pDir : nullptr;
+}
+
+//the last symbol argument of a directive, e.g. the name of .class/.method
+Symbol lastSymbolArg(const DUnimplemented& dir)
+{
+  for(auto it = dir.Args.rbegin(); it != dir.Args.rend(); ++it)
+    if(it->Type == TT::Symbol)
+      return it->Value;
+
+  return Symbol{};
+}
+
+//the argument following a keyword argument, e.g. the label after "from"
+const Token* argAfter(const DUnimplemented& dir, std::string_view keyword, size_t skip = 0)
+{
+  for(size_t i = 0; i + 1 + skip < dir.Args.size(); ++i)
+    if(dir.Args[i].Type == TT::Symbol && dir.Args[i].Value == keyword)
+      return &dir.Args[i + 1 + skip];
+
+  return nullptr;
+}
+
+Token makeIntArg(std::int32_t value, const Token::MetaInfo& info)
+{
+  return Token{TT::Integer, Symbol{std::to_string(value)}, value, info};
+}
+
+Token makeSymbolArg(std::string_view value)
+{
+  return Token{TT::Symbol, Symbol{value}, {}, {0, 0, 0}};
+}
+
+NodePtr makeDirective(std::string_view name, std::pmr::vector<Token> args)
+{
+  auto pDir = std::make_unique<DUnimplemented>();
+  pDir->DirectiveName = Symbol{name};
+  pDir->Args = std::move(args);
+  return pDir;
+}
+
+NodePtr makeInstruction(std::string_view mnemonic, std::pmr::vector<Token> args = {})
+{
+  auto pINode = std::make_unique<InstructionNode>();
+  pINode->Mnemonic = Symbol{mnemonic};
+  pINode->Args = std::move(args);
+  return pINode;
+}
+
+NodePtr makeLabel(Symbol name)
+{
+  auto pLNode = std::make_unique<LabelNode>();
+  pLNode->LabelName = name;
+  return pLNode;
+}
+
+//the verifier treats boolean/byte/char/short locals as ints
+std::string verifierType(std::string_view descriptor)
+{
+  switch(descriptor.front())
+  {
+    case 'Z': case 'B': case 'C': case 'S': return "I";
+    default: return std::string{descriptor};
+  }
+}
+
+std::string classDescriptor(std::string_view className)
+{
+  if(!className.empty() && className.front() == '[')
+    return std::string{className};
+
+  return fmt::format("L{};", className);
+}
+
+std::string_view returnInstruction(std::string_view returnType)
+{
+  switch(returnType.front())
+  {
+    case 'V': return "return";
+    case 'J': return "lreturn";
+    case 'F': return "freturn";
+    case 'D': return "dreturn";
+    case 'L': case '[': return "areturn";
+    default:  return "ireturn";
+  }
+}
+
+std::string_view loadPrefix(std::string_view type)
+{
+  switch(type.front())
+  {
+    case 'J': return "l";
+    case 'F': return "f";
+    case 'D': return "d";
+    case 'L': case '[': return "a";
+    default:  return "i";
+  }
+}
+
+//xload_<n> for n <= 3, otherwise xload n
+NodePtr makeLocalInstruction(std::string_view base, unsigned slot, const Token::MetaInfo& info)
+{
+  if(slot <= 3)
+    return makeInstruction(fmt::format("{}_{}", base, slot));
+
+  return makeInstruction(base, {makeIntArg(static_cast<std::int32_t>(slot), info)});
+}
+
+struct Method
+{
+  NodePtr Header;
+  std::vector<NodePtr> Body;
+  NodePtr End;
+
+  const DUnimplemented& HeaderDirective() const
+  {
+    return static_cast<const DUnimplemented&>(*Header);
+  }
+
+  std::string_view NameAndDescriptor() const
+  {
+    return lastSymbolArg(HeaderDirective()).View();
+  }
+
+  std::string_view Name() const
+  {
+    std::string_view nameAndDesc = NameAndDescriptor();
+    return nameAndDesc.substr(0, nameAndDesc.find('('));
+  }
+
+  bool IsStatic() const
+  {
+    for(const auto& arg : HeaderDirective().Args)
+      if(arg.Type == TT::Static)
+        return true;
+
+    return false;
+  }
+};
+
+struct CatchRange
+{
+  const Node* Directive;
+  size_t From, To, Handler;
+};
+
+//instruction level view of a method body. positions are instruction
+//indices, a label refers to the instruction following it
+struct MethodAnalysis
+{
+  std::vector<InstructionNode*> Instrs;
+  std::vector<size_t> BodyPos;
+  std::vector<size_t> Offsets;
+  std::vector<bool> IsBranchTarget;
+  std::unordered_map<Symbol, size_t> Labels;
+  std::vector<CatchRange> Catches;
+  std::vector<int> Depths;
+  bool UsesSubroutines = false;
+
+  //slots definitely assigned on entry to each block (on every path from
+  //the method entry, empty for unreachable blocks), the first store of each
+  //slot stored in a block ({slot, instruction}) and the block of every
+  //instruction, see IsAssignedBefore
+  std::vector<std::vector<bool>> BlockAssigned;
+  std::vector<std::vector<std::pair<unsigned, size_t>>> BlockFirstStores;
+  std::vector<size_t> BlockOf;
+
+  bool IsAssignedBefore(unsigned slot, size_t i) const
+  {
+    const std::vector<bool>& assigned = BlockAssigned[BlockOf[i]];
+    if(slot < assigned.size() && assigned[slot])
+      return true;
+
+    for(const auto& [storedSlot, at] : BlockFirstStores[BlockOf[i]])
+      if(storedSlot == slot)
+        return at < i;
+
+    return false;
+  }
+
+  size_t CodeSize() const { return Offsets.back(); }
+
+  size_t LabelIndex(Symbol label) const
+  {
+    auto it = Labels.find(label);
+    if(it == Labels.end())
+      throw std::runtime_error{fmt::format(
+          "Assembler error: undefined label \"{}\"", label.View())};
+
+    return it->second;
+  }
+};
+
+//stack depth before every reachable instruction, propagated block by block
+//(handlers start with the exception on the stack)
+void computeDepths(MethodAnalysis& a, const ControlFlowGraph& cfg,
+                   const std::vector<size_t>& instrAt)
+{
+  using BlockId = ControlFlowGraph::BlockId;
+
+  size_t n = a.Instrs.size();
+  a.Depths.assign(n + 1, -1);
+
+  std::vector<int> entryDepths(cfg.BlockCount(), -1);
+  std::vector<BlockId> work;
+
+  auto reach = [&](BlockId block, int depth)
+  {
+    if(entryDepths[block] == -1)
+    {
+      entryDepths[block] = depth;
+      work.push_back(block);
+    }
+    else if(entryDepths[block] != depth)
+    {
+      throw std::runtime_error{fmt::format(
+          "Assembler error: inconsistent stack depth at {} ({} vs {})",
+          a.Instrs[instrAt[cfg.BlockBegin(block)]]->Mnemonic.View(), entryDepths[block], depth)};
+    }
+  };
+
+  if(cfg.BlockCount() > 0)
+    reach(0, 0);
+
+  while(!work.empty())
+  {
+    BlockId block = work.back();
+    work.pop_back();
+
+    int depth = entryDepths[block];
+
+    for(size_t i = instrAt[cfg.BlockBegin(block)]; i < instrAt[cfg.BlockEnd(block)]; ++i)
+    {
+      const InstructionNode& node = *a.Instrs[i];
+      auto [pops, pushes] = StackEffect(node);
+
+      a.Depths[i] = depth;
+      depth -= pops;
+      if(depth < 0)
+        throw std::runtime_error{fmt::format(
+            "Assembler error: stack underflow at {}", node.Mnemonic.View())};
+
+      depth += pushes;
+    }
+
+    for(BlockId successor : cfg.Successors(block))
+      reach(successor, depth);
+
+    for(BlockId handler : cfg.Handlers(block))
+      reach(handler, 1);
+  }
+}
+
+//slots written by the instruction, iinc needs its slot assigned already
+std::pair<unsigned, unsigned> storedSlots(const InstructionNode& node)
+{
+  const InstructionInfo& info = GetInstruction(node);
+  if(!info.IsLocalStore || node.Mnemonic == "iinc")
+    return {0, 0};
+
+  return {*LocalSlot(node), static_cast<unsigned>(info.LocalWidth)};
+}
+
+//definite assignment: the slots assigned on entry to a block are the
+//intersection over its predecessors (parameters at the method entry). a
+//handler can be entered from anywhere in the blocks it protects, so it gets
+//the intersection of their entry states (stores only add to those)
+void computeAssigned(MethodAnalysis& a, const ControlFlowGraph& cfg,
+                     const std::vector<size_t>& instrAt, unsigned paramSlots)
+{
+  using BlockId = ControlFlowGraph::BlockId;
+
+  a.BlockAssigned.assign(cfg.BlockCount(), {});
+  a.BlockFirstStores.assign(cfg.BlockCount(), {});
+  a.BlockOf.resize(a.Instrs.size());
+
+  for(BlockId block = 0; block < cfg.BlockCount(); ++block)
+  {
+    auto& firstStores = a.BlockFirstStores[block];
+
+    for(size_t i = instrAt[cfg.BlockBegin(block)]; i < instrAt[cfg.BlockEnd(block)]; ++i)
+    {
+      a.BlockOf[i] = block;
+
+      auto [slot, width] = storedSlots(*a.Instrs[i]);
+      for(unsigned stored = slot; stored < slot + width; ++stored)
+      {
+        bool isStored = std::any_of(firstStores.begin(), firstStores.end(),
+            [stored](const auto& store) { return store.first == stored; });
+        if(!isStored)
+          firstStores.emplace_back(stored, i);
+      }
+    }
+  }
+
+  std::vector<BlockId> work;
+  std::vector<bool> queued(cfg.BlockCount(), false);
+  std::vector<bool> visited(cfg.BlockCount(), false);
+
+  auto meet = [&](BlockId block, const std::vector<bool>& state)
+  {
+    std::vector<bool>& in = a.BlockAssigned[block];
+    bool changed = !visited[block];
+
+    if(!visited[block])
+    {
+      in = state;
+      visited[block] = true;
+    }
+    else
+    {
+      if(in.size() > state.size())
+        in.resize(state.size());
+
+      for(size_t slot = 0; slot < in.size(); ++slot)
+      {
+        if(in[slot] && !state[slot])
+        {
+          in[slot] = false;
+          changed = true;
+        }
+      }
+    }
+
+    if(changed && !queued[block])
+    {
+      queued[block] = true;
+      work.push_back(block);
+    }
+  };
+
+  if(cfg.BlockCount() > 0)
+    meet(0, std::vector<bool>(paramSlots, true));
+
+  while(!work.empty())
+  {
+    BlockId block = work.back();
+    work.pop_back();
+    queued[block] = false;
+
+    std::vector<bool> state = a.BlockAssigned[block];
+    for(BlockId handler : cfg.Handlers(block))
+      meet(handler, state);
+
+    for(const auto& [slot, at] : a.BlockFirstStores[block])
+    {
+      if(slot >= state.size())
+        state.resize(slot + 1, false);
+      state[slot] = true;
+    }
+
+    for(BlockId successor : cfg.Successors(block))
+      meet(successor, state);
+  }
+}
+
+unsigned parameterSlots(const Method& method)
+{
+  unsigned slots = method.IsStatic() ? 0 : 1;
+  for(std::string_view param : MethodParameters(method.NameAndDescriptor()))
+    slots += DescriptorSlots(param);
+
+  return slots;
+}
+
+MethodAnalysis analyze(const Method& method)
+{
+  MethodAnalysis a;
+  std::vector<const DUnimplemented*> catches;
+
+  for(size_t pos = 0; pos < method.Body.size(); ++pos)
+  {
+    const NodePtr& pNode = method.Body[pos];
+
+    if(auto pINode = dynamic_cast<InstructionNode*>(pNode.get()))
+    {
+      auto flow = GetInstruction(*pINode).ControlFlow;
+      if(flow == InstructionInfo::Flow::Jsr || flow == InstructionInfo::Flow::Ret)
+        a.UsesSubroutines = true;
+
+      a.Instrs.push_back(pINode);
+      a.BodyPos.push_back(pos);
+    }
+    else if(auto pLNode = dynamic_cast<LabelNode*>(pNode.get()))
+    {
+      a.Labels[pLNode->LabelName] = a.Instrs.size();
+    }
+    else if(auto pCatch = asDirective(pNode, "catch"))
+    {
+      catches.push_back(pCatch);
+    }
+  }
+
+  //NOTE: the pool isnt laid out yet, so ldc is sized as ldc_w
+  a.Offsets = CodeOffsets(method.Body.begin(), method.Body.end());
+
+  a.IsBranchTarget.assign(a.Instrs.size() + 1, false);
+  for(const auto& [label, index] : a.Labels)
+    a.IsBranchTarget[index] = true;
+
+  for(const DUnimplemented* pCatch : catches)
+  {
+    const Token* pFrom = argAfter(*pCatch, "from");
+    const Token* pTo = argAfter(*pCatch, "to");
+    const Token* pUsing = argAfter(*pCatch, "using");
+
+    if(!pFrom || !pTo || !pUsing)
+      throw std::runtime_error{"Assembler error: .catch expects from, to and using labels"};
+
+    a.Catches.push_back({pCatch, a.LabelIndex(pFrom->Value),
+        a.LabelIndex(pTo->Value), a.LabelIndex(pUsing->Value)});
+  }
+
+  if(a.UsesSubroutines)
+    return a;
+
+  ControlFlowGraph cfg{method.Body.begin(), method.Body.end()};
+
+  //index of the first instruction at or after each body position
+  size_t n = a.Instrs.size();
+  std::vector<size_t> instrAt(method.Body.size() + 1, n);
+  for(size_t pos = method.Body.size(), next = n; pos-- > 0;)
+  {
+    if(next > 0 && a.BodyPos[next - 1] == pos)
+      --next;
+    instrAt[pos] = next;
+  }
+
+  computeDepths(a, cfg, instrAt);
+  computeAssigned(a, cfg, instrAt, parameterSlots(method));
+
+  return a;
+}
+
+//verifier type of each local slot, AssignedAt is the instruction index of
+//its first store (0 for parameters) and ConflictAt the first store that
+//gives it a different type. an empty type means it couldnt be inferred
+struct LocalType
+{
+  std::string Type;
+  size_t AssignedAt = npos;
+  size_t ConflictAt = npos;
+};
+
+//reference type on top of the stack after instruction i, or "" if unknown
+std::string producedReference(const MethodAnalysis& a, size_t i,
+                              const std::vector<LocalType>& locals)
+{
+  const InstructionNode& node = *a.Instrs[i];
+  std::string_view mnemonic = node.Mnemonic.View();
+
+  auto arg = [&node](size_t n) -> std::string_view
+  {
+    return n < node.Args.size() ? node.Args[n].Value.View() : std::string_view{};
+  };
+
+  auto isReference = [](std::string_view type)
+  {
+    return !type.empty() && (type.front() == 'L' || type.front() == '[');
+  };
+
+  if(mnemonic == "new" || mnemonic == "checkcast")
+    return arg(0).empty() ? "" : classDescriptor(arg(0));
+
+  if(mnemonic == "anewarray")
+    return arg(0).empty() ? "" : "[" + classDescriptor(arg(0));
+
+  if(mnemonic == "newarray")
+  {
+    static const std::map<std::string_view, std::string_view> arrayTypes =
+    {
+      {"boolean", "[Z"}, {"char", "[C"}, {"float", "[F"}, {"double", "[D"},
+      {"byte",    "[B"}, {"short","[S"}, {"int",   "[I"}, {"long",   "[J"},
+    };
+
+    auto it = arrayTypes.find(arg(0));
+    return it == arrayTypes.end() ? "" : std::string{it->second};
+  }
+
+  if(mnemonic == "multianewarray")
+    return std::string{arg(0)};
+
+  if(mnemonic == "ldc" || mnemonic == "ldc_w")
+  {
+    if(node.Args.empty())
+      return "";
+    if(node.Args.front().Type == TT::String)
+      return "Ljava/lang/String;";
+    if(node.Args.front().Type == TT::Symbol)
+      return "Ljava/lang/Class;";
+    return "";
+  }
+
+  if(mnemonic == "getstatic" || mnemonic == "getfield")
+    return isReference(arg(1)) ? std::string{arg(1)} : "";
+
+  //new X, dup, <args>, invokespecial X/<init> leaves the initialized X
+  if(mnemonic == "invokespecial" && !arg(0).empty())
+  {
+    std::string_view methodRef = arg(0).substr(0, arg(0).find('('));
+    size_t slash = methodRef.rfind('/');
+
+    if(slash != std::string_view::npos && methodRef.substr(slash + 1) == "<init>")
+      return classDescriptor(methodRef.substr(0, slash));
+  }
+
+  if(mnemonic.substr(0, 6) == "invoke" && !arg(0).empty())
+  {
+    std::string_view descriptor = MethodDescriptorOf(arg(0));
+    std::string_view returnType = descriptor.substr(descriptor.find(')') + 1);
+    return isReference(returnType) ? std::string{returnType} : "";
+  }
+
+  if(mnemonic.substr(0, 5) == "aload")
+  {
+    unsigned slot = *LocalSlot(node);
+    if(slot < locals.size() && locals[slot].AssignedAt < i && locals[slot].ConflictAt > i)
+      return locals[slot].Type;
+  }
+
+  return "";
+}
+
+std::vector<LocalType> inferLocals(const Method& method, const MethodAnalysis& a,
+                                   std::string_view className)
+{
+  std::vector<LocalType> locals;
+
+  auto assign = [&locals](unsigned slot, std::string type, unsigned width, size_t at)
+  {
+    if(locals.size() < slot + 2)
+      locals.resize(slot + 2);
+
+    LocalType& local = locals[slot];
+    if(local.AssignedAt == npos)
+    {
+      local.Type = std::move(type);
+      local.AssignedAt = at;
+    }
+    else if(local.Type != type || type.empty())
+    {
+      local.ConflictAt = std::min(local.ConflictAt, at);
+    }
+
+    //the second half of a long/double cant be read on its own
+    if(width == 2)
+      locals[slot + 1].ConflictAt = std::min(locals[slot + 1].ConflictAt, at);
+  };
+
+  //.var <slot> is <name> <descriptor> ...
+  std::map<unsigned, std::string> declared;
+  for(const auto& pNode : method.Body)
+  {
+    auto pVar = asDirective(pNode, "var");
+    if(!pVar || pVar->Args.empty() || !pVar->Args.front().IntValue())
+      continue;
+
+    const Token* pDescriptor = argAfter(*pVar, "is", 1);
+    if(!pDescriptor)
+      continue;
+
+    unsigned slot = static_cast<unsigned>(*pVar->Args.front().IntValue());
+    auto [it, isNew] = declared.emplace(slot, pDescriptor->Value.Str());
+    if(!isNew && it->second != pDescriptor->Value.View())
+      it->second.clear();
+  }
+
+  unsigned slot = 0;
+  if(!method.IsStatic())
+    assign(slot++, classDescriptor(className), 1, 0);
+
+  for(std::string_view param : MethodParameters(method.NameAndDescriptor()))
+  {
+    unsigned width = DescriptorSlots(param);
+    assign(slot, verifierType(param), width, 0);
+    slot += width;
+  }
+
+  for(size_t i = 0; i < a.Instrs.size(); ++i)
+  {
+    const InstructionNode& node = *a.Instrs[i];
+    const InstructionInfo& info = GetInstruction(node);
+
+    if(!info.IsLocalStore)
+      continue;
+
+    unsigned storeSlot = *LocalSlot(node);
+    std::string_view mnemonic = node.Mnemonic.View();
+    std::string type;
+
+    switch(mnemonic.front())
+    {
+      case 'i': type = "I"; break; //istore and iinc
+      case 'l': type = "J"; break;
+      case 'f': type = "F"; break;
+      case 'd': type = "D"; break;
+      case 'a':
+      {
+        if(i > 0 && !a.IsBranchTarget[i])
+          type = producedReference(a, i - 1, locals);
+
+        auto it = declared.find(storeSlot);
+        if(type.empty() && it != declared.end())
+          type = it->second;
+
+        break;
+      }
+    }
+
+    assign(storeSlot, std::move(type), static_cast<unsigned>(info.LocalWidth), i);
+  }
+
+  return locals;
+}
+
+struct SplitPoint
+{
+  size_t Index = npos;
+  std::vector<unsigned> Passed; //slots passed to the helper, in order
+};
+
+bool reads(const InstructionNode& node, const InstructionInfo& info)
+{
+  return info.LocalWidth != 0 && (!info.IsLocalStore || node.Mnemonic == "iinc");
+}
+
+size_t callSequenceSize(const std::vector<unsigned>& passed)
+{
+  size_t size = 3 + 1; //invokestatic + return
+
+  for(unsigned slot : passed)
+    size += slot <= 3 ? 1 : slot <= 0xFF ? 2 : 4;
+
+  return size;
+}
+
+SplitPoint findSplitPoint(const Method& method, const MethodAnalysis& a,
+                          const std::vector<LocalType>& locals, size_t maxCodeSize)
+{
+  size_t n = a.Instrs.size();
+
+  //furthest branch target from before i / nearest branch target from i on
+  std::vector<size_t> headMaxTarget(n + 1, 0);
+  std::vector<size_t> tailMinTarget(n + 1, npos);
+
+  for(size_t i = 0; i < n; ++i)
+  {
+    headMaxTarget[i + 1] = headMaxTarget[i];
+    for(Symbol target : BranchTargets(*a.Instrs[i]))
+      headMaxTarget[i + 1] = std::max(headMaxTarget[i + 1], a.LabelIndex(target));
+  }
+
+  for(size_t i = n; i-- > 0;)
+  {
+    tailMinTarget[i] = tailMinTarget[i + 1];
+    for(Symbol target : BranchTargets(*a.Instrs[i]))
+      tailMinTarget[i] = std::min(tailMinTarget[i], a.LabelIndex(target));
+  }
+
+  std::set<unsigned> tailReads;
+
+  for(size_t k = n; k-- > 1;)
+  {
+    const InstructionNode& node = *a.Instrs[k];
+    if(reads(node, GetInstruction(node)))
+      tailReads.insert(*LocalSlot(node));
+
+    if(a.Depths[k] != 0 || headMaxTarget[k] > k || tailMinTarget[k] < k)
+      continue;
+
+    //a catch range and its handler have to end up in the same method
+    bool catchesOk = std::all_of(a.Catches.begin(), a.Catches.end(),
+        [k](const CatchRange& range)
+        {
+          bool inHead = range.From < k && range.To <= k && range.Handler < k;
+          bool inTail = range.From >= k && range.To >= k && range.Handler >= k;
+          return inHead || inTail;
+        });
+
+    if(!catchesOk)
+      continue;
+
+    SplitPoint point{k, {}};
+    unsigned paramSlots = 0;
+    bool localsOk = true;
+
+    for(unsigned slot : tailReads)
+    {
+      //not assigned on every path to the cut, so the verifier already
+      //requires the tail to write it before reading it
+      if(!a.IsAssignedBefore(slot, k))
+        continue;
+
+      if(slot >= locals.size() || locals[slot].AssignedAt >= k)
+        continue;
+
+      const LocalType& local = locals[slot];
+      if(local.Type.empty() || local.ConflictAt < k)
+      {
+        localsOk = false;
+        break;
+      }
+
+      point.Passed.push_back(slot);
+      paramSlots += DescriptorSlots(local.Type);
+    }
+
+    if(!localsOk || paramSlots > 255)
+      continue;
+
+    if(a.Offsets[k] + callSequenceSize(point.Passed) > maxCodeSize)
+      continue;
+
+    return point;
+  }
+
+  throw std::runtime_error{fmt::format(
+      "Assembler error: method {} is {} bytes (max {}) and has no safe split point",
+      method.NameAndDescriptor(), a.CodeSize(), maxCodeSize)};
+}
+
+//renumbers the locals used by the tail instructions: passed slots become
+//the helper's parameters (in order), all others follow them
+std::unordered_map<unsigned, unsigned> remapLocals(const std::vector<InstructionNode*>& tail,
+    const SplitPoint& point, const std::vector<LocalType>& locals)
+{
+  std::map<unsigned, unsigned> widths;
+  for(const InstructionNode* pINode : tail)
+  {
+    const InstructionInfo& info = GetInstruction(*pINode);
+    if(info.LocalWidth == 0)
+      continue;
+
+    unsigned& width = widths[*LocalSlot(*pINode)];
+    width = std::max(width, static_cast<unsigned>(info.LocalWidth));
+  }
+
+  std::unordered_map<unsigned, unsigned> mapping;
+  unsigned next = 0;
+
+  for(unsigned slot : point.Passed)
+  {
+    mapping[slot] = next;
+    next += DescriptorSlots(locals[slot].Type);
+  }
+
+  for(const auto& [slot, width] : widths)
+  {
+    if(mapping.count(slot))
+      continue;
+
+    mapping[slot] = next;
+    next += width;
+  }
+
+  return mapping;
+}
+
+void rewriteLocal(InstructionNode& node, unsigned newSlot)
+{
+  const InstructionInfo& info = GetInstruction(node);
+  Token::MetaInfo info0 = node.Args.empty() ? Token::MetaInfo{0, 0, 0} : node.Args.front().Info;
+
+  if(node.Mnemonic == "iinc")
+  {
+    node.Args.at(0) = makeIntArg(static_cast<std::int32_t>(newSlot), info0);
+    return;
+  }
+
+  std::string_view mnemonic = node.Mnemonic.View();
+  if(info.ImplicitLocal != InstructionInfo::Variable)
+    mnemonic = mnemonic.substr(0, mnemonic.rfind('_'));
+
+  auto pNew = makeLocalInstruction(mnemonic, newSlot, info0);
+  auto& newNode = static_cast<InstructionNode&>(*pNew);
+
+  node.Mnemonic = newNode.Mnemonic;
+  node.Args = std::move(newNode.Args);
+}
+
+struct SplitContext
+{
+  std::string_view ClassName;
+  std::set<std::string> MethodNames;
+  size_t MaxCodeSize;
+};
+
+std::string uniqueHelperName(SplitContext& context, std::string_view methodName)
+{
+  std::string base;
+  for(char c : methodName)
+    if(c != '<' && c != '>')
+      base += c;
+
+  for(unsigned n = 0;; ++n)
+  {
+    std::string name = fmt::format("{}$split{}", base, n);
+    if(context.MethodNames.insert(name).second)
+      return name;
+  }
+}
+
+//splits method at the given point, method keeps the head and the returned
+//helper method gets the tail
+Method split(Method& method, const MethodAnalysis& a, const SplitPoint& point,
+             const std::vector<LocalType>& locals, SplitContext& context)
+{
+  size_t k = point.Index;
+  size_t cutPos = a.BodyPos[k - 1] + 1;
+
+  std::string_view descriptor = MethodDescriptorOf(method.NameAndDescriptor());
+  std::string_view returnType = descriptor.substr(descriptor.find(')') + 1);
+
+  std::string helperDescriptor = "(";
+  unsigned passedSlots = 0;
+  for(unsigned slot : point.Passed)
+  {
+    helperDescriptor += locals[slot].Type;
+    passedSlots += DescriptorSlots(locals[slot].Type);
+  }
+  helperDescriptor += ")";
+  helperDescriptor += returnType;
+
+  std::string helperName = uniqueHelperName(context, method.Name());
+
+  std::set<const Node*> tailCatches;
+  for(const auto& range : a.Catches)
+    if(range.From >= k)
+      tailCatches.insert(range.Directive);
+
+  std::vector<NodePtr> head;
+  std::vector<NodePtr> tail;
+  std::vector<NodePtr> helperCatches;
+  std::optional<std::int64_t> stackLimit;
+
+  for(size_t pos = 0; pos < method.Body.size(); ++pos)
+  {
+    NodePtr& pNode = method.Body[pos];
+
+    if(asDirective(pNode, "catch"))
+    {
+      if(tailCatches.count(pNode.get()))
+        helperCatches.push_back(std::move(pNode));
+      else
+        head.push_back(std::move(pNode));
+
+      continue;
+    }
+
+    if(auto pLimit = asDirective(pNode, "limit"))
+    {
+      if(pLimit->Args.size() == 2 && pLimit->Args[0].Value == "stack")
+        stackLimit = pLimit->Args[1].IntValue();
+
+      head.push_back(std::move(pNode));
+      continue;
+    }
+
+    if(asDirective(pNode, "throws"))
+    {
+      head.push_back(std::move(pNode));
+      continue;
+    }
+
+    if(auto pVar = asDirective(pNode, "var"))
+    {
+      //local numbers change in the helper, so only head ranges are kept
+      const Token* pFrom = argAfter(*pVar, "from");
+      const Token* pTo = argAfter(*pVar, "to");
+      bool inHead = !pFrom || !pTo ||
+        (a.LabelIndex(pFrom->Value) < k && a.LabelIndex(pTo->Value) <= k);
+
+      if(inHead)
+        head.push_back(std::move(pNode));
+
+      continue;
+    }
+
+    if(pos < cutPos)
+    {
+      head.push_back(std::move(pNode));
+      continue;
+    }
+
+    //labels right at the cut can be targeted from both sides, labels are
+    //method local so each method gets its own copy
+    if(auto pLNode = dynamic_cast<LabelNode*>(pNode.get()))
+      if(a.LabelIndex(pLNode->LabelName) == k)
+        head.push_back(makeLabel(pLNode->LabelName));
+
+    tail.push_back(std::move(pNode));
+  }
+
+  //head: load the passed locals, call the helper and return its result
+  Token::MetaInfo noInfo{0, 0, 0};
+  for(unsigned slot : point.Passed)
+    head.push_back(makeLocalInstruction(
+          fmt::format("{}load", loadPrefix(locals[slot].Type)), slot, noInfo));
+
+  head.push_back(makeInstruction("invokestatic", {makeSymbolArg(
+          fmt::format("{}/{}{}", context.ClassName, helperName, helperDescriptor))}));
+  head.push_back(makeInstruction(returnInstruction(returnType)));
+
+  for(auto& pNode : head)
+  {
+    auto pLimit = asDirective(pNode, "limit");
+    if(!pLimit || pLimit->Args.size() != 2 || pLimit->Args[0].Value != "stack")
+      continue;
+
+    auto limit = pLimit->Args[1].IntValue();
+    if(limit && *limit < static_cast<std::int64_t>(passedSlots))
+      pLimit->Args[1] = makeIntArg(static_cast<std::int32_t>(passedSlots), pLimit->Args[1].Info);
+  }
+
+  //tail: renumber locals so the passed ones line up with the parameters
+  std::vector<InstructionNode*> tailInstrs(a.Instrs.begin() + k, a.Instrs.end());
+  auto mapping = remapLocals(tailInstrs, point, locals);
+
+  unsigned localCount = 0;
+  for(InstructionNode* pINode : tailInstrs)
+  {
+    const InstructionInfo& info = GetInstruction(*pINode);
+    if(info.LocalWidth == 0)
+      continue;
+
+    unsigned newSlot = mapping.at(*LocalSlot(*pINode));
+    rewriteLocal(*pINode, newSlot);
+    localCount = std::max(localCount, newSlot + static_cast<unsigned>(info.LocalWidth));
+  }
+  localCount = std::max(localCount, passedSlots);
+
+  Method helper;
+  helper.Header = makeDirective("method", {
+      Token{TT::Private, Symbol{}, {}, noInfo},
+      Token{TT::Static,  Symbol{}, {}, noInfo},
+      makeSymbolArg(helperName + helperDescriptor)});
+
+  if(stackLimit)
+    helper.Body.push_back(makeDirective("limit",
+          {makeSymbolArg("stack"), makeIntArg(static_cast<std::int32_t>(*stackLimit), noInfo)}));
+
+  helper.Body.push_back(makeDirective("limit",
+        {makeSymbolArg("locals"), makeIntArg(static_cast<std::int32_t>(localCount), noInfo)}));
+
+  for(auto& pCatch : helperCatches)
+    helper.Body.push_back(std::move(pCatch));
+
+  for(auto& pNode : tail)
+    helper.Body.push_back(std::move(pNode));
+
+  helper.End = makeDirective("end", {makeSymbolArg("method")});
+
+  method.Body = std::move(head);
+  return helper;
+}
+
+void emitMethod(Method method, SplitContext& context, std::vector<NodePtr>& out)
+{
+  while(true)
+  {
+    MethodAnalysis a = analyze(method);
+
+    if(a.CodeSize() <= context.MaxCodeSize)
+      break;
+
+    if(a.UsesSubroutines || method.Name() == "<init>")
+      throw std::runtime_error{fmt::format(
+          "Assembler error: method {} is {} bytes (max {}) and cant be split",
+          method.NameAndDescriptor(), a.CodeSize(), context.MaxCodeSize)};
+
+    if(context.ClassName.empty())
+      throw std::runtime_error{"Assembler error: cant split methods without a .class"};
+
+    auto locals = inferLocals(method, a, context.ClassName);
+    SplitPoint point = findSplitPoint(method, a, locals, context.MaxCodeSize);
+    Method helper = split(method, a, point, locals, context);
+
+    out.push_back(std::move(method.Header));
+    for(auto& pNode : method.Body)
+      out.push_back(std::move(pNode));
+    out.push_back(std::move(method.End));
+
+    method = std::move(helper);
+  }
+
+  out.push_back(std::move(method.Header));
+  for(auto& pNode : method.Body)
+    out.push_back(std::move(pNode));
+  out.push_back(std::move(method.End));
+}
+
+bool isEndMethod(const NodePtr& pNode)
+{
+  auto pEnd = asDirective(pNode, "end");
+  return pEnd && !pEnd->Args.empty() && pEnd->Args.front().Value == "method";
+}
+
+} //namespace: anonymous
+
+size_t CodeSize(std::vector<NodePtr>::const_iterator begin,
+                std::vector<NodePtr>::const_iterator end)
+{
+  return CodeOffsets(begin, end).back();
+}
+
+std::vector<NodePtr> SplitOversizedMethods(std::vector<NodePtr> nodes, const SplitOptions& options)
+{
+  SplitContext context{{}, {}, options.MaxCodeSize};
+
+  for(const auto& pNode : nodes)
+  {
+    auto pMethod = asDirective(pNode, "method");
+    if(!pMethod)
+      continue;
+
+    std::string_view name = lastSymbolArg(*pMethod).View();
+    context.MethodNames.emplace(name.substr(0, name.find('(')));
+  }
+
+  std::vector<NodePtr> out;
+  out.reserve(nodes.size());
+
+  for(size_t i = 0; i < nodes.size(); ++i)
+  {
+    if(auto pClass = asDirective(nodes[i], "class"))
+      context.ClassName = lastSymbolArg(*pClass).View();
+    else if(auto pInterface = asDirective(nodes[i], "interface"))
+      context.ClassName = lastSymbolArg(*pInterface).View();
+
+    if(!asDirective(nodes[i], "method"))
+    {
+      out.push_back(std::move(nodes[i]));
+      continue;
+    }
+
+    Method method;
+    method.Header = std::move(nodes[i]);
+
+    while(++i < nodes.size() && !isEndMethod(nodes[i]))
+      method.Body.push_back(std::move(nodes[i]));
+
+    if(i == nodes.size())
+      throw std::runtime_error{fmt::format(
+          "Assembler error: .method {} has no .end method", method.NameAndDescriptor())};
+
+    method.End = std::move(nodes[i]);
+    emitMethod(std::move(method), context, out);
+  }
+
+  return out;
+}
+
+} //namespace: Jasmin
@@ -2,19 +2,92 @@
 
 #include <fmt/core.h>
 
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
 namespace Jasmin
 {
 
-Parser::Parser(const std::vector<Token>& ts): tokens{ts} {}
-Parser::Parser(Lexer lexer) : tokens{lexer.LexAll()} {}
+namespace
+{
+
+template<typename NodeList>
+NodeList makeNodeList(std::pmr::memory_resource* pResource)
+{
+  if constexpr(std::is_same_v<NodeList, std::pmr::vector<NodePtr>>)
+    return NodeList{pResource ? pResource : std::pmr::get_default_resource()};
+  else
+    return NodeList{};
+}
+
+} //namespace: anonymous
+
+template<typename NodeList>
+BasicNodeBuilder<NodeList>::BasicNodeBuilder(std::pmr::memory_resource* pResource)
+: Nodes{makeNodeList<NodeList>(pResource)}, pResource{pResource}
+{
+}
+
+template<typename NodeList>
+void BasicNodeBuilder<NodeList>::OnDirective(const Token& directive, const std::vector<Token>& args)
+{
+  auto pUnimplemented = MakeNode<DUnimplemented>(pResource);
+  pUnimplemented->DirectiveName = directive.Value;
+  pUnimplemented->Args.assign(args.begin(), args.end());
+  Nodes.push_back(std::move(pUnimplemented));
+}
+
+template<typename NodeList>
+void BasicNodeBuilder<NodeList>::OnInstruction(Symbol mnemonic, const std::vector<Token>& args)
+{
+  auto pINode = MakeNode<InstructionNode>(pResource);
+  pINode->Mnemonic = mnemonic;
+  pINode->Args.assign(args.begin(), args.end());
+  Nodes.push_back(std::move(pINode));
+}
+
+template<typename NodeList>
+void BasicNodeBuilder<NodeList>::OnSwitch(Symbol mnemonic, const std::vector<Token>& args,
+                                          const std::vector<SwitchCase>& cases, Symbol defaultLabel)
+{
+  auto pSNode = MakeNode<SwitchNode>(pResource);
+  pSNode->Mnemonic = mnemonic;
+  pSNode->Args.assign(args.begin(), args.end());
+  pSNode->Cases.assign(cases.begin(), cases.end());
+  pSNode->DefaultLabel = defaultLabel;
+  Nodes.push_back(std::move(pSNode));
+}
+
+template<typename NodeList>
+void BasicNodeBuilder<NodeList>::OnLabel(Symbol label)
+{
+  auto pLNode = MakeNode<LabelNode>(pResource);
+  pLNode->LabelName = label;
+  Nodes.push_back(std::move(pLNode));
+}
+
+template class BasicNodeBuilder<std::vector<NodePtr>>;
+template class BasicNodeBuilder<std::pmr::vector<NodePtr>>;
+
+Parser::Parser(const std::vector<Token>& ts): tokens{ts.data(), ts.size()} {}
+Parser::Parser(const std::pmr::vector<Token>& ts): tokens{ts.data(), ts.size()} {}
+Parser::Parser(Lexer lexer)
+: ownedTokens{lexer.LexAll()}, tokens{ownedTokens.data(), ownedTokens.size()} {}
+Parser::Parser(Lexer* streamingLexer) : pLexer{streamingLexer} {}
 
 std::vector<NodePtr> Parser::ParseAll()
 {
-  std::vector<NodePtr> nodes;
-  while(HasMore())
-    nodes.emplace_back(ParseNext());
+  NodeBuilder builder;
+  Visit(builder);
+  return std::move(builder.Nodes);
+}
 
-  return nodes;
+std::pmr::vector<NodePtr> Parser::ParseAll(std::pmr::memory_resource* pResource)
+{
+  PmrNodeBuilder builder{pResource};
+  Visit(builder);
+  return std::move(builder.Nodes);
 }
 
 std::vector<NodePtr> Parser::ParseAll(const std::vector<Token>& tokens)
@@ -27,12 +100,50 @@ std::vector<NodePtr> Parser::ParseAll(const std::vector<Token>&& tokens)
   return ParseAll(tokens);
 }
 
+std::pmr::vector<NodePtr> Parser::ParseAll(const std::pmr::vector<Token>& tokens,
+                                           std::pmr::memory_resource* pResource)
+{
+  return Parser{tokens}.ParseAll(pResource);
+}
+
+void Parser::Visit(ParseVisitor& visitor)
+{
+  while(HasMore())
+    parseStatement(visitor);
+}
+
+void Parser::Visit(Lexer lexer, ParseVisitor& visitor)
+{
+  Parser{&lexer}.Visit(visitor);
+}
+
 bool Parser::HasMore() const
 {
-  return currentToken < tokens.size();
+  //NOTE: trailing newlines dont count, theres nothing left to parse in them
+  if(pLexer)
+  {
+    for(const Token* pToken; (pToken = lookaheadToken()); lookahead.reset())
+      if(pToken->Type != TT::Newline)
+        return true;
+
+    return false;
+  }
+
+  for(size_t i = currentToken; i < tokens.size(); ++i)
+    if(tokens[i].Type != TT::Newline)
+      return true;
+
+  return false;
 }
 
 NodePtr Parser::ParseNext()
+{
+  NodeBuilder builder;
+  parseStatement(builder);
+  return std::move(builder.Nodes.back());
+}
+
+void Parser::parseStatement(ParseVisitor& visitor)
 {
   Token token;
   while( (token = peekNextToken()).Type == TT::Newline) 
@@ -40,33 +151,70 @@ NodePtr Parser::ParseNext()
     consumeNextToken(); }
 
   if(token.IsDirective())
-    return parseDirective();
+    return parseDirective(visitor);
 
   if(token.Type == TT::Instruction)
-    return parseInstruction();
+    return parseInstruction(visitor);
 
-  if(token.Type == TT::Symbol)
-    return parseLabel();
+  if(token.Type == TT::Symbol || token.Type == TT::Label)
+    return parseLabel(visitor);
 
   throw error(fmt::format(
-        "unexpected top level token: {}=\"{}\"", ToString(token.Type), token.Value));
+        "unexpected top level token: {}=\"{}\"", ToString(token.Type), token.Value.View()));
+}
+
+const Token* Parser::lookaheadToken() const
+{
+  if(!lookahead)
+  {
+    if(pLexer->HasMore())
+    {
+      lookahead = pLexer->LexNext();
+    }
+    else if(!lexerDrained)
+    {
+      //like LexAll, make sure the last statement is terminated
+      lookahead = Token{TT::Newline, {}, {}, 
+        {pLexer->CurrentLineNumber(), pLexer->CurrentLineOffset(), pLexer->CurrentFileOffset()}};
+      lexerDrained = true;
+    }
+    else
+    {
+      return nullptr;
+    }
+  }
+
+  return &*lookahead;
 }
 
 Token Parser::peekNextToken() const
 {
-  return tokens.size() >= currentToken ? 
+  if(pLexer)
+  {
+    const Token* pToken = lookaheadToken();
+    return pToken ? *pToken : throw error("ran out of tokens");
+  }
+
+  return tokens.size() > currentToken ? 
          tokens[currentToken] :
          throw error("ran out of tokens");
 }
 
 Token Parser::consumeNextToken()
 {
+  if(pLexer)
+  {
+    Token token = peekNextToken();
+    lookahead.reset();
+    return token;
+  }
+
   return tokens.size() > currentToken ? 
          tokens[currentToken++] :
          throw error("ran out of tokens");
 }
 
-std::string Parser::consumeExpected(TT expectedType)
+Symbol Parser::consumeExpected(TT expectedType)
 {
   Token token = peekNextToken();
 
@@ -88,67 +236,168 @@ Token Parser::consumeDirective()
   return token;
 }
 
-NodePtr Parser::parseDirective()
+void Parser::parseDirective(ParseVisitor& visitor)
 { 
-  NodePtr pDir = nullptr;
   Token directiveToken = consumeDirective();
 
-  switch(directiveToken.Type)
-  {
-    default:
-    {
-      auto pUnimplemented = std::make_unique<DUnimplemented>();
-      pUnimplemented->DirectiveName = directiveToken.Value;
+  argBuffer.clear();
 
-      Token arg;
-      while( (arg = peekNextToken()).Type != TT::Newline ) 
-        pUnimplemented->Args.emplace_back( consumeNextToken().Value );
-
-      pDir = std::move(pUnimplemented);
-    }
-  }
+  Token arg;
+  while( (arg = peekNextToken()).Type != TT::Newline ) 
+    argBuffer.emplace_back( consumeNextToken() );
 
   consumeExpected(TT::Newline);
-  return pDir;
+  visitor.OnDirective(directiveToken, argBuffer);
 }
 
-NodePtr Parser::parseInstruction()
+void Parser::parseInstruction(ParseVisitor& visitor)
 {
-  std::string mnemonic = consumeExpected(TT::Instruction);
+  Symbol mnemonic = consumeExpected(TT::Instruction);
 
-  auto pINode = std::make_unique<InstructionNode>();
-  if(!pINode)
-    throw error("parseInstruction failed to allocate InstructionNode");
+  if(mnemonic == "tableswitch" || mnemonic == "lookupswitch")
+    return parseSwitch(mnemonic, visitor);
 
-  pINode->Mnemonic = std::move(mnemonic);
+  argBuffer.clear();
 
   Token arg;
   while( (arg = consumeNextToken()).Type != TT::Newline ) 
-    pINode->Args.emplace_back( std::move(arg.Value) );
+    argBuffer.emplace_back( std::move(arg) );
+
+  visitor.OnInstruction(mnemonic, argBuffer);
+}
+
+void Parser::parseSwitch(Symbol mnemonic, ParseVisitor& visitor)
+{
+  argBuffer.clear();
+  caseBuffer.clear();
+
+  Token arg;
+  while( (arg = consumeNextToken()).Type != TT::Newline ) 
+    argBuffer.emplace_back( std::move(arg) );
+
+  bool isTable = mnemonic == "tableswitch";
+  std::int64_t nextKey = 0;
+
+  if(isTable)
+  {
+    if(argBuffer.empty() || !argBuffer.front().IntValue())
+      throw error("tableswitch expects an integer low key");
+
+    auto low = argBuffer.front().Int32Value();
+    if(!low)
+      throw error(fmt::format("tableswitch low key {} is out of the int range",
+            argBuffer.front().Value.View()));
+
+    nextKey = *low;
+  }
+
+  Symbol defaultLabel;
+
+  //one case per line, terminated by "default : label"
+  while(true)
+  {
+    Token token = consumeNextToken();
+
+    if(token.Type == TT::Newline)
+      continue;
+
+    if(token.Type == TT::Default || token.Type == TT::Label)
+    {
+      if(token.Type == TT::Label && token.Value != "default:")
+        throw error(fmt::format("unexpected label \"{}\" in {}", 
+              token.Value.View(), mnemonic.View()));
 
-  return pINode;
+      if(token.Type == TT::Default)
+        consumeExpected(TT::Colon);
+
+      defaultLabel = consumeExpected(TT::Symbol);
+      break;
+    }
+
+    std::int64_t key = nextKey;
+
+    if(!isTable)
+    {
+      if(token.Type != TT::Integer || !token.Int32Value())
+        throw error(fmt::format("{} expects an int key", mnemonic.View()));
+
+      key = *token.Int32Value();
+      consumeExpected(TT::Colon);
+      token = consumeNextToken();
+    }
+
+    if(token.Type != TT::Symbol)
+      throw error(fmt::format("{} expects a label", mnemonic.View()));
+
+    if(key > std::numeric_limits<std::int32_t>::max())
+      throw error("tableswitch has too many cases");
+
+    caseBuffer.emplace_back(static_cast<std::int32_t>(key), token.Value);
+    consumeExpected(TT::Newline);
+    ++nextKey;
+  }
+
+  consumeExpected(TT::Newline);
+
+  if(isTable && argBuffer.size() > 1)
+  {
+    auto high = argBuffer[1].Int32Value();
+    if(!high || *high != nextKey - 1)
+      throw error("tableswitch high key doesnt match its number of cases");
+  }
+
+  visitor.OnSwitch(mnemonic, argBuffer, caseBuffer, defaultLabel);
 }
 
-NodePtr Parser::parseLabel()
+void Parser::parseLabel(ParseVisitor& visitor)
 {
-  std::string label = consumeExpected(TT::Symbol);
-  consumeExpected(TT::Colon);
+  Symbol label;
+
+  //the lexer makes "name:" a single label token, "name :" is symbol + colon
+  if(peekNextToken().Type == TT::Label)
+  {
+    std::string_view labelStr = consumeExpected(TT::Label).View();
+    labelStr.remove_suffix(1);
+    label = Symbol{labelStr};
+  }
+  else
+  {
+    label = consumeExpected(TT::Symbol);
+
+    //"switch" isnt an opcode, it is the high level switch the assembler
+    //lowers (unless it is followed by a colon, then it is just a label)
+    if(label == "switch" && peekNextToken().Type != TT::Colon)
+      return parseSwitch(label, visitor);
 
-  auto pLNode = std::make_unique<LabelNode>();
-  if(!pLNode)
-    throw error("parseLabel failed to allocate LabelNode");
+    consumeExpected(TT::Colon);
+  }
 
-  pLNode->LabelName = std::move(label);
-  return pLNode;
+  visitor.OnLabel(label);
 }
 
 std::runtime_error Parser::error(std::string_view message) const
 {
+  if(pLexer)
+  {
+    Token::MetaInfo info = lookahead ? lookahead->Info : Token::MetaInfo{
+      pLexer->CurrentLineNumber(), pLexer->CurrentLineOffset(), pLexer->CurrentFileOffset()};
+
+    return std::runtime_error{fmt::format("Parser error: {} on line {} col {}",
+        message, info.LineNumber, info.LineOffset)};
+  }
+
+  if(tokens.empty())
+    return std::runtime_error{fmt::format("Parser error: {}", message)};
+
+  //NOTE: cant use peekNextToken() here since it reports running out of
+  //tokens through this function
+  const Token& token = tokens[std::min(currentToken, tokens.size() - 1)];
+
   return std::runtime_error{
       fmt::format("Parser error: {} on line {} col {}",
       message,
-      peekNextToken().Info.LineNumber,
-      peekNextToken().Info.LineOffset - peekNextToken().Value.length())};
+      token.Info.LineNumber,
+      token.Info.LineOffset)};
 }
 
 } //namespace: Jasmin
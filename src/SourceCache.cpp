@@ -0,0 +1,509 @@
+#include "Jasmin/SourceCache.hpp"
+#include "Jasmin/Parser.hpp"
+
+#include <fmt/core.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+
+namespace Jasmin
+{
+
+struct SourceCache::Header
+{
+  char Magic[4];
+  std::uint32_t ByteOrderMark;
+  std::uint32_t Version;
+  std::uint32_t StringCount;
+  std::uint64_t SourceHash;
+  std::uint64_t SourceSize;
+  std::uint32_t TokenCount;
+  std::uint32_t NodeCount;
+  std::uint32_t ArgCount;
+  std::uint32_t CaseCount;
+  std::uint64_t StringsOffset;
+  std::uint64_t TokensOffset;
+  std::uint64_t NodesOffset;
+  std::uint64_t ArgsOffset;
+  std::uint64_t CasesOffset;
+  std::uint64_t TextOffset;
+  std::uint64_t TextSize;
+};
+
+struct SourceCache::StringRecord
+{
+  std::uint32_t Offset;
+  std::uint32_t Length;
+};
+
+struct SourceCache::TokenRecord
+{
+  std::uint8_t Type;
+  std::uint8_t NumKind; //index into Token::Number
+  std::uint16_t LineOffset;
+  std::uint32_t LineNumber;
+  std::uint32_t Value;
+  std::uint32_t Reserved;
+  std::uint64_t FileOffset;
+  std::uint64_t NumBits;
+};
+
+//NOTE: a Directive's args start with the directive token itself
+struct SourceCache::NodeRecord
+{
+  enum Kind : std::uint8_t { Directive, Instruction, Switch, Label };
+
+  std::uint8_t Type;
+  std::uint8_t Reserved[3];
+  std::uint32_t Name;
+  std::uint32_t FirstArg;
+  std::uint32_t ArgCount;
+  std::uint32_t FirstCase;
+  std::uint32_t CaseCount;
+  std::uint32_t DefaultLabel;
+};
+
+struct SourceCache::CaseRecord
+{
+  std::int32_t Key;
+  std::uint32_t Label;
+};
+
+namespace
+{
+
+constexpr char Magic[4] = {'J', 'S', 'M', 'C'};
+constexpr std::uint32_t ByteOrderMark = 0x01020304;
+
+std::uint64_t align8(std::uint64_t offset)
+{
+  return (offset + 7) & ~std::uint64_t{7};
+}
+
+std::runtime_error imageError(std::string_view message)
+{
+  return std::runtime_error{fmt::format("Source cache error: {}", message)};
+}
+
+//collects the records while the parser walks the tokens
+class ImageBuilder : public ParseVisitor
+{
+  public:
+    using StringRecord = std::pair<std::uint32_t, std::uint32_t>;
+
+    template<typename TokenRecord>
+    TokenRecord Record(const Token& token)
+    {
+      TokenRecord record{};
+      record.Type       = static_cast<std::uint8_t>(token.Type);
+      record.NumKind    = static_cast<std::uint8_t>(token.Num.index());
+      record.LineOffset = token.Info.LineOffset;
+      record.LineNumber = token.Info.LineNumber;
+      record.Value      = String(token.Value);
+      record.FileOffset = token.Info.FileOffset;
+
+      std::visit([&record](auto value)
+      {
+        using T = decltype(value);
+        if constexpr(std::is_same_v<T, double>)
+          std::memcpy(&record.NumBits, &value, sizeof(value));
+        else if constexpr(!std::is_same_v<T, std::monostate>)
+          record.NumBits = static_cast<std::uint64_t>(static_cast<std::int64_t>(value));
+      }, token.Num);
+
+      return record;
+    }
+
+    std::uint32_t String(Symbol symbol)
+    {
+      auto [it, inserted] = stringIndex.emplace(symbol, static_cast<std::uint32_t>(Strings.size()));
+      if(inserted)
+      {
+        Strings.emplace_back(static_cast<std::uint32_t>(Text.size()),
+                             static_cast<std::uint32_t>(symbol.Length()));
+        Text.append(symbol.View());
+      }
+
+      return it->second;
+    }
+
+    void OnDirective(const Token& directive, const std::vector<Token>& args) override
+    {
+      Nodes.push_back({Kind::Directive, &directive, {}, args, nullptr, Symbol{}});
+    }
+
+    void OnInstruction(Symbol mnemonic, const std::vector<Token>& args) override
+    {
+      Nodes.push_back({Kind::Instruction, nullptr, mnemonic, args, nullptr, Symbol{}});
+    }
+
+    void OnSwitch(Symbol mnemonic, const std::vector<Token>& args,
+                  const std::vector<SwitchCase>& cases, Symbol defaultLabel) override
+    {
+      Nodes.push_back({Kind::Switch, nullptr, mnemonic, args, &cases, defaultLabel});
+    }
+
+    void OnLabel(Symbol label) override
+    {
+      Nodes.push_back({Kind::Label, nullptr, label, {}, nullptr, Symbol{}});
+    }
+
+    enum class Kind { Directive, Instruction, Switch, Label };
+
+    //NOTE: the parser reuses its buffers, so statements are copied out as
+    //they arrive
+    struct Statement
+    {
+      Statement(Kind type, const Token* pDirective, Symbol name, const std::vector<Token>& args,
+                const std::vector<SwitchCase>* pCases, Symbol defaultLabel)
+      : Type{type}, Name{name}, Args{args}, DefaultLabel{defaultLabel}
+      {
+        if(pDirective)
+          Args.insert(Args.begin(), *pDirective);
+        if(pCases)
+          Cases = *pCases;
+      }
+
+      Kind Type;
+      Symbol Name;
+      std::vector<Token> Args;
+      std::vector<SwitchCase> Cases;
+      Symbol DefaultLabel;
+    };
+
+    std::vector<Statement> Nodes;
+    std::vector<StringRecord> Strings;
+    std::string Text;
+
+  private:
+    std::unordered_map<Symbol, std::uint32_t> stringIndex;
+};
+
+template<typename T>
+void put(std::string& image, std::uint64_t offset, const T* pData, size_t count)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+  if(count)
+    std::memcpy(image.data() + offset, pData, count * sizeof(T));
+}
+
+} //namespace: anonymous
+
+std::uint64_t SourceCache::HashSource(std::string_view source)
+{
+  //FNV-1a
+  std::uint64_t hash = 0xcbf29ce484222325;
+  for(char ch : source)
+  {
+    hash ^= static_cast<unsigned char>(ch);
+    hash *= 0x100000001b3;
+  }
+
+  return hash;
+}
+
+std::string SourceCache::Build(std::string_view source)
+{
+  std::vector<Token> tokens = Lexer::LexAll(InStream{std::string{source}});
+
+  ImageBuilder builder;
+  Parser{tokens}.Visit(builder);
+
+  std::vector<TokenRecord> tokenRecords;
+  tokenRecords.reserve(tokens.size());
+  for(const auto& token : tokens)
+    tokenRecords.push_back(builder.Record<TokenRecord>(token));
+
+  std::vector<NodeRecord> nodeRecords;
+  std::vector<TokenRecord> argRecords;
+  std::vector<CaseRecord> caseRecords;
+  nodeRecords.reserve(builder.Nodes.size());
+
+  for(const auto& statement : builder.Nodes)
+  {
+    NodeRecord record{};
+    record.Type         = static_cast<std::uint8_t>(statement.Type);
+    record.Name         = builder.String(statement.Name);
+    record.FirstArg     = static_cast<std::uint32_t>(argRecords.size());
+    record.ArgCount     = static_cast<std::uint32_t>(statement.Args.size());
+    record.FirstCase    = static_cast<std::uint32_t>(caseRecords.size());
+    record.CaseCount    = static_cast<std::uint32_t>(statement.Cases.size());
+    record.DefaultLabel = builder.String(statement.DefaultLabel);
+
+    for(const auto& arg : statement.Args)
+      argRecords.push_back(builder.Record<TokenRecord>(arg));
+
+    for(const auto& [key, label] : statement.Cases)
+      caseRecords.push_back(CaseRecord{key, builder.String(label)});
+
+    nodeRecords.push_back(record);
+  }
+
+  Header header{};
+  std::memcpy(header.Magic, Magic, sizeof(Magic));
+  header.ByteOrderMark = ByteOrderMark;
+  header.Version       = Version;
+  header.StringCount   = static_cast<std::uint32_t>(builder.Strings.size());
+  header.SourceHash    = HashSource(source);
+  header.SourceSize    = source.size();
+  header.TokenCount    = static_cast<std::uint32_t>(tokenRecords.size());
+  header.NodeCount     = static_cast<std::uint32_t>(nodeRecords.size());
+  header.ArgCount      = static_cast<std::uint32_t>(argRecords.size());
+  header.CaseCount     = static_cast<std::uint32_t>(caseRecords.size());
+
+  header.StringsOffset = align8(sizeof(Header));
+  header.TokensOffset  = align8(header.StringsOffset + header.StringCount * sizeof(StringRecord));
+  header.NodesOffset   = align8(header.TokensOffset  + header.TokenCount  * sizeof(TokenRecord));
+  header.ArgsOffset    = align8(header.NodesOffset   + header.NodeCount   * sizeof(NodeRecord));
+  header.CasesOffset   = align8(header.ArgsOffset    + header.ArgCount    * sizeof(TokenRecord));
+  header.TextOffset    = align8(header.CasesOffset   + header.CaseCount   * sizeof(CaseRecord));
+  header.TextSize      = builder.Text.size();
+
+  std::vector<StringRecord> stringRecords;
+  stringRecords.reserve(builder.Strings.size());
+  for(const auto& [offset, length] : builder.Strings)
+    stringRecords.push_back(StringRecord{offset, length});
+
+  std::string image(align8(header.TextOffset + header.TextSize), '\0');
+  put(image, 0, &header, 1);
+  put(image, header.StringsOffset, stringRecords.data(), stringRecords.size());
+  put(image, header.TokensOffset,  tokenRecords.data(),  tokenRecords.size());
+  put(image, header.NodesOffset,   nodeRecords.data(),   nodeRecords.size());
+  put(image, header.ArgsOffset,    argRecords.data(),    argRecords.size());
+  put(image, header.CasesOffset,   caseRecords.data(),   caseRecords.size());
+  put(image, header.TextOffset,    builder.Text.data(),  builder.Text.size());
+
+  return image;
+}
+
+void SourceCache::Write(const std::filesystem::path& path, std::string_view image)
+{
+  WriteFileAtomically(path, image);
+}
+
+SourceCache SourceCache::Open(const std::filesystem::path& path)
+{
+  MappedFile file;
+  try
+  {
+    file = MappedFile::Open(path);
+  }
+  catch(const std::runtime_error& e)
+  {
+    throw imageError(e.what());
+  }
+
+  std::string_view image = file.Data();
+  return SourceCache{std::move(file), image};
+}
+
+SourceCache::SourceCache(std::string_view image) : SourceCache{MappedFile{}, image}
+{
+}
+
+SourceCache::SourceCache(MappedFile file, std::string_view image)
+: file{std::move(file)}, image{image}
+{
+  static_assert(sizeof(Header)       == 104);
+  static_assert(sizeof(StringRecord) == 8);
+  static_assert(sizeof(TokenRecord)  == 32);
+  static_assert(sizeof(NodeRecord)   == 28);
+  static_assert(sizeof(CaseRecord)   == 8);
+
+  if(image.size() < sizeof(Header) ||
+     reinterpret_cast<std::uintptr_t>(image.data()) % alignof(std::uint64_t) != 0)
+    throw imageError("image is truncated or misaligned");
+
+  pHeader = reinterpret_cast<const Header*>(image.data());
+
+  if(std::memcmp(pHeader->Magic, Magic, sizeof(Magic)) != 0)
+    throw imageError("not a source cache image");
+  if(pHeader->ByteOrderMark != ByteOrderMark)
+    throw imageError("image was written with a different byte order");
+  if(pHeader->Version != Version)
+    throw imageError(fmt::format("image version {} (expected {})", pHeader->Version, Version));
+
+  pStrings = section<StringRecord>(pHeader->StringsOffset, pHeader->StringCount);
+  pTokens  = section<TokenRecord>(pHeader->TokensOffset, pHeader->TokenCount);
+  pNodes   = section<NodeRecord>(pHeader->NodesOffset, pHeader->NodeCount);
+  pArgs    = section<TokenRecord>(pHeader->ArgsOffset, pHeader->ArgCount);
+  pCases   = section<CaseRecord>(pHeader->CasesOffset, pHeader->CaseCount);
+
+  if(pHeader->TextOffset > image.size() || pHeader->TextSize > image.size() - pHeader->TextOffset)
+    throw imageError("text section out of bounds");
+  pText = image.data() + pHeader->TextOffset;
+
+  validate();
+
+  symbols.reserve(pHeader->StringCount);
+  for(std::uint32_t i = 0; i < pHeader->StringCount; ++i)
+    symbols.emplace_back(std::string_view{pText + pStrings[i].Offset, pStrings[i].Length});
+}
+
+template<typename Record>
+const Record* SourceCache::section(std::uint64_t offset, std::uint32_t count) const
+{
+  if(offset % alignof(Record) != 0 || offset > image.size() ||
+     (image.size() - offset) / sizeof(Record) < count)
+    throw imageError("section out of bounds");
+
+  return reinterpret_cast<const Record*>(image.data() + offset);
+}
+
+//NOTE: every index is checked once here so the accessors can trust them
+void SourceCache::validate() const
+{
+  for(std::uint32_t i = 0; i < pHeader->StringCount; ++i)
+    if(pStrings[i].Offset > pHeader->TextSize ||
+       pStrings[i].Length > pHeader->TextSize - pStrings[i].Offset)
+      throw imageError("string out of bounds");
+
+  auto checkString = [this](std::uint32_t index)
+  {
+    if(index >= pHeader->StringCount)
+      throw imageError("string index out of bounds");
+  };
+
+  auto checkToken = [&checkString](const TokenRecord& record)
+  {
+    if(record.Type > static_cast<std::uint8_t>(TT::Newline) ||
+       record.NumKind >= std::variant_size_v<Token::Number>)
+      throw imageError("invalid token record");
+    checkString(record.Value);
+  };
+
+  for(std::uint32_t i = 0; i < pHeader->TokenCount; ++i)
+    checkToken(pTokens[i]);
+
+  for(std::uint32_t i = 0; i < pHeader->ArgCount; ++i)
+    checkToken(pArgs[i]);
+
+  for(std::uint32_t i = 0; i < pHeader->CaseCount; ++i)
+    checkString(pCases[i].Label);
+
+  for(std::uint32_t i = 0; i < pHeader->NodeCount; ++i)
+  {
+    const NodeRecord& node = pNodes[i];
+
+    if(node.Type > NodeRecord::Label ||
+       node.FirstArg > pHeader->ArgCount || node.ArgCount > pHeader->ArgCount - node.FirstArg ||
+       node.FirstCase > pHeader->CaseCount || node.CaseCount > pHeader->CaseCount - node.FirstCase ||
+       (node.Type == NodeRecord::Directive && node.ArgCount == 0))
+      throw imageError("invalid node record");
+
+    checkString(node.Name);
+    checkString(node.DefaultLabel);
+  }
+}
+
+bool SourceCache::Matches(std::string_view source) const
+{
+  return pHeader->SourceSize == source.size() && pHeader->SourceHash == HashSource(source);
+}
+
+Token SourceCache::makeToken(const TokenRecord& record) const
+{
+  Token token;
+  token.Type  = static_cast<TT>(record.Type);
+  token.Value = symbols[record.Value];
+  token.Info  = Token::MetaInfo{record.LineNumber, record.LineOffset,
+                                static_cast<size_t>(record.FileOffset)};
+
+  switch(record.NumKind)
+  {
+    case 1:
+      token.Num = static_cast<std::int32_t>(static_cast<std::int64_t>(record.NumBits));
+      break;
+
+    case 2:
+      token.Num = static_cast<std::int64_t>(record.NumBits);
+      break;
+
+    case 3:
+    {
+      double value;
+      std::memcpy(&value, &record.NumBits, sizeof(value));
+      token.Num = value;
+      break;
+    }
+
+    default:
+      break;
+  }
+
+  return token;
+}
+
+std::vector<Token> SourceCache::Tokens() const
+{
+  std::vector<Token> tokens;
+  tokens.reserve(pHeader->TokenCount);
+
+  for(std::uint32_t i = 0; i < pHeader->TokenCount; ++i)
+    tokens.push_back(makeToken(pTokens[i]));
+
+  return tokens;
+}
+
+std::vector<NodePtr> SourceCache::Nodes() const
+{
+  NodeBuilder builder;
+  builder.Nodes.reserve(pHeader->NodeCount);
+  Visit(builder);
+  return std::move(builder.Nodes);
+}
+
+std::pmr::vector<NodePtr> SourceCache::Nodes(std::pmr::memory_resource* pResource) const
+{
+  PmrNodeBuilder builder{pResource};
+  builder.Nodes.reserve(pHeader->NodeCount);
+  Visit(builder);
+  return std::move(builder.Nodes);
+}
+
+void SourceCache::Visit(ParseVisitor& visitor) const
+{
+  std::vector<Token> args;
+  std::vector<SwitchCase> cases;
+
+  for(std::uint32_t i = 0; i < pHeader->NodeCount; ++i)
+  {
+    const NodeRecord& node = pNodes[i];
+
+    args.clear();
+    for(std::uint32_t a = node.FirstArg; a < node.FirstArg + node.ArgCount; ++a)
+      args.push_back(makeToken(pArgs[a]));
+
+    switch(node.Type)
+    {
+      case NodeRecord::Directive:
+      {
+        Token directive = std::move(args.front());
+        args.erase(args.begin());
+        visitor.OnDirective(directive, args);
+        break;
+      }
+
+      case NodeRecord::Instruction:
+        visitor.OnInstruction(symbols[node.Name], args);
+        break;
+
+      case NodeRecord::Switch:
+        cases.clear();
+        for(std::uint32_t c = node.FirstCase; c < node.FirstCase + node.CaseCount; ++c)
+          cases.emplace_back(pCases[c].Key, symbols[pCases[c].Label]);
+
+        visitor.OnSwitch(symbols[node.Name], args, cases, symbols[node.DefaultLabel]);
+        break;
+
+      case NodeRecord::Label:
+        visitor.OnLabel(symbols[node.Name]);
+        break;
+    }
+  }
+}
+
+} //namespace: Jasmin
@@ -0,0 +1,364 @@
+#include "Jasmin/SwitchLowering.hpp"
+#include "Jasmin/ConstantPool.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+namespace Jasmin
+{
+
+namespace
+{
+
+//worst case, the real padding depends on where the switch ends up
+constexpr std::uint64_t MaxPadding = 3;
+
+//a run of sorted cases [First, Last) dispatched by one switch instruction
+struct Cluster
+{
+  bool IsTable;
+  size_t First;
+  size_t Last;
+};
+
+struct Cost
+{
+  std::uint64_t Bytes;
+  std::uint64_t Steps; //on the longest dispatch path
+
+  std::uint64_t Total(const SwitchLoweringOptions& options) const
+  {
+    return Bytes + Steps * options.StepCost;
+  }
+};
+
+std::uint64_t tableRange(const std::vector<SwitchCase>& cases, size_t first, size_t last)
+{
+  return static_cast<std::uint64_t>(
+      static_cast<std::int64_t>(cases[last-1].first) - cases[first].first) + 1;
+}
+
+//NOTE: binary search over n pairs takes up to floor(log2 n) + 1 probes
+std::uint64_t lookupSteps(size_t n)
+{
+  std::uint64_t steps = 0;
+  for(; n; n >>= 1)
+    ++steps;
+
+  return steps;
+}
+
+Cost leafCost(const std::vector<SwitchCase>& cases, const Cluster& cluster)
+{
+  if(cluster.IsTable)
+    return {1 + MaxPadding + 12 + 4 * tableRange(cases, cluster.First, cluster.Last), 1};
+
+  size_t n = cluster.Last - cluster.First;
+  return {1 + MaxPadding + 8 + 8 * n, lookupSteps(n)};
+}
+
+//an int push as it is written in source, ldc takes the value itself and gets
+//its pool index once the constant loads are lowered
+struct IntPush
+{
+  Symbol Mnemonic;
+  std::optional<std::int32_t> Arg;
+};
+
+IntPush pushInt(std::int32_t value)
+{
+  Constant constant{Constant::Kind::Integer, value};
+
+  if(auto folded = FoldConstantLoad(constant))
+    return IntPush{folded->Mnemonic, folded->Immediate};
+
+  return IntPush{Symbol{"ldc"}, value};
+}
+
+//dup, push pivot, if_icmpge
+std::uint64_t compareBytes(std::int32_t pivot)
+{
+  IntPush push = pushInt(pivot);
+  std::uint64_t pushBytes = 1;
+
+  if(push.Arg)
+    pushBytes += push.Mnemonic == "bipush" ? 1 : 2; //ldc_w at worst
+
+  return 1 + pushBytes + 3;
+}
+
+Cost treeCost(const std::vector<SwitchCase>& cases, const std::vector<Cluster>& clusters,
+              size_t first, size_t last)
+{
+  if(last - first == 1)
+    return leafCost(cases, clusters[first]);
+
+  size_t mid = first + (last - first) / 2;
+  Cost left  = treeCost(cases, clusters, first, mid);
+  Cost right = treeCost(cases, clusters, mid, last);
+
+  return {compareBytes(cases[clusters[mid].First].first) + left.Bytes + right.Bytes,
+          1 + std::max(left.Steps, right.Steps)};
+}
+
+//greedily grows dense runs from each key, runs too small for a table are
+//merged into lookupswitch clusters
+std::vector<Cluster> findClusters(const std::vector<SwitchCase>& cases,
+                                  const SwitchLoweringOptions& options)
+{
+  std::vector<Cluster> clusters;
+
+  auto addSparse = [&clusters](size_t index)
+  {
+    if(!clusters.empty() && !clusters.back().IsTable && clusters.back().Last == index)
+      ++clusters.back().Last;
+    else
+      clusters.push_back(Cluster{false, index, index + 1});
+  };
+
+  size_t first = 0;
+  while(first < cases.size())
+  {
+    size_t last = first + 1;
+    while(last < cases.size() &&
+          double(last + 1 - first) / tableRange(cases, first, last + 1) >= options.MinTableDensity)
+      ++last;
+
+    if(last - first >= options.MinTableCases)
+    {
+      clusters.push_back(Cluster{true, first, last});
+      first = last;
+    }
+    else
+    {
+      addSparse(first++);
+    }
+  }
+
+  return clusters;
+}
+
+std::vector<Cluster> planSwitch(const std::vector<SwitchCase>& cases,
+                                const SwitchLoweringOptions& options)
+{
+  std::vector<Cluster> best{Cluster{false, 0, cases.size()}};
+  std::uint64_t bestCost = leafCost(cases, best.front()).Total(options);
+
+  auto consider = [&](std::vector<Cluster> plan)
+  {
+    std::uint64_t cost = treeCost(cases, plan, 0, plan.size()).Total(options);
+    if(cost < bestCost)
+    {
+      bestCost = cost;
+      best = std::move(plan);
+    }
+  };
+
+  consider({Cluster{true, 0, cases.size()}});
+
+  std::vector<Cluster> clusters = findClusters(cases, options);
+  if(clusters.size() > 1)
+    consider(std::move(clusters));
+
+  return best;
+}
+
+Token makeIntArg(std::int32_t value, const Token::MetaInfo& info)
+{
+  return Token{TT::Integer, Symbol{std::to_string(value)}, value, info};
+}
+
+NodePtr makeInstruction(Symbol mnemonic, std::pmr::vector<Token> args = {})
+{
+  auto pINode = std::make_unique<InstructionNode>();
+  pINode->Mnemonic = mnemonic;
+  pINode->Args = std::move(args);
+  return pINode;
+}
+
+DUnimplemented* asDirective(const NodePtr& pNode, std::string_view name)
+{
+  auto pDir = dynamic_cast<DUnimplemented*>(pNode.get());
+  return pDir && pDir->DirectiveName == name ? pDir : nullptr;
+}
+
+class Lowering
+{
+  public:
+    Lowering(const std::vector<NodePtr>& nodes, const SwitchLoweringOptions& options)
+    : options{options}
+    {
+      for(const auto& pNode : nodes)
+        if(auto pLabel = dynamic_cast<const LabelNode*>(pNode.get()))
+          usedLabels.insert(pLabel->LabelName);
+    }
+
+    //returns true if the lowered code uses the compare tree
+    bool Lower(const SwitchNode& node, std::vector<NodePtr>& out)
+    {
+      if(!node.Args.empty())
+        throw std::runtime_error{fmt::format(
+            "Assembler error: switch takes no operands on line {} col {}",
+            node.Args.front().Info.LineNumber, node.Args.front().Info.LineOffset)};
+
+      cases.assign(node.Cases.begin(), node.Cases.end());
+      std::sort(cases.begin(), cases.end(),
+          [](const SwitchCase& a, const SwitchCase& b) { return a.first < b.first; });
+
+      for(size_t i = 1; i < cases.size(); ++i)
+        if(cases[i].first == cases[i-1].first)
+          throw std::runtime_error{fmt::format(
+              "Assembler error: switch has more than one case {}", cases[i].first)};
+
+      defaultLabel = node.DefaultLabel;
+
+      if(cases.empty())
+      {
+        out.push_back(makeInstruction(Symbol{"pop"}));
+        out.push_back(makeInstruction(Symbol{"goto"}, {labelArg(defaultLabel)}));
+        return false;
+      }
+
+      std::vector<Cluster> plan = planSwitch(cases, options);
+      emit(plan, 0, plan.size(), out);
+      return plan.size() > 1;
+    }
+
+  private:
+    void emit(const std::vector<Cluster>& plan, size_t first, size_t last,
+              std::vector<NodePtr>& out)
+    {
+      if(last - first == 1)
+        return emitLeaf(plan[first], out);
+
+      size_t mid = first + (last - first) / 2;
+      std::int32_t pivot = cases[plan[mid].First].first;
+      Symbol rightLabel = freshLabel();
+
+      IntPush push = pushInt(pivot);
+      std::pmr::vector<Token> pushArgs;
+      if(push.Arg)
+        pushArgs.push_back(makeIntArg(*push.Arg, {}));
+
+      out.push_back(makeInstruction(Symbol{"dup"}));
+      out.push_back(makeInstruction(push.Mnemonic, std::move(pushArgs)));
+      out.push_back(makeInstruction(Symbol{"if_icmpge"}, {labelArg(rightLabel)}));
+
+      emit(plan, first, mid, out);
+
+      auto pLabel = std::make_unique<LabelNode>();
+      pLabel->LabelName = rightLabel;
+      out.push_back(std::move(pLabel));
+
+      emit(plan, mid, last, out);
+    }
+
+    void emitLeaf(const Cluster& cluster, std::vector<NodePtr>& out)
+    {
+      auto pSwitch = std::make_unique<SwitchNode>();
+      pSwitch->DefaultLabel = defaultLabel;
+
+      if(cluster.IsTable)
+      {
+        std::int32_t low  = cases[cluster.First].first;
+        std::int32_t high = cases[cluster.Last-1].first;
+
+        pSwitch->Mnemonic = Symbol{"tableswitch"};
+        pSwitch->Args = {makeIntArg(low, {}), makeIntArg(high, {})};
+
+        //gaps in the range go to the default label
+        size_t next = cluster.First;
+        for(std::int64_t key = low; key <= high; ++key)
+        {
+          bool hasCase = next < cluster.Last && cases[next].first == key;
+          pSwitch->Cases.emplace_back(static_cast<std::int32_t>(key),
+                                      hasCase ? cases[next++].second : defaultLabel);
+        }
+      }
+      else
+      {
+        pSwitch->Mnemonic = Symbol{"lookupswitch"};
+        pSwitch->Cases.assign(cases.begin() + cluster.First, cases.begin() + cluster.Last);
+      }
+
+      out.push_back(std::move(pSwitch));
+    }
+
+    Symbol freshLabel()
+    {
+      Symbol label;
+      do
+        label = Symbol{fmt::format("switch${}", nextLabel++)};
+      while(usedLabels.count(label));
+
+      return label;
+    }
+
+    static Token labelArg(Symbol label)
+    {
+      return Token{TT::Symbol, label, {}, {0, 0, 0}};
+    }
+
+    const SwitchLoweringOptions& options;
+    std::unordered_set<Symbol> usedLabels;
+    size_t nextLabel = 0;
+
+    std::vector<SwitchCase> cases;
+    Symbol defaultLabel;
+};
+
+} //namespace: anonymous
+
+std::vector<NodePtr> LowerSwitches(std::vector<NodePtr> nodes, const SwitchLoweringOptions& options)
+{
+  Lowering lowering{nodes, options};
+
+  std::vector<NodePtr> out;
+  out.reserve(nodes.size());
+
+  //.limit stack of the current method, bumped once for the dup + pivot the
+  //compares keep on top of the key
+  DUnimplemented* pStackLimit = nullptr;
+  bool needsStack = false;
+
+  auto finishMethod = [&]()
+  {
+    if(needsStack && pStackLimit)
+    {
+      Token& limit = pStackLimit->Args[1];
+      limit = makeIntArg(static_cast<std::int32_t>(*limit.IntValue() + 2), limit.Info);
+    }
+
+    pStackLimit = nullptr;
+    needsStack = false;
+  };
+
+  for(auto& pNode : nodes)
+  {
+    if(asDirective(pNode, "method") || asDirective(pNode, "end"))
+      finishMethod();
+
+    if(auto pLimit = asDirective(pNode, "limit"))
+      if(pLimit->Args.size() == 2 && pLimit->Args[0].Value == "stack" &&
+         pLimit->Args[1].IntValue() && *pLimit->Args[1].IntValue() < 0xFFFF - 1)
+        pStackLimit = pLimit;
+
+    auto pSwitch = dynamic_cast<const SwitchNode*>(pNode.get());
+    if(!pSwitch || pSwitch->Mnemonic != "switch")
+    {
+      out.push_back(std::move(pNode));
+      continue;
+    }
+
+    needsStack |= lowering.Lower(*pSwitch, out);
+  }
+
+  finishMethod();
+  return out;
+}
+
+} //namespace: Jasmin
@@ -0,0 +1,71 @@
+#include "Jasmin/Symbol.hpp"
+
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace Jasmin
+{
+
+namespace
+{
+
+struct SymbolPool
+{
+  //NOTE: a deque never moves its elements on push_back so the entries
+  //symbols point to (and the views used as map keys) stay valid
+  std::deque<Symbol::Entry> entries{Symbol::Entry{"", 0}};
+  std::unordered_map<std::string_view, const Symbol::Entry*> ids;
+  mutable std::shared_mutex mutex;
+};
+
+SymbolPool& pool()
+{
+  static SymbolPool symbolPool;
+  return symbolPool;
+}
+
+} //namespace: anonymous
+
+const Symbol::Entry* Symbol::intern(std::string_view str)
+{
+  if(str.empty())
+    return nullptr;
+
+  SymbolPool& p = pool();
+
+  {
+    std::shared_lock lock{p.mutex};
+    auto it = p.ids.find(str);
+    if(it != p.ids.end())
+      return it->second;
+  }
+
+  std::unique_lock lock{p.mutex};
+
+  //another thread may have interned it between the two locks
+  auto it = p.ids.find(str);
+  if(it != p.ids.end())
+    return it->second;
+
+  if(p.entries.size() > std::numeric_limits<ID>::max())
+    throw std::runtime_error{"Symbol pool exhausted"};
+
+  ID newId = static_cast<ID>(p.entries.size());
+  const Entry& stored = p.entries.emplace_back(Entry{std::string{str}, newId});
+  p.ids.emplace(stored.Str, &stored);
+
+  return &stored;
+}
+
+size_t Symbol::PoolSize()
+{
+  const SymbolPool& p = pool();
+  std::shared_lock lock{p.mutex};
+  return p.entries.size();
+}
+
+} //namespace: Jasmin
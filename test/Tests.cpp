@@ -3,10 +3,25 @@
 #include <Jasmin/Lexer.hpp>
 #include <Jasmin/Parser.hpp>
 #include <Jasmin/Assembler.hpp>
+#include <Jasmin/ConstantPool.hpp>
+#include <Jasmin/MethodSplitter.hpp>
+#include <Jasmin/SourceCache.hpp>
+#include <Jasmin/SwitchLowering.hpp>
+#include <Jasmin/BlockLayout.hpp>
+#include <Jasmin/DebugInfo.hpp>
+#include <Jasmin/Instructions.hpp>
+#include <Jasmin/ControlFlowGraph.hpp>
+#include <Jasmin/ClassPathIndex.hpp>
+#include <Jasmin/ConstexprAssembler.hpp>
+#include <Jasmin/JarWriter.hpp>
 
 #include <ClassFile/ClassFile.hpp>
 
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory_resource>
+#include <random>
 
 #include <string>
 #include <sstream>
@@ -29,6 +44,15 @@ static void expectTokens(std::vector<T> tokens,
     EXPECT_EQ(tokens[i].Type, expectedTTs[i]);
 }
 
+//a file in the temp directory no other test run uses, so concurrent runs
+//dont overwrite each others files
+static std::filesystem::path uniqueTempPath(const std::string& name)
+{
+  std::random_device random;
+  return std::filesystem::temp_directory_path() /
+         (std::to_string(random()) + std::to_string(random()) + "-" + name);
+}
+
 TEST(LexerTests, SampleClassAndSuperStatement)
 {
   auto tokens = Jasmin::Lexer::LexAll( std::stringstream{
@@ -66,6 +90,41 @@ TEST(LexerTests, SampleMethodDefinition)
 
 }
 
+TEST(LexerTests, RepeatedSymbolsShareId)
+{
+  auto tokens = Jasmin::Lexer::LexAll( std::stringstream{
+      R"(.super java/lang/Object
+         new java/lang/Object)"});
+
+  ASSERT_EQ(tokens.size(), 6);
+  EXPECT_EQ(tokens[1].Value, "java/lang/Object");
+  EXPECT_EQ(tokens[1].Value.Id(), tokens[4].Value.Id());
+  EXPECT_NE(tokens[1].Value.Id(), tokens[3].Value.Id());
+}
+
+TEST(LexerTests, NumericLiteralsAreTyped)
+{
+  auto tokens = Jasmin::Lexer::LexAll( std::stringstream{
+      "12 -7 0x1F 0xFFFFFFFF -0x10 3000000000 12.5 -1.5e3 .25 2E-2"});
+
+  ASSERT_EQ(tokens.size(), 11);
+  EXPECT_EQ(std::get<std::int32_t>(tokens[0].Num), 12);
+  EXPECT_EQ(std::get<std::int32_t>(tokens[1].Num), -7);
+  EXPECT_EQ(std::get<std::int32_t>(tokens[2].Num), 0x1F);
+  EXPECT_EQ(std::get<std::int64_t>(tokens[3].Num), 0xFFFFFFFF);
+  EXPECT_EQ(tokens[3].Int32Value(), -1);
+  EXPECT_EQ(std::get<std::int32_t>(tokens[4].Num), -16);
+  EXPECT_FALSE(tokens[5].Int32Value());
+  EXPECT_EQ(std::get<std::int64_t>(tokens[5].Num), 3000000000);
+  EXPECT_EQ(tokens[6].DecimalValue(), 12.5);
+  EXPECT_EQ(tokens[7].DecimalValue(), -1500.0);
+  EXPECT_EQ(tokens[8].DecimalValue(), 0.25);
+  EXPECT_EQ(tokens[9].DecimalValue(), 0.02);
+
+  EXPECT_EQ(tokens[3].Value, "0xFFFFFFFF");
+  EXPECT_FALSE(tokens[10].IsNumber());
+}
+
 TEST(ParserTests, ParseDirective)
 {
   auto tokens = Jasmin::Lexer::LexAll( 
@@ -79,9 +138,881 @@ TEST(ParserTests, ParseDirective)
   EXPECT_EQ(pDNode->SuperName, "java/lang/Object");
 }
 
+TEST(ParserTests, ParseLabel)
+{
+  auto nodes = Jasmin::Parser::ParseAll( Jasmin::Lexer::LexAll(
+      std::stringstream{"Loop:\n  goto Loop\n\n\n"}) );
+
+  ASSERT_EQ(nodes.size(), 2);
+  auto pLNode = dynamic_cast<Jasmin::LabelNode*>(nodes[0].get());
+  ASSERT_NE(pLNode, nullptr);
+
+  EXPECT_EQ(pLNode->LabelName, "Loop");
+}
+
+TEST(ParserTests, VisitStreamsStatements)
+{
+  struct Counter : public Jasmin::ParseVisitor
+  {
+    void OnDirective(const T& directive, const std::vector<T>&) override { ++directives; }
+    void OnInstruction(Jasmin::Symbol, const std::vector<T>&) override { ++instructions; }
+    void OnLabel(Jasmin::Symbol label) override { labels.push_back(label.Str()); }
+
+    int directives = 0, instructions = 0;
+    std::vector<std::string> labels;
+  } counter;
+
+  std::stringstream source{
+      R"(.method public static f(I)V
+           iload_0
+           lookupswitch
+             1 : One
+             default : Done
+         One:
+           nop
+         Done:
+           return
+         .end method)"};
+
+  Jasmin::Parser::Visit(Jasmin::Lexer{source}, counter);
+
+  EXPECT_EQ(counter.directives, 2);
+  EXPECT_EQ(counter.instructions, 4);
+  EXPECT_EQ(counter.labels, (std::vector<std::string>{"One", "Done"}));
+
+  auto parse = [](const char* source)
+  {
+    return Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(Jasmin::InStream{source}));
+  };
+  EXPECT_THROW(parse("tableswitch -3000000000\nA\ndefault : A\n"), std::runtime_error);
+  EXPECT_THROW(parse("tableswitch 3000000000\nA\ndefault : A\n"), std::runtime_error);
+  EXPECT_NO_THROW(parse("tableswitch 0x7FFFFFFF\nA\ndefault : A\n"));
+
+  static_assert(!std::is_copy_constructible_v<Jasmin::Parser>, "copies would share tokens");
+}
+
+TEST(ParserTests, SourceCacheRoundTrip)
+{
+  std::string source =
+      R"(.method public static f(I)V
+           ldc 1.5
+           ldc2_w 12345678901
+           tableswitch 0
+             Done
+             default : Done
+         Done:
+           return
+         .end method
+)";
+
+  auto path = uniqueTempPath("JasminSourceCacheTest.jcache");
+  Jasmin::SourceCache::Write(path, Jasmin::SourceCache::Build(source));
+  Jasmin::SourceCache cache = Jasmin::SourceCache::Open(path);
+
+  EXPECT_TRUE(cache.Matches(source));
+  EXPECT_FALSE(cache.Matches(source + " "));
+
+  auto tokens = Jasmin::Lexer::LexAll(Jasmin::InStream{source});
+  auto cachedTokens = cache.Tokens();
+  ASSERT_EQ(cachedTokens.size(), tokens.size());
+  for(size_t i = 0; i < tokens.size(); ++i)
+  {
+    EXPECT_EQ(cachedTokens[i].Type, tokens[i].Type);
+    EXPECT_EQ(cachedTokens[i].Value, tokens[i].Value);
+    EXPECT_EQ(cachedTokens[i].Num, tokens[i].Num);
+    EXPECT_EQ(cachedTokens[i].Info.FileOffset, tokens[i].Info.FileOffset);
+  }
+
+  auto nodes = Jasmin::Parser::ParseAll(tokens);
+  auto cachedNodes = cache.Nodes();
+  ASSERT_EQ(cachedNodes.size(), nodes.size());
+
+  auto pSwitch = dynamic_cast<Jasmin::SwitchNode*>(cachedNodes[3].get());
+  ASSERT_NE(pSwitch, nullptr);
+  EXPECT_EQ(pSwitch->Cases.size(), 1u);
+  EXPECT_EQ(pSwitch->DefaultLabel, "Done");
+
+  std::filesystem::remove(path);
+  EXPECT_THROW(Jasmin::SourceCache{std::string(128, 'x')}, std::runtime_error);
+}
+
+//counts the bytes it hands out that havent been given back yet
+class CountingResource : public std::pmr::memory_resource
+{
+  public:
+    size_t Allocations = 0;
+    size_t Outstanding = 0;
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+      ++Allocations;
+      Outstanding += bytes;
+      return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+      Outstanding -= bytes;
+      std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+      return this == &other;
+    }
+};
+
+//nodes from a resource remember it themselves, the pointers stay plain
+static_assert(sizeof(Jasmin::NodePtr) == sizeof(Jasmin::Node*), "NodePtr holds no deleter state");
+
+TEST(ParserTests, ParsesIntoMemoryResource)
+{
+  std::string source = ".method public f(I)V\n  bipush 7\n  ifeq Done\n"
+                       "  tableswitch 0\n    A\n    default : Done\nA:\nDone:\n  return\n"
+                       ".end method\n";
+
+  CountingResource resource;
+  {
+    std::pmr::vector<Jasmin::Token> tokens = Jasmin::Lexer::LexAll(Jasmin::InStream{source}, &resource);
+    EXPECT_EQ(tokens.get_allocator().resource(), &resource);
+
+    auto nodes = Jasmin::Parser::ParseAll(tokens, &resource);
+    auto expected = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(Jasmin::InStream{source}));
+    ASSERT_EQ(nodes.size(), expected.size());
+
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+      auto pINode = dynamic_cast<Jasmin::InstructionNode*>(nodes[i].get());
+      auto pExpected = dynamic_cast<Jasmin::InstructionNode*>(expected[i].get());
+      ASSERT_EQ(!pINode, !pExpected);
+
+      if(!pINode)
+        continue;
+
+      EXPECT_EQ(pINode->Mnemonic, pExpected->Mnemonic);
+      EXPECT_EQ(pINode->Args.size(), pExpected->Args.size());
+      EXPECT_EQ(pINode->Args.get_allocator().resource(), &resource);
+    }
+
+    //tokens, list and every node (plus the args and cases it has)
+    EXPECT_GE(resource.Allocations, 3 + nodes.size());
+  }
+
+  EXPECT_EQ(resource.Outstanding, 0u);
+}
+
 TEST(AssemblerTests, SuperClass)
 {
   auto cf = Jasmin::Assembler::Assemble(".super foobar");
   EXPECT_EQ(cf.ConstPool.LookupString(cf.SuperClass).GetOrElse(""), "foobar");
 }
 
+TEST(AssemblerTests, HotLdcConstantsGetLowPoolIndices)
+{
+  std::stringstream source;
+  for(int i = 0; i < 300; ++i)
+    source << "ldc \"cold" << i << "\"\n";
+  for(int i = 0; i < 5; ++i)
+    source << "ldc 123456\nldc 5\n";
+
+  auto nodes = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(source));
+
+  Jasmin::ConstantPoolLayout layout;
+  layout.Profile(nodes);
+  layout.Finalize();
+
+  using Jasmin::Constant;
+  Constant hot{Constant::Kind::Integer, std::int32_t{123456}};
+  Constant cold{Constant::Kind::String, Jasmin::Symbol{"cold299"}};
+  Constant folded{Constant::Kind::Integer, std::int32_t{5}};
+
+  EXPECT_EQ(layout.IndexOf(hot), 1);
+  EXPECT_EQ(Jasmin::LowerConstantLoad(hot, layout).Mnemonic, "ldc");
+  EXPECT_EQ(Jasmin::LowerConstantLoad(cold, layout).Mnemonic, "ldc_w");
+  EXPECT_EQ(Jasmin::LowerConstantLoad(folded, layout).Mnemonic, "iconst_5");
+  EXPECT_EQ(Jasmin::LowerConstantLoad(hot, layout).PoolIndex, std::optional<Jasmin::U16>{1});
+  EXPECT_EQ(Jasmin::LowerConstantLoad(hot, layout).Immediate, std::nullopt);
+  EXPECT_EQ(Jasmin::LowerConstantLoad(Constant{Constant::Kind::Integer, std::int32_t{300}}, layout).Immediate,
+            std::optional<std::int32_t>{300});
+  EXPECT_THROW(layout.IndexOf(folded), std::logic_error);
+
+  //the assembler lays the pool out the same way
+  Jasmin::ConstantPoolLayout assembled;
+  Jasmin::AssemblerOptions options;
+  options.PoolLayout = &assembled;
+  Jasmin::Assembler::Assemble(Jasmin::InStream{".method public static f()V\n" + source.str() +
+                                               "  return\n.end method\n"}, options);
+  EXPECT_TRUE(assembled.IsFinal());
+  EXPECT_EQ(assembled.IndexOf(hot), 1);
+  EXPECT_GT(assembled.IndexOf(cold), Jasmin::ConstantPoolLayout::MaxLdcIndex);
+
+  //hex literals are bit patterns for ldc and magnitudes for ldc2_w
+  auto loads = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(std::stringstream{
+      "ldc 0xFFFFFFFF\nldc2_w 0xFFFFFFFF\n"}));
+  auto loaded = [&loads](size_t i)
+  {
+    return Constant::FromLoad(dynamic_cast<const Jasmin::InstructionNode&>(*loads[i]));
+  };
+  EXPECT_EQ(loaded(0), (Constant{Constant::Kind::Integer, std::int32_t{-1}}));
+  EXPECT_EQ(loaded(1), (Constant{Constant::Kind::Long, std::int64_t{0xFFFFFFFF}}));
+}
+
+TEST(AssemblerTests, ConstantPoolLayoutHoldsReferences)
+{
+  auto nodes = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(std::stringstream{
+      "getstatic java/lang/System/out Ljava/io/PrintStream;\n"
+      "ldc \"hi\"\n"
+      "invokevirtual java/io/PrintStream/println(Ljava/lang/String;)V\n"
+      "ldc 1.0\n"}));
+
+  Jasmin::ConstantPoolLayout layout;
+  layout.Profile(nodes);
+  layout.Finalize();
+
+  using Jasmin::Constant;
+  using Jasmin::Symbol;
+  Constant out{Constant::Kind::Fieldref, Jasmin::MemberRef{
+      Symbol{"java/lang/System"}, Symbol{"out"}, Symbol{"Ljava/io/PrintStream;"}}};
+  Constant nameAndType{Constant::Kind::NameAndType, Jasmin::MemberRef{
+      Symbol{}, Symbol{"out"}, Symbol{"Ljava/io/PrintStream;"}}};
+
+  //the ldc constant first, then the references, then what they point at
+  EXPECT_EQ(layout.IndexOf(Constant{Constant::Kind::String, Symbol{"hi"}}), 1);
+  EXPECT_LT(layout.IndexOf(out), layout.IndexOf(nameAndType));
+  EXPECT_LT(layout.IndexOf(nameAndType),
+            layout.IndexOf(Constant{Constant::Kind::Utf8, Symbol{"Ljava/io/PrintStream;"}}));
+  EXPECT_NO_THROW(layout.IndexOf(Constant{Constant::Kind::Class, Symbol{"java/io/PrintStream"}}));
+  EXPECT_NO_THROW(layout.IndexOf(Constant{Constant::Kind::Utf8, Symbol{"Code"}}));
+
+  nodes = Jasmin::LowerConstantLoads(std::move(nodes), layout);
+  EXPECT_EQ(dynamic_cast<const Jasmin::InstructionNode&>(*nodes[3]).Mnemonic, "fconst_1");
+
+  auto tooBig = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(std::stringstream{"ldc 1e39\n"}));
+  EXPECT_THROW(Jasmin::ConstantPoolLayout{}.Profile(tooBig), std::runtime_error);
+}
+
+TEST(AssemblerTests, SplitsOversizedMethod)
+{
+  std::stringstream source;
+  source << ".class public Big\n.super java/lang/Object\n"
+         << ".method public static run(J)I\n.limit stack 2\n.limit locals 3\n"
+         << "iconst_0\nistore_2\n";
+  for(int i = 0; i < 30000; ++i)
+    source << "iinc 2 1\n";
+  source << "lload_0\nl2i\niload_2\niadd\nireturn\n.end method\n";
+
+  auto nodes = Jasmin::SplitOversizedMethods(
+      Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(source)));
+
+  std::vector<std::pair<std::string, size_t>> methods;
+  for(auto it = nodes.begin(); it != nodes.end(); ++it)
+  {
+    auto pDir = dynamic_cast<Jasmin::DUnimplemented*>(it->get());
+    if(!pDir || pDir->DirectiveName != "method")
+      continue;
+
+    auto end = it;
+    while(dynamic_cast<Jasmin::DUnimplemented*>(end->get()) == nullptr ||
+          static_cast<Jasmin::DUnimplemented&>(**end).DirectiveName != "end")
+      ++end;
+
+    methods.emplace_back(pDir->Args.back().Value.Str(), Jasmin::CodeSize(it, end));
+  }
+
+  ASSERT_EQ(methods.size(), 2);
+  EXPECT_EQ(methods[0].first, "run(J)I");
+  EXPECT_EQ(methods[1].first, "run$split0(JI)I");
+  EXPECT_LE(methods[0].second, 65535);
+  EXPECT_LE(methods[1].second, 65535);
+
+  //local 1 is only stored on one path into the cut, the tail stores it
+  //before reading it so it isnt passed
+  std::stringstream branchy;
+  branchy << ".class public Big\n.super java/lang/Object\n"
+          << ".method public static run(I)I\n.limit stack 2\n.limit locals 3\n"
+          << "iload_0\nifeq Skip\niconst_1\nistore_1\nSkip:\niconst_0\nistore_2\n";
+  for(int i = 0; i < 30000; ++i)
+    branchy << "iinc 2 1\n";
+  branchy << "iconst_5\nistore_1\niload_1\niload_2\niadd\nireturn\n.end method\n";
+
+  nodes = Jasmin::SplitOversizedMethods(Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(branchy)));
+
+  std::vector<std::string> names;
+  for(const auto& pNode : nodes)
+  {
+    auto pDir = dynamic_cast<Jasmin::DUnimplemented*>(pNode.get());
+    if(pDir && pDir->DirectiveName == "method")
+      names.push_back(pDir->Args.back().Value.Str());
+  }
+
+  EXPECT_EQ(names, (std::vector<std::string>{"run(I)I", "run$split0(I)I"}));
+}
+
+TEST(AssemblerTests, LowersSwitchByDensity)
+{
+  auto lower = [](std::string cases)
+  {
+    std::vector<std::string> lowered;
+    auto nodes = Jasmin::LowerSwitches(Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(
+        Jasmin::InStream{".limit stack 1\nswitch\n" + cases + "default : D\n"})));
+
+    for(const auto& pNode : nodes)
+      if(auto pINode = dynamic_cast<Jasmin::InstructionNode*>(pNode.get()))
+        lowered.push_back(pINode->Mnemonic.Str());
+      else if(auto pLimit = dynamic_cast<Jasmin::DUnimplemented*>(pNode.get()))
+        lowered.push_back("limit " + pLimit->Args[1].Value.Str());
+
+    return lowered;
+  };
+
+  std::string dense, sparse, clustered;
+  for(int key : {1, 2, 3, 5, 6, 7})
+    dense += std::to_string(key) + " : A\n";
+  for(int key : {-100000, 7, 4000, 90000})
+    sparse += std::to_string(key) + " : A\n";
+  for(int key : {0, 1, 2, 3, 4, 5, 1000000, 1000001, 1000002, 1000003, 1000004})
+    clustered += std::to_string(key) + " : A\n";
+
+  using Mnemonics = std::vector<std::string>;
+  EXPECT_EQ(lower(dense),  (Mnemonics{"limit 1", "tableswitch"}));
+  EXPECT_EQ(lower(sparse), (Mnemonics{"limit 1", "lookupswitch"}));
+  EXPECT_EQ(lower(clustered),
+      (Mnemonics{"limit 3", "dup", "ldc", "if_icmpge", "tableswitch", "tableswitch"}));
+
+  EXPECT_THROW(lower("1 : A\n1 : B\n"), std::runtime_error);
+}
+
+TEST(AssemblerTests, SwitchPaddingAlignsOperands)
+{
+  auto nodes = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(
+      Jasmin::InStream{"lookupswitch\n1 : A\ndefault : B\n"}));
+  auto& lookup = static_cast<Jasmin::InstructionNode&>(*nodes.front());
+
+  for(size_t offset = 0; offset < 8; ++offset)
+  {
+    size_t padding = Jasmin::SwitchPadding(offset);
+    EXPECT_EQ((offset + 1 + padding) % 4, 0u);
+    EXPECT_EQ(Jasmin::EncodedSize(lookup, offset), 1 + padding + 8 + 8);
+  }
+}
+
+TEST(AssemblerTests, CodeOffsetsWidenWhereNeeded)
+{
+  auto codeSize = [](const std::string& source)
+  {
+    auto nodes = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(Jasmin::InStream{source}));
+    return Jasmin::CodeOffsets(nodes.begin(), nodes.end()).back();
+  };
+
+  EXPECT_EQ(codeSize("wide\niload 5\n"), 4u);
+  EXPECT_EQ(codeSize("wide\niinc 5 1\n"), 6u);
+  EXPECT_THROW(codeSize("wide\nnop\n"), std::runtime_error);
+
+  //ldc may need ldc_w until the pool is laid out
+  auto nodes = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(Jasmin::InStream{"ldc 123456\n"}));
+  auto& ldc = static_cast<Jasmin::InstructionNode&>(*nodes.front());
+  Jasmin::ConstantPoolLayout layout;
+  layout.Profile(nodes);
+  layout.Finalize();
+  EXPECT_EQ(Jasmin::EncodedSize(ldc, 0), 3u);
+  EXPECT_EQ(Jasmin::EncodedSize(ldc, 0, &layout), 2u);
+
+  //11000 iinc are 33000 bytes, out of reach of a 2 byte branch offset
+  std::string body;
+  for(int i = 0; i < 11000; ++i)
+    body += "iinc 1 1\n";
+
+  EXPECT_EQ(codeSize("Top:\n" + body + "goto Top\n"), 33000u + 5);
+  EXPECT_EQ(codeSize("ifeq End\n" + body + "End:\nreturn\n"), 3 + 5 + 33000u + 1);
+  EXPECT_EQ(codeSize("ifeq End\nEnd:\n" + body), 3 + 33000u);
+}
+
+TEST(AssemblerTests, ControlFlowGraphBlocksAndDominators)
+{
+  auto body = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(Jasmin::InStream{
+      R"(  iload_0
+           ifeq Else
+           iconst_1
+           goto Join
+         Else:
+           iconst_2
+         Join:
+           istore_1
+         Loop:
+           iinc 1 -1
+           iload_1
+           ifgt Loop
+         Start:
+           invokestatic A/f()V
+         End:
+           return
+         Handler:
+           athrow
+           nop
+         .catch java/lang/Exception from Start to End using Handler
+)"}));
+
+  Jasmin::ControlFlowGraph cfg{body.begin(), body.end()};
+  using Blocks = std::vector<Jasmin::ControlFlowGraph::BlockId>;
+  auto succs = [&cfg](Jasmin::ControlFlowGraph::BlockId b)
+  {
+    return Blocks(cfg.Successors(b).begin(), cfg.Successors(b).end());
+  };
+
+  //entry, then, Else, Join, Loop, Start, End, Handler, dead nop
+  ASSERT_EQ(cfg.BlockCount(), 9u);
+  EXPECT_EQ(succs(0), (Blocks{2, 1}));
+  EXPECT_EQ(succs(1), (Blocks{3}));
+  EXPECT_EQ(succs(4), (Blocks{4, 5}));
+  EXPECT_EQ(Blocks(cfg.Handlers(5).begin(), cfg.Handlers(5).end()), (Blocks{7}));
+  EXPECT_TRUE(cfg.Handlers(6).empty());
+  EXPECT_EQ(cfg.BlockOf(Jasmin::Symbol{"Join"}), 3u);
+
+  EXPECT_FALSE(cfg.IsReachable(8));
+  EXPECT_EQ(cfg.ReversePostorder().size(), 8u);
+  EXPECT_EQ(cfg.ReversePostorder().front(), 0u);
+
+  Jasmin::DominatorTree dominators{cfg};
+  EXPECT_EQ(dominators.ImmediateDominator(3), 0u);
+  EXPECT_EQ(dominators.ImmediateDominator(7), 5u);
+  EXPECT_TRUE(dominators.Dominates(3, 6));
+  EXPECT_TRUE(dominators.Dominates(4, 4));
+  EXPECT_FALSE(dominators.Dominates(1, 3));
+  EXPECT_FALSE(dominators.Dominates(0, 8));
+}
+
+TEST(AssemblerTests, ChecksReferencesAgainstClassPath)
+{
+  std::filesystem::path res = RES_DIR;
+  auto path = uniqueTempPath("JasminClassPathTest.idx");
+  Jasmin::ClassPathIndex::Write(path, Jasmin::ClassPathIndex::Build(
+      {res / "classpath" / "classes", res / "classpath" / "lib.jar"}));
+
+  Jasmin::ClassPathIndex classpath = Jasmin::ClassPathIndex::Open(path);
+  EXPECT_EQ(classpath.ClassCount(), 3u);
+  EXPECT_TRUE(classpath.HasClass("demo/Base"));
+  EXPECT_FALSE(classpath.HasClass("demo/Missing"));
+
+  auto check = [&classpath](const std::string& instruction, bool requireKnownClasses = false)
+  {
+    Jasmin::CheckReferences(Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(
+        Jasmin::InStream{".class public Self\n" + instruction + "\n"})), classpath,
+        Jasmin::ReferenceCheckOptions{requireKnownClasses});
+  };
+
+  //declared, inherited from the superclass, the interface and Object
+  EXPECT_NO_THROW(check("getstatic demo/Greeter/INSTANCE Ldemo/Greeter;"));
+  EXPECT_NO_THROW(check("getfield demo/Greeter/count I"));
+  EXPECT_NO_THROW(check("invokevirtual demo/Greeter/greet(Ljava/lang/String;)V"));
+  EXPECT_NO_THROW(check("invokeinterface demo/Greeter/area()D 1"));
+  EXPECT_NO_THROW(check("invokevirtual demo/Greeter/hashCode()I"));
+  EXPECT_NO_THROW(check("invokestatic Self/helper()V"));
+
+  EXPECT_THROW(check("invokevirtual demo/Greeter/greet(I)V"), std::runtime_error);
+  EXPECT_THROW(check("getfield demo/Base/count J"), std::runtime_error);
+  EXPECT_NO_THROW(check("invokestatic demo/Missing/f()V"));
+  EXPECT_THROW(check("invokestatic demo/Missing/f()V", true), std::runtime_error);
+  EXPECT_THROW(check("getstatic /x I"), std::runtime_error);
+
+  std::filesystem::remove(path);
+}
+
+constexpr auto ConstexprClass = JASMIN_CLASS(R"(
+.class public Answer
+.super java/lang/Object
+
+.method public static answer(I)I
+  .limit stack 2
+  iload_0
+  ifle Negative
+  bipush 42
+  ireturn
+Negative:
+  ldc "no"
+  pop
+  iconst_m1
+  ireturn
+.end method
+)");
+
+static_assert(ConstexprClass[0] == 0xCA && ConstexprClass[3] == 0xBE, "class file magic");
+static_assert(ConstexprClass[7] == 49, "class file major version");
+
+TEST(AssemblerTests, AssemblesClassAtCompileTime)
+{
+  EXPECT_EQ(ConstexprClass.size(), Jasmin::Constexpr::ClassFileSize(R"(
+.class public Answer
+.super java/lang/Object
+
+.method public static answer(I)I
+  .limit stack 2
+  iload_0
+  ifle Negative
+  bipush 42
+  ireturn
+Negative:
+  ldc "no"
+  pop
+  iconst_m1
+  ireturn
+.end method
+)"));
+
+  //the code is followed by an empty exception table, no code attributes and
+  //no class attributes
+  const std::uint8_t code[] = {0x1a, 0x9e, 0x00, 0x06, 0x10, 42, 0xac, 0x12};
+  auto pCode = ConstexprClass.end() - 6 - 12;
+  EXPECT_EQ(pCode[-1], 12);
+  EXPECT_TRUE(std::equal(std::begin(code), std::end(code), pCode));
+  EXPECT_EQ(pCode[9], 0x57);
+
+  EXPECT_THROW(Jasmin::Constexpr::ClassFileSize(
+      ".class A\n.method f()V\ngoto Nowhere\n.end method\n"), std::runtime_error);
+  EXPECT_THROW(Jasmin::Constexpr::ClassFileSize(
+      ".class A\n.method f()V\ntableswitch 0\n.end method\n"), std::runtime_error);
+
+  //directives it doesnt know are errors, not skipped
+  EXPECT_THROW(Jasmin::Constexpr::ClassFileSize(
+      ".class A\n.method f()V\n.limt stack 1\nreturn\n.end method\n"), std::runtime_error);
+  EXPECT_THROW(Jasmin::Constexpr::ClassFileSize(
+      ".class A\n.source A.j\n"), std::runtime_error);
+
+  //and so are misspelled modifiers
+  EXPECT_THROW(Jasmin::Constexpr::ClassFileSize(".class publc A\n"), std::runtime_error);
+  EXPECT_THROW(Jasmin::Constexpr::ClassFileSize(
+      ".class A\n.method pubic statc f()V\nreturn\n.end method\n"), std::runtime_error);
+  EXPECT_THROW(Jasmin::Constexpr::ClassFileSize(".class A\n.field varargs x I\n"), std::runtime_error);
+  EXPECT_NO_THROW(Jasmin::Constexpr::ClassFileSize(
+      ".class public final synthetic A\n.method public static varargs strict f([I)V\nreturn\n.end method\n"));
+
+  //a label in front of an instruction keeps the instruction
+  EXPECT_EQ(Jasmin::Constexpr::ClassFileSize(".class A\n.method f()V\nL: return\n.end method\n"),
+            Jasmin::Constexpr::ClassFileSize(".class A\n.method f()V\nL:\nreturn\n.end method\n"));
+
+  constexpr auto handled = JASMIN_CLASS(R"(
+.class A
+.method static f()V
+  .catch all from Start to End using Handler
+Start: nop
+End: return
+Handler: athrow
+.end method
+)");
+
+  //start, end, handler, catch type (0 for all), then no code and no class
+  //attributes
+  const std::uint8_t handler[] = {0, 1, 0, 0, 0, 1, 0, 2, 0, 0, 0, 0, 0, 0};
+  EXPECT_TRUE(std::equal(std::begin(handler), std::end(handler), handled.end() - 14));
+}
+
+constexpr std::string_view CrossCheckSource = R"(
+.class public Check
+.super java/lang/Object
+
+.method public static check(I)I
+  .limit stack 4
+  .limit locals 400
+  .catch java/lang/RuntimeException from Start to End using Handler
+Start: ldc "say \"hi\"\n"
+  pop
+  ldc 0xFFFFFFFF
+  ldc 0x80000000
+  ldc 100
+  ldc 1000
+  ldc 5
+  ldc_w 123456
+  ldc java/lang/String
+  ldc2_w 1
+  ldc2_w 0x100000000
+  wide
+  iload 2
+  istore 300
+  iinc 300 1000
+  iinc 1 1
+  iload_0
+  ifle End
+  getstatic java/lang/System/out Ljava/io/PrintStream;
+  invokevirtual java/io/PrintStream/println(I)V
+End: ireturn
+Handler:
+  athrow
+.end method
+)";
+
+constexpr auto CrossCheckClass = Jasmin::Constexpr::AssembleClassFile<
+    Jasmin::Constexpr::ClassFileSize(CrossCheckSource)>(CrossCheckSource);
+
+TEST(AssemblerTests, CompileTimeAssemblyMatchesRunTime)
+{
+  //both front ends read the same opcode table
+  for(const Jasmin::Opcode& opcode : Jasmin::Opcodes)
+  {
+    const Jasmin::InstructionInfo* pInfo = Jasmin::LookupInstruction(Jasmin::Symbol{opcode.Mnemonic});
+    ASSERT_NE(pInfo, nullptr) << opcode.Mnemonic;
+    EXPECT_EQ(pInfo->Code, opcode.Code);
+    EXPECT_EQ(pInfo->OperandBytes, Jasmin::OperandBytes(opcode.Kind));
+  }
+
+  //the run time pipeline up to the encoding: constant loads lowered against
+  //the final pool layout, then the code offsets
+  auto nodes = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(
+      Jasmin::InStream{std::string{CrossCheckSource}}));
+  Jasmin::ConstantPoolLayout layout;
+  layout.Profile(nodes);
+  layout.Finalize();
+  nodes = Jasmin::LowerConstantLoads(std::move(nodes), layout);
+  std::vector<size_t> offsets = Jasmin::CodeOffsets(nodes.begin(), nodes.end(), &layout);
+
+  //one method with one exception handler, no code and no class attributes
+  const std::uint8_t* pClass = CrossCheckClass.data();
+  const std::uint8_t* pCode = pClass + CrossCheckClass.size() - 2 - 2 - (2 + 8) - offsets.back();
+  auto u2 = [](const std::uint8_t* p) { return static_cast<std::uint32_t>(p[0] << 8 | p[1]); };
+  auto u4 = [&u2](const std::uint8_t* p) { return u2(p) << 16 | u2(p + 2); };
+  ASSERT_EQ(u4(pCode - 4), offsets.back());
+
+  //offset of every pool entry by index
+  std::vector<const std::uint8_t*> pool(u2(pClass + 8));
+  const std::uint8_t* pEntry = pClass + 10;
+  for(size_t i = 1; i < pool.size(); ++i)
+  {
+    pool[i] = pEntry;
+    switch(*pEntry)
+    {
+      case 1: pEntry += 3 + u2(pEntry + 1); break;
+      case 3: pEntry += 5; break;
+      case 5: pEntry += 9; ++i; break;
+      case 7: case 8: pEntry += 3; break;
+      default: pEntry += 5; break;
+    }
+  }
+  auto utf8 = [&](std::uint32_t index)
+  {
+    return std::string_view{reinterpret_cast<const char*>(pool[index] + 3), u2(pool[index] + 1)};
+  };
+
+  size_t i = 0;
+  for(const auto& pNode : nodes)
+  {
+    auto pINode = dynamic_cast<const Jasmin::InstructionNode*>(pNode.get());
+    if(!pINode)
+      continue;
+
+    const std::uint8_t* pInstr = pCode + offsets[i++];
+    bool implicitWide = *pInstr == 0xc4 && pINode->Mnemonic != "wide";
+    EXPECT_EQ(pInstr[implicitWide ? 1 : 0],
+              Jasmin::GetInstruction(*pINode).Code) << pINode->Mnemonic.View();
+
+    auto constant = Jasmin::Constant::FromLoad(*pINode);
+    if(!constant)
+      continue;
+
+    const std::uint8_t* pConstant = pool[pINode->Mnemonic == "ldc" ? pInstr[1] : u2(pInstr + 1)];
+    using Kind = Jasmin::Constant::Kind;
+    ASSERT_EQ(*pConstant, static_cast<std::uint8_t>(constant->Type));
+
+    if(constant->Type == Kind::Integer)
+      EXPECT_EQ(static_cast<std::int32_t>(u4(pConstant + 1)), std::get<std::int32_t>(constant->Value));
+    else if(constant->Type == Kind::Long)
+      EXPECT_EQ(std::uint64_t{u4(pConstant + 1)} << 32 | u4(pConstant + 5),
+                static_cast<std::uint64_t>(std::get<std::int64_t>(constant->Value)));
+    else
+      EXPECT_EQ(utf8(u2(pConstant + 1)), std::get<Jasmin::Symbol>(constant->Value).View());
+  }
+  EXPECT_EQ(i + 1, offsets.size());
+}
+
+TEST(AssemblerTests, ReordersBlocksByProfile)
+{
+  auto layout = [](const Jasmin::BlockProfile& profile)
+  {
+    auto nodes = Jasmin::ReorderBlocks(Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(
+        Jasmin::InStream{R"(.method public static f(I)I
+  .limit stack 3
+  .catch java/lang/RuntimeException from Check to Done using Handler
+Check:
+  iload_0
+  ifge Positive
+  new java/lang/IllegalArgumentException
+  dup
+  invokespecial java/lang/IllegalArgumentException/<init>()V
+  athrow
+Positive:
+  iload_0
+  iconst_1
+  if_icmpne Done
+  iconst_0
+  ireturn
+Done:
+  iload_0
+  ireturn
+Handler:
+  iconst_m1
+  ireturn
+.end method
+)"})), profile);
+
+    std::vector<std::string> lines;
+    for(const auto& pNode : nodes)
+    {
+      if(auto pLabel = dynamic_cast<Jasmin::LabelNode*>(pNode.get()))
+        lines.push_back(pLabel->LabelName.Str() + ":");
+      else if(auto pINode = dynamic_cast<Jasmin::InstructionNode*>(pNode.get());
+              pINode && pINode->Mnemonic.View().substr(0, 2) == "if")
+        lines.push_back(pINode->Mnemonic.Str() + " " + pINode->Args[0].Value.Str());
+      else if(auto pDir = dynamic_cast<Jasmin::DUnimplemented*>(pNode.get());
+              pDir && pDir->DirectiveName == "catch")
+        lines.push_back("catch " + pDir->Args[2].Value.Str() + " " + pDir->Args[4].Value.Str());
+    }
+
+    return lines;
+  };
+
+  using Lines = std::vector<std::string>;
+
+  //the throw is cold and the taken side of the compare is hot
+  EXPECT_EQ(layout({{Jasmin::Symbol{"Positive"}, 100}, {Jasmin::Symbol{"Done"}, 90}}),
+      (Lines{"Check:", "iflt layout$0", "Positive:", "if_icmpeq layout$1", "Done:",
+             "layout$1:", "layout$0:", "Handler:", "catch Check Done", "catch layout$1 Handler"}));
+
+  //qualified labels win, unprofiled methods keep their order
+  EXPECT_EQ(layout({{Jasmin::Symbol{"f(I)I:Positive"}, 0}, {Jasmin::Symbol{"Positive"}, 5}}),
+      (Lines{"catch Check Done", "Check:", "ifge Positive", "Positive:", "if_icmpne Done",
+             "Done:", "Handler:"}));
+  EXPECT_EQ(layout({{Jasmin::Symbol{"Elsewhere"}, 5}}),
+      (Lines{"catch Check Done", "Check:", "ifge Positive", "Positive:", "if_icmpne Done",
+             "Done:", "Handler:"}));
+}
+
+
+TEST(AssemblerTests, DebugInfoPolicies)
+{
+  auto nodes = Jasmin::Parser::ParseAll(Jasmin::Lexer::LexAll(Jasmin::InStream{R"(.source Demo.j
+.method public static f(I)I
+  .var 0 is n I from Begin to Middle
+  .var 0 is n I from Middle to End
+  .var 1 is tmp J
+  .line 10
+Begin:
+  iload_0
+  iconst_1
+  .line 10
+  iadd
+Middle:
+  .line 11
+  .line 12
+  ireturn
+End:
+.end method
+)"}));
+
+  auto body = [&nodes](Jasmin::DebugInfoPolicy policy)
+  {
+    return Jasmin::BuildDebugInfo(nodes.begin() + 2, nodes.end() - 1, policy);
+  };
+
+  using Lines = std::vector<std::pair<int, int>>;
+  auto lines = [](const Jasmin::MethodDebugInfo& info)
+  {
+    Lines pcLines;
+    for(const auto& entry : info.LineNumbers)
+      pcLines.emplace_back(entry.StartPc, entry.LineNumber);
+    return pcLines;
+  };
+
+  Jasmin::MethodDebugInfo full = body(Jasmin::DebugInfoPolicy::Full);
+  EXPECT_EQ(lines(full), (Lines{{0, 10}, {1, 10}, {2, 10}, {3, 12}}));
+  ASSERT_EQ(full.LocalVariables.size(), 3u);
+  EXPECT_EQ(full.LocalVariables[1].StartPc, 3);
+  EXPECT_EQ(full.LocalVariables[2].Length, 4);
+
+  Jasmin::MethodDebugInfo compact = body(Jasmin::DebugInfoPolicy::Compact);
+  EXPECT_EQ(lines(compact), (Lines{{0, 10}, {3, 12}}));
+  ASSERT_EQ(compact.LocalVariables.size(), 2u);
+  EXPECT_EQ(compact.LocalVariables[0].Name, "n");
+  EXPECT_EQ(compact.LocalVariables[0].Length, 4);
+
+  Jasmin::MethodDebugInfo strip = body(Jasmin::DebugInfoPolicy::Strip);
+  EXPECT_TRUE(strip.LineNumbers.empty() && strip.LocalVariables.empty());
+
+  EXPECT_EQ(Jasmin::SourceFile(nodes, Jasmin::DebugInfoPolicy::Compact), Jasmin::Symbol{"Demo.j"});
+  EXPECT_FALSE(Jasmin::SourceFile(nodes, Jasmin::DebugInfoPolicy::Strip));
+
+  size_t count = nodes.size();
+  nodes = Jasmin::StripDebugInfo(std::move(nodes));
+  EXPECT_EQ(nodes.size(), count - 8);
+  EXPECT_FALSE(Jasmin::SourceFile(nodes, Jasmin::DebugInfoPolicy::Full));
+
+  //the assembler rejects malformed debug info unless it is stripped
+  std::string badLine = ".method public static g()V\n  .line x\n  return\n.end method\n";
+  Jasmin::AssemblerOptions options;
+  EXPECT_THROW(Jasmin::Assembler::Assemble(Jasmin::InStream{badLine}, options), std::runtime_error);
+  options.DebugInfo = Jasmin::DebugInfoPolicy::Strip;
+  EXPECT_NO_THROW(Jasmin::Assembler::Assemble(Jasmin::InStream{badLine}, options));
+}
+
+TEST(AssemblerTests, WritesReproducibleJar)
+{
+  std::filesystem::path res = RES_DIR;
+  std::ifstream classFile{res / "classpath" / "classes" / "demo" / "Greeter.class", std::ios::binary};
+  std::stringstream greeter;
+  greeter << classFile.rdbuf();
+
+  std::vector<Jasmin::JarEntry> entries{
+    {"demo/Greeter.class", greeter.str()},
+    {"demo/Tiny.txt", "x"},
+    {"demo/Repeated.txt", std::string(4096, 'a')},
+  };
+
+  Jasmin::JarOptions serial;
+  serial.Threads = 1;
+  Jasmin::JarOptions parallel;
+  parallel.Threads = 8;
+
+  std::string jar = Jasmin::BuildJar(entries, serial);
+  EXPECT_EQ(jar, Jasmin::BuildJar(entries, parallel));
+  EXPECT_EQ(jar, Jasmin::BuildJar({entries.rbegin(), entries.rend()}, parallel));
+  EXPECT_LT(jar.size(), greeter.str().size() + 4096);
+
+  auto path = uniqueTempPath("JasminJarTest.jar");
+  Jasmin::WriteJar(path, entries, parallel);
+  std::string image = Jasmin::ClassPathIndex::Build({path});
+  EXPECT_TRUE(Jasmin::ClassPathIndex{image}.HasClass("demo/Greeter"));
+  std::filesystem::remove(path);
+
+  entries.push_back({"demo/Tiny.txt", "y"});
+  EXPECT_THROW(Jasmin::BuildJar(entries), std::runtime_error);
+
+  //a count of 65535 reads as zip64, so it is one entry too many
+  std::vector<Jasmin::JarEntry> many(0xFFFF);
+  for(size_t i = 0; i < many.size(); ++i)
+    many[i].Name = std::to_string(i);
+  EXPECT_THROW(Jasmin::BuildJar(many, {1, 0, false}), std::runtime_error);
+}
+
+TEST(AssemblerTests, CachesSameNamedSourcesSeparately)
+{
+  auto dir = uniqueTempPath("JasminSourceCacheDir");
+  std::filesystem::create_directories(dir / "a");
+  std::filesystem::create_directories(dir / "b");
+  std::ofstream{dir / "a" / "Main.j"} << ".method public static f()V\n  return\n.end method\n";
+  std::ofstream{dir / "b" / "Main.j"} << ".method public static g()V\n  return\n.end method\n";
+
+  Jasmin::AssemblerOptions options;
+  options.SourceCacheDir = dir / "cache";
+  Jasmin::Assembler::AssembleFile(dir / "a" / "Main.j", options);
+  Jasmin::Assembler::AssembleFile(dir / "b" / "Main.j", options);
+
+  std::vector<std::filesystem::path> images;
+  for(const auto& entry : std::filesystem::directory_iterator{options.SourceCacheDir})
+    images.push_back(entry.path());
+  ASSERT_EQ(images.size(), 2u);
+
+  //a corrupt image is rebuilt rather than read back
+  std::ofstream{images[0], std::ios::binary | std::ios::trunc} << std::string(128, 'x');
+  Jasmin::Assembler::AssembleFile(dir / "a" / "Main.j", options);
+  Jasmin::Assembler::AssembleFile(dir / "b" / "Main.j", options);
+  EXPECT_NO_THROW(Jasmin::SourceCache::Open(images[0]));
+
+  std::filesystem::remove_all(dir);
+}